@@ -0,0 +1,104 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Adaptive acquisition rate. While every phase is steady the interval
+// between reads doubles step by step up to maxInterval. A reading far from
+// its phase average, a noisy phase, a steep forecast slope or a voltage
+// near the edge of the safe band puts it back to minInterval at once.
+
+struct AdaptiveSamplingParams {
+    uint32_t minInterval;    // ms between reads at full rate
+    uint32_t maxInterval;
+    uint32_t calmHold;       // ms without a trip before slowing down one step
+    float deviationLimit;    // V, |reading - average|
+    float noiseLimit;        // V, running RMS of the deviation
+    float slopeLimit;        // V/s, forecast trend
+    float sagVoltage;        // Trip below this ...
+    float swellVoltage;      // ... or above this
+};
+
+enum SamplingTrip : uint8_t {
+    TRIP_NONE,
+    TRIP_DEVIATION,
+    TRIP_NOISE,
+    TRIP_SLOPE,
+    TRIP_SAG,
+    TRIP_SWELL,
+    TRIP_CAUSE_COUNT
+};
+
+inline const char* samplingTripName(uint8_t trip) {
+    switch (trip) {
+        case TRIP_NONE: return "none";
+        case TRIP_DEVIATION: return "deviation";
+        case TRIP_NOISE: return "noise";
+        case TRIP_SLOPE: return "slope";
+        case TRIP_SAG: return "sag";
+        case TRIP_SWELL: return "swell";
+    }
+    return "unknown";
+}
+
+template <int PHASE_COUNT>
+class AdaptiveSampler {
+public:
+    explicit AdaptiveSampler(const AdaptiveSamplingParams& params)
+        : params_(params), interval_(params.minInterval), calmSince_(0) {
+        for (int i = 0; i < PHASE_COUNT; i++) variance_[i] = 0.0f;
+        for (int i = 0; i < TRIP_CAUSE_COUNT; i++) trips_[i] = 0;
+    }
+
+    // Feeds one reading of `phase`; `average` is the phase average before
+    // this reading. Returns the trip cause, or TRIP_NONE if the phase looks
+    // steady.
+    SamplingTrip update(int phase, float reading, float average, float slopePerSecond, uint32_t now) {
+        float deviation = reading - average;
+        variance_[phase] += VARIANCE_WEIGHT * (deviation * deviation - variance_[phase]);
+
+        SamplingTrip trip = TRIP_NONE;
+        if (reading < params_.sagVoltage) {
+            trip = TRIP_SAG;
+        } else if (reading > params_.swellVoltage) {
+            trip = TRIP_SWELL;
+        } else if (fabsf(deviation) > params_.deviationLimit) {
+            trip = TRIP_DEVIATION;
+        } else if (sqrtf(variance_[phase]) > params_.noiseLimit) {
+            trip = TRIP_NOISE;
+        } else if (fabsf(slopePerSecond) > params_.slopeLimit) {
+            trip = TRIP_SLOPE;
+        }
+
+        if (trip != TRIP_NONE) {
+            trips_[trip]++;
+            interval_ = params_.minInterval;
+            calmSince_ = now;
+        } else if (now - calmSince_ >= params_.calmHold && interval_ < params_.maxInterval) {
+            interval_ *= 2;
+            if (interval_ > params_.maxInterval) interval_ = params_.maxInterval;
+            calmSince_ = now;
+        }
+        return trip;
+    }
+
+    uint32_t interval() const { return interval_; }
+    bool atFullRate() const { return interval_ == params_.minInterval; }
+    uint32_t trips(SamplingTrip cause) const { return trips_[cause]; }
+
+    // EMA weight for one reading at the current interval, so averages keep
+    // the time constant they have at full rate
+    float emaAlpha(float alphaAtFullRate) const {
+        float steps = (float)interval_ / params_.minInterval;
+        return 1.0f - powf(1.0f - alphaAtFullRate, steps);
+    }
+
+private:
+    static constexpr float VARIANCE_WEIGHT = 0.2f;
+
+    AdaptiveSamplingParams params_;
+    uint32_t interval_;
+    uint32_t calmSince_;
+    float variance_[PHASE_COUNT];
+    uint32_t trips_[TRIP_CAUSE_COUNT];
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Token buckets for HTTP admission control. Time is passed in by the
+// caller (millis() on the device), so nothing here touches the hardware.
+
+struct TokenBucket {
+    float tokens;
+    float ratePerMs;   // Refill rate
+    float capacity;    // Burst size
+    uint32_t lastRefill;
+
+    void init(float rate, float burst, uint32_t now) {
+        ratePerMs = rate;
+        capacity = burst;
+        tokens = burst;
+        lastRefill = now;
+    }
+
+    void refill(uint32_t now) {
+        tokens += (now - lastRefill) * ratePerMs;
+        if (tokens > capacity) tokens = capacity;
+        lastRefill = now;
+    }
+
+    bool available(uint32_t now) {
+        refill(now);
+        return tokens > 0.0f;
+    }
+
+    // The balance may go negative, so an expensive operation is paid off
+    // before the next one is allowed.
+    void spend(float cost) { tokens -= cost; }
+
+    bool take(uint32_t now, float cost = 1.0f) {
+        if (!available(now)) return false;
+        spend(cost);
+        return true;
+    }
+
+    // Milliseconds until take() can succeed again
+    uint32_t waitMs(uint32_t now) {
+        return available(now) ? 0 : (uint32_t)(-tokens / ratePerMs) + 1;
+    }
+};
+
+enum AdmissionResult : uint8_t {
+    ADMIT,
+    SHED_RATE,     // Client exceeded its request rate
+    SHED_CLIENTS   // Every client slot is held by another active client
+};
+
+// One request bucket per client address. A client holds its slot while it
+// keeps making requests; a slot idle for `idleMs` goes to the next new
+// client, so at most SLOTS clients are served at a time.
+template <int SLOTS>
+class ClientRateLimiter {
+public:
+    ClientRateLimiter(float requestsPerSecond, float burst, uint32_t idleMs)
+        : rate_(requestsPerSecond / 1000.0f), burst_(burst), idleMs_(idleMs) {
+        for (int i = 0; i < SLOTS; i++) {
+            clients_[i].address = 0;
+            clients_[i].lastSeen = 0;
+        }
+    }
+
+    AdmissionResult admit(uint32_t address, uint32_t now, uint32_t* retryAfterMs = NULL) {
+        Client* client = find(address);
+        if (client == NULL) {
+            client = freeSlot(now);
+            if (client == NULL) {
+                if (retryAfterMs) *retryAfterMs = idleMs_;
+                return SHED_CLIENTS;
+            }
+            client->address = address;
+            client->bucket.init(rate_, burst_, now);
+        }
+        client->lastSeen = now;
+
+        if (!client->bucket.take(now)) {
+            if (retryAfterMs) *retryAfterMs = client->bucket.waitMs(now);
+            return SHED_RATE;
+        }
+        return ADMIT;
+    }
+
+    int activeClients(uint32_t now) const {
+        int count = 0;
+        for (int i = 0; i < SLOTS; i++) {
+            if (clients_[i].address != 0 && now - clients_[i].lastSeen < idleMs_) count++;
+        }
+        return count;
+    }
+
+private:
+    struct Client {
+        uint32_t address;  // IPv4, 0 = free
+        uint32_t lastSeen;
+        TokenBucket bucket;
+    };
+
+    Client* find(uint32_t address) {
+        for (int i = 0; i < SLOTS; i++) {
+            if (clients_[i].address == address) return &clients_[i];
+        }
+        return NULL;
+    }
+
+    // A free slot, or the longest-idle one past the idle timeout
+    Client* freeSlot(uint32_t now) {
+        Client* oldest = NULL;
+        for (int i = 0; i < SLOTS; i++) {
+            Client& client = clients_[i];
+            if (client.address == 0) return &client;
+            uint32_t idle = now - client.lastSeen;
+            if (idle >= idleMs_ && (oldest == NULL || idle > now - oldest->lastSeen)) {
+                oldest = &client;
+            }
+        }
+        return oldest;
+    }
+
+    float rate_;
+    float burst_;
+    uint32_t idleMs_;
+    Client clients_[SLOTS];
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stdint.h>
+#include "command_queue.h"
+#include "event_journal.h"
+#include "phase_config.h"
+#include "status_document.h"
+
+// The JSON API documents other than /api/status (status_document.h). Every
+// string is a pointer to static or caller-owned storage and every document
+// is built in the shared StaticJsonDocument, so answering a request does not
+// touch the heap (test/test_json_alloc checks this on the host).
+
+// Largest pages, bounded by JSON_DOCUMENT_CAPACITY
+const int EVENTS_PAGE_SIZE = 16;
+const int HISTORY_PAGE_SIZE = 40;
+
+// Reading history for clients that sync incrementally (/api/history): one
+// averaged reading per trend update, RAM only, so sequence numbers restart
+// with every boot
+struct HistoryReading {
+    uint32_t seq;
+    uint32_t timestamp;         // millis()
+    int8_t selectedPhase;
+    int16_t voltage[NUM_PHASES];  // avgVoltage in 0.1 V
+};
+
+inline void buildResult(JsonDocument& doc, bool success, const char* message) {
+    doc["success"] = success;
+    doc["message"] = message;
+}
+
+// Legacy command response. Carries the resulting mode and relay state so
+// clients can update their view without polling /api/status again: the
+// selected phase and each phase's isActive, which is false for all of them
+// while no relay is energised. `Phase` is anything with `isActive`
+// (PhaseData in main.cpp, PhaseStatus elsewhere).
+template <typename Phase>
+void buildCommandResult(JsonDocument& doc, bool success, const char* message, int mode, int selectedPhase,
+                        const Phase* phases) {
+    buildResult(doc, success, message);
+    doc["mode"] = systemModeName(mode);
+    doc["selectedPhase"] = selectedPhase;
+    JsonArray phaseArray = doc.createNestedArray("phases");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        JsonObject phaseObj = phaseArray.createNestedObject();
+        phaseObj["isActive"] = phases[i].isActive;
+    }
+}
+
+inline void buildCommandDocument(JsonDocument& doc, const Command& command, int mode, int selectedPhase) {
+    doc["id"] = command.id;
+    doc["type"] = commandTypeName(command.type);
+    doc["state"] = commandStateName(command.state);
+    if (command.reason) doc["reason"] = command.reason;
+    if (command.key[0]) doc["key"] = (const char*)command.key;
+    doc["mode"] = systemModeName(mode);
+    doc["selectedPhase"] = selectedPhase;
+}
+
+// `staIP` is NULL while the station interface is not connected
+inline void buildNetworkDocument(JsonDocument& doc, const char* deviceId, const char* firmware,
+                                 const char* apSSID, const char* apIP, const char* staSSID, const char* staIP) {
+    doc["deviceId"] = deviceId;
+    doc["firmware"] = firmware;
+    doc["ap_ssid"] = apSSID;
+    doc["ap_ip"] = apIP;
+    doc["ap_connected"] = true;
+    doc["sta_connected"] = staIP != NULL;
+    doc["sta_ip"] = staIP ? staIP : "";
+    doc["sta_ssid"] = staIP ? staSSID : "";
+}
+
+// Events newer than `since`, at most `limit` of them. `Journal` is an
+// EventJournal (event_journal.h).
+template <typename Journal>
+void buildEventsPage(JsonDocument& doc, const Journal& journal, uint16_t bootCount, uint32_t uptime,
+                     uint32_t since, int limit) {
+    uint32_t nextSeq = journal.nextSeq();
+    uint32_t oldestSeq = journal.oldestSeq();
+    uint32_t seq = since + 1 > oldestSeq ? since + 1 : oldestSeq;
+    uint32_t lastSeq = since;
+
+    doc["boot"] = bootCount;
+    doc["uptime"] = uptime;  // Event times are millis() of their boot
+    doc["oldest"] = oldestSeq;
+    doc["truncated"] = since + 1 < oldestSeq;  // Client missed events that were overwritten
+
+    JsonArray events = doc.createNestedArray("events");
+    int count = 0;
+    for (; seq < nextSeq && count < limit; seq++) {
+        typename Journal::Entry event;
+        if (!journal.read(seq, event)) continue;
+
+        JsonObject eventObj = events.createNestedObject();
+        eventObj["seq"] = event.seq;
+        eventObj["boot"] = event.bootCount;
+        eventObj["time"] = event.timestamp;
+        eventObj["cause"] = eventCauseName(event.cause);
+        eventObj["from"] = event.fromPhase;
+        eventObj["to"] = event.toPhase;
+        eventObj["detail"] = event.detail;
+        JsonArray voltages = eventObj.createNestedArray("voltages");
+        for (int i = 0; i < NUM_PHASES; i++) {
+            voltages.add(event.voltage[i] / 10.0f);
+        }
+
+        lastSeq = event.seq;
+        count++;
+    }
+
+    doc["next"] = lastSeq;  // Pass back as `since` to continue
+    doc["more"] = seq < nextSeq;
+}
+
+// Readings newer than `since` as compact rows [seq, time, selectedPhase,
+// voltage x10 per phase]. `History` is a SequenceRing of HistoryReading.
+template <typename History>
+void buildHistoryPage(JsonDocument& doc, const History& history, uint16_t bootCount, uint32_t uptime,
+                      uint32_t interval, uint32_t since, int limit) {
+    uint32_t nextSeq = history.nextSeq();
+    uint32_t oldestSeq = history.oldestSeq();
+    uint32_t seq = since + 1 > oldestSeq ? since + 1 : oldestSeq;
+    uint32_t lastSeq = since;
+
+    doc["boot"] = bootCount;
+    doc["uptime"] = uptime;
+    doc["interval"] = interval;
+    doc["truncated"] = since + 1 < oldestSeq;
+
+    JsonArray readings = doc.createNestedArray("readings");
+    int count = 0;
+    for (; seq < nextSeq && count < limit; seq++) {
+        HistoryReading reading;
+        if (!history.read(seq, reading)) continue;
+
+        JsonArray row = readings.createNestedArray();
+        row.add(reading.seq);
+        row.add(reading.timestamp);
+        row.add(reading.selectedPhase);
+        for (int i = 0; i < NUM_PHASES; i++) {
+            row.add(reading.voltage[i]);
+        }
+
+        lastSeq = reading.seq;
+        count++;
+    }
+
+    doc["next"] = lastSeq;
+    doc["more"] = seq < nextSeq;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Control commands (phase / mode changes) submitted over HTTP and executed
+// later by the control task. Each command gets an ID and may carry a client
+// idempotency key: a retry with the same key returns the original command
+// instead of queueing another relay operation. A newer command of the same
+// type supersedes one that has not run yet.
+//
+// Finished keyed commands are also copied to a small key cache and answer
+// retries for `keyTtl` ms after they finish, even once their queue slot has
+// been reused. When the cache is full the oldest result goes first.
+
+enum CommandType : uint8_t {
+    COMMAND_SET_PHASE,
+    COMMAND_SET_MODE
+};
+
+enum CommandState : uint8_t {
+    COMMAND_PENDING,
+    COMMAND_DONE,
+    COMMAND_REJECTED,
+    COMMAND_SUPERSEDED
+};
+
+inline const char* commandTypeName(uint8_t type) {
+    return type == COMMAND_SET_PHASE ? "setPhase" : "setMode";
+}
+
+inline const char* commandStateName(uint8_t state) {
+    switch (state) {
+        case COMMAND_PENDING: return "pending";
+        case COMMAND_DONE: return "done";
+        case COMMAND_REJECTED: return "rejected";
+        case COMMAND_SUPERSEDED: return "superseded";
+    }
+    return "unknown";
+}
+
+const int COMMAND_KEY_LENGTH = 33;  // Up to 32 characters, e.g. a UUID without dashes
+
+struct Command {
+    uint32_t id;           // 0 = free slot
+    uint8_t type;          // CommandType
+    int8_t argument;       // Phase index or SystemMode
+    uint8_t state;         // CommandState
+    char key[COMMAND_KEY_LENGTH];
+    const char* reason;    // Why it was rejected or superseded (static string)
+    uint32_t submittedAt;  // millis()
+    uint32_t completedAt;
+};
+
+template <int CAPACITY, int KEY_CACHE_SIZE>
+class CommandQueue {
+public:
+    explicit CommandQueue(uint32_t keyTtl) : nextId_(1), keyTtl_(keyTtl), nextKeyed_(0) {
+        memset(commands_, 0, sizeof(commands_));
+        memset(keyed_, 0, sizeof(keyed_));
+    }
+
+    // Queues a command, or returns the existing one when `key` was seen
+    // before (`duplicate` is set). Returns NULL if every slot holds a
+    // pending command.
+    Command* submit(uint8_t type, int8_t argument, const char* key, uint32_t now, bool& duplicate) {
+        duplicate = false;
+        if (key && key[0]) {
+            for (int i = 0; i < CAPACITY; i++) {
+                if (commands_[i].id != 0 && strncmp(commands_[i].key, key, COMMAND_KEY_LENGTH - 1) == 0) {
+                    duplicate = true;
+                    return &commands_[i];
+                }
+            }
+            for (int i = 0; i < KEY_CACHE_SIZE; i++) {
+                if (live(keyed_[i], now) && strncmp(keyed_[i].key, key, COMMAND_KEY_LENGTH - 1) == 0) {
+                    duplicate = true;
+                    return &keyed_[i];
+                }
+            }
+        }
+
+        // Reuse the slot of the oldest finished command
+        Command* slot = NULL;
+        for (int i = 0; i < CAPACITY; i++) {
+            Command& c = commands_[i];
+            if (c.id != 0 && c.state == COMMAND_PENDING) continue;
+            if (!slot || c.id < slot->id) slot = &c;
+        }
+        if (!slot) return NULL;
+
+        uint32_t id = nextId_++;
+        for (int i = 0; i < CAPACITY; i++) {
+            Command& c = commands_[i];
+            if (c.id != 0 && c.state == COMMAND_PENDING && c.type == type) {
+                complete(&c, COMMAND_SUPERSEDED, "superseded", now);
+            }
+        }
+
+        memset(slot, 0, sizeof(Command));
+        slot->id = id;
+        slot->type = type;
+        slot->argument = argument;
+        slot->state = COMMAND_PENDING;
+        slot->submittedAt = now;
+        if (key) {
+            memcpy(slot->key, key, strnlen(key, COMMAND_KEY_LENGTH - 1));  // The slot is zeroed
+        }
+        return slot;
+    }
+
+    // A queued command, or a keyed one still in the key cache
+    Command* find(uint32_t id, uint32_t now) {
+        if (id == 0) return NULL;
+        for (int i = 0; i < CAPACITY; i++) {
+            if (commands_[i].id == id) return &commands_[i];
+        }
+        for (int i = 0; i < KEY_CACHE_SIZE; i++) {
+            if (keyed_[i].id == id && live(keyed_[i], now)) return &keyed_[i];
+        }
+        return NULL;
+    }
+
+    // Oldest pending command, NULL if none
+    Command* nextPending() {
+        Command* oldest = NULL;
+        for (int i = 0; i < CAPACITY; i++) {
+            Command& c = commands_[i];
+            if (c.id != 0 && c.state == COMMAND_PENDING && (!oldest || c.id < oldest->id)) oldest = &c;
+        }
+        return oldest;
+    }
+
+    void complete(Command* command, uint8_t state, const char* reason, uint32_t now) {
+        command->state = state;
+        command->reason = reason;
+        command->completedAt = now;
+        if (command->key[0]) {
+            keyed_[nextKeyed_] = *command;
+            nextKeyed_ = (nextKeyed_ + 1) % KEY_CACHE_SIZE;
+        }
+    }
+
+private:
+    bool live(const Command& cached, uint32_t now) const {
+        return cached.id != 0 && now - cached.completedAt < keyTtl_;
+    }
+
+    Command commands_[CAPACITY];
+    uint32_t nextId_;
+    uint32_t keyTtl_;
+    Command keyed_[KEY_CACHE_SIZE];
+    int nextKeyed_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "adaptive_sampling.h"
+
+// Thresholds and timing of the acquisition and switching pipeline. Shared
+// by the application and the host decision model (best_phase_fleet
+// tools/decision_sim), so the tuner scores the limits and cadence that ship.
+
+// Weight of one reading in the phase average at VOLTAGE_READ_INTERVAL;
+// slower reads scale it up (AdaptiveSampler::emaAlpha())
+const float VOLTAGE_EMA_ALPHA = 0.15f;
+
+// Safety thresholds
+const float OVERVOLTAGE_THRESHOLD = 260.0;
+const float UNDERVOLTAGE_THRESHOLD = 180.0;
+const float MIN_VOLTAGE = 150.0;
+
+// Timing
+const unsigned long VOLTAGE_READ_INTERVAL = 200;      // One phase per read
+const unsigned long TREND_UPDATE_INTERVAL = 5000;     // Phase selection
+const unsigned long MIN_MAX_RESET_INTERVAL = 300000;  // Fresh min/max every 5 minutes
+const unsigned long FORECAST_HORIZON = 30000;         // Score phases on where they will be in 30 s
+
+// Reads slow down to one per 800 ms after 30 s without a trip and return to
+// VOLTAGE_READ_INTERVAL at once when a phase moves (ENABLE_ADAPTIVE_SAMPLING).
+// bpd_sampling_bench (best_phase_fleet) weighs the CPU saved against
+// detection latency.
+const AdaptiveSamplingParams ADAPTIVE_SAMPLING_PARAMS = {
+    VOLTAGE_READ_INTERVAL, 800, 30000,
+    4.0f,   // V from the phase average
+    2.0f,   // V RMS deviation
+    0.2f,   // V/s forecast slope
+    UNDERVOLTAGE_THRESHOLD + 15.0f, OVERVOLTAGE_THRESHOLD - 10.0f
+};
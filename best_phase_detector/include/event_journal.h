@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include "sequence_ring.h"
+
+// Fixed-size event journal: a RAM ring of events indexed by their sequence
+// number (see sequence_ring.h).
+
+enum EventCause : uint8_t {
+    EVENT_BOOT,
+    EVENT_SWITCH_AUTO,
+    EVENT_SWITCH_MANUAL,
+    EVENT_BLOCKED_LOCKOUT,
+    EVENT_BLOCKED_RATE,
+    EVENT_BLOCKED_LOW_VOLTAGE,
+    EVENT_BLOCKED_HIGH_VOLTAGE,
+    EVENT_MODE_CHANGE,
+    EVENT_BUTTON
+};
+
+inline const char* eventCauseName(uint8_t cause) {
+    switch (cause) {
+        case EVENT_BOOT: return "boot";
+        case EVENT_SWITCH_AUTO: return "switch_auto";
+        case EVENT_SWITCH_MANUAL: return "switch_manual";
+        case EVENT_BLOCKED_LOCKOUT: return "blocked_lockout";
+        case EVENT_BLOCKED_RATE: return "blocked_rate";
+        case EVENT_BLOCKED_LOW_VOLTAGE: return "blocked_low_voltage";
+        case EVENT_BLOCKED_HIGH_VOLTAGE: return "blocked_high_voltage";
+        case EVENT_MODE_CHANGE: return "mode_change";
+        case EVENT_BUTTON: return "button";
+    }
+    return "unknown";
+}
+
+template <int PHASE_COUNT>
+struct JournalEvent {
+    uint32_t seq;
+    uint32_t timestamp;   // millis() at the time of the event
+    uint16_t bootCount;   // Boot the timestamp belongs to
+    uint8_t cause;        // EventCause
+    uint8_t detail;       // Cause-specific (new mode, button/press type, transfer gap in ms)
+    int8_t fromPhase;
+    int8_t toPhase;
+    int16_t voltage[PHASE_COUNT];  // Per-phase snapshot in 0.1 V
+};
+
+template <int CAPACITY, int PHASE_COUNT>
+using EventJournal = SequenceRing<JournalEvent<PHASE_COUNT>, CAPACITY>;
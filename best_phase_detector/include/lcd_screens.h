@@ -0,0 +1,57 @@
+#pragma once
+
+#include "phase_config.h"
+
+// The 16x2 LCD screens. `Display` is LiquidCrystal_I2C or anything with its
+// clear()/setCursor()/print(); `Phase` is anything with `voltage` and
+// `isActive` (PhaseData in main.cpp, PhaseStatus in the bench). Each screen
+// redraws from a cleared display.
+
+// Phase voltages in 7-character slots, two per line ("P1:230 P2:231"). The
+// active phase shows '*' in place of the ':'.
+template <typename Display, typename Phase>
+void drawMainScreen(Display& lcd, const Phase* phases, bool automatic) {
+    const int SLOT_WIDTH = 7;
+    lcd.clear();
+    for (int i = 0; i < NUM_PHASES; i++) {
+        lcd.setCursor((i % 2) * SLOT_WIDTH, i / 2);
+        lcd.print("P");
+        lcd.print(i + 1);
+        lcd.print(phases[i].isActive ? "*" : ":");
+        lcd.print((int)phases[i].voltage);
+    }
+
+    // Mode in the next free slot, or squeezed into the last column
+    if (NUM_PHASES < 4) {
+        lcd.setCursor((NUM_PHASES % 2) * SLOT_WIDTH, NUM_PHASES / 2);
+        lcd.print(automatic ? "AUTO" : "MAN");
+    } else {
+        lcd.setCursor(15, 1);
+        lcd.print(automatic ? "A" : "M");
+    }
+}
+
+template <typename Display, typename Phase>
+void drawSelectPhaseScreen(Display& lcd, const Phase* phases, int menuIndex, int selectedPhase) {
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("Select Phase:");
+    lcd.setCursor(0, 1);
+    lcd.print(PHASE_TABLE[menuIndex].name);
+    lcd.print(" ");
+    lcd.print((int)phases[menuIndex].voltage);
+    lcd.print("V");
+    if (menuIndex == selectedPhase) {
+        lcd.print("*");
+    }
+}
+
+template <typename Display>
+void drawSettingsScreen(Display& lcd, bool automatic) {
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("Settings:");
+    lcd.setCursor(0, 1);
+    lcd.print("Mode: ");
+    lcd.print(automatic ? "Auto" : "Manual");
+}
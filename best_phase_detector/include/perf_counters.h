@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+// Duration statistics for an instrumented code path: min/max/sum plus a
+// fixed histogram, all in microseconds. Recording is a handful of compares
+// and adds, cheap enough to leave enabled on the hot paths.
+
+const int PERF_BUCKET_COUNT = 8;
+
+// Upper bounds of the first PERF_BUCKET_COUNT - 1 buckets; the last bucket
+// catches everything slower.
+const uint32_t PERF_BUCKET_BOUNDS_US[PERF_BUCKET_COUNT - 1] = {
+    50, 200, 1000, 5000, 20000, 100000, 500000
+};
+
+struct PerfStat {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t buckets[PERF_BUCKET_COUNT];
+
+    PerfStat() { reset(); }
+
+    void reset() {
+        count = 0;
+        minUs = UINT32_MAX;
+        maxUs = 0;
+        totalUs = 0;
+        for (int i = 0; i < PERF_BUCKET_COUNT; i++) buckets[i] = 0;
+    }
+
+    void record(uint32_t us) {
+        count++;
+        totalUs += us;
+        if (us < minUs) minUs = us;
+        if (us > maxUs) maxUs = us;
+
+        int bucket = 0;
+        while (bucket < PERF_BUCKET_COUNT - 1 && us > PERF_BUCKET_BOUNDS_US[bucket]) bucket++;
+        buckets[bucket]++;
+    }
+
+    float averageUs() const {
+        return count > 0 ? (float)totalUs / count : 0.0f;
+    }
+};
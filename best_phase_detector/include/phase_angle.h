@@ -0,0 +1,198 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Relationships between the three phases of one supply, from a capture
+// that samples the channels round robin over exactly one mains cycle.
+// Each channel's fundamental phasor comes from a single-bin DFT that is
+// updated sample by sample with the sample's own timestamp. The channels
+// need not be sampled simultaneously, and nothing is buffered.
+//
+// From the phasors: the angle of each phase relative to the first, the
+// phase sequence, and the voltage unbalance factor (negative- over
+// positive-sequence magnitude, symmetrical components).
+
+struct Phasor {
+    float re;
+    float im;
+
+    float magnitude() const { return sqrtf(re * re + im * im); }
+    float degrees() const { return atan2f(im, re) * (180.0f / (float)M_PI); }
+};
+
+inline Phasor phasorMul(const Phasor& a, const Phasor& b) {
+    Phasor product = {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+    return product;
+}
+
+// a / b; b must not be zero
+inline Phasor phasorDiv(const Phasor& a, const Phasor& b) {
+    float norm = b.re * b.re + b.im * b.im;
+    Phasor quotient = {(a.re * b.re + a.im * b.im) / norm, (a.im * b.re - a.re * b.im) / norm};
+    return quotient;
+}
+
+// Wraps an angle difference into (-180, 180]
+inline float wrapDegrees(float degrees) {
+    while (degrees > 180.0f) degrees -= 360.0f;
+    while (degrees <= -180.0f) degrees += 360.0f;
+    return degrees;
+}
+
+// Fundamental phasor per channel, accumulated one sample at a time. The
+// DC offset is removed at the end from the running sums, so raw ADC
+// counts can be fed in directly.
+template <int CHANNELS>
+class CycleDft {
+public:
+    void begin(uint32_t startUs, float frequency) {
+        startUs_ = startUs;
+        radiansPerUs_ = 2.0f * (float)M_PI * frequency / 1000000.0f;
+        for (int i = 0; i < CHANNELS; i++) {
+            count_[i] = 0;
+            sum_[i] = re_[i] = im_[i] = cosSum_[i] = sinSum_[i] = 0.0f;
+        }
+    }
+
+    void add(int channel, uint16_t sample, uint32_t timeUs) {
+        float theta = radiansPerUs_ * (float)(timeUs - startUs_);
+        float c = cosf(theta);
+        float s = sinf(theta);
+        count_[channel]++;
+        sum_[channel] += sample;
+        re_[channel] += sample * c;
+        im_[channel] -= sample * s;
+        cosSum_[channel] += c;
+        sinSum_[channel] += s;
+    }
+
+    // Peak amplitude and phase of the fundamental, in ADC counts
+    Phasor phasor(int channel) const {
+        Phasor result = {0.0f, 0.0f};
+        if (count_[channel] == 0) return result;
+        float mean = sum_[channel] / count_[channel];
+        float scale = 2.0f / count_[channel];
+        result.re = (re_[channel] - mean * cosSum_[channel]) * scale;
+        result.im = (im_[channel] + mean * sinSum_[channel]) * scale;
+        return result;
+    }
+
+    int count(int channel) const { return count_[channel]; }
+
+private:
+    uint32_t startUs_;
+    float radiansPerUs_;
+    int count_[CHANNELS];
+    float sum_[CHANNELS];
+    float re_[CHANNELS];
+    float im_[CHANNELS];
+    float cosSum_[CHANNELS];
+    float sinSum_[CHANNELS];
+};
+
+enum PhaseSequence : int8_t {
+    SEQUENCE_UNKNOWN = 0,
+    SEQUENCE_POSITIVE = 1,   // 1-2-3 (ABC)
+    SEQUENCE_NEGATIVE = -1   // 1-3-2 (ACB): two phases swapped
+};
+
+inline const char* phaseSequenceName(PhaseSequence sequence) {
+    switch (sequence) {
+        case SEQUENCE_POSITIVE: return "123";
+        case SEQUENCE_NEGATIVE: return "132";
+        case SEQUENCE_UNKNOWN: break;
+    }
+    return "unknown";
+}
+
+struct PhaseRelations {
+    float angle[3];         // Degrees relative to phase 1, (-180, 180]
+    float displacement[3];  // Degrees from the ideal 120-degree position
+    float unbalance;        // %, weaker over stronger sequence component
+    PhaseSequence sequence;
+};
+
+// Tracks the three phasors of a supply across cycles. Every cycle is
+// reduced to the ratios of phases 2 and 3 to phase 1, which do not depend
+// on where the capture window started, and the ratios are smoothed with
+// an EMA before the angles and the unbalance are derived.
+class PhaseRelationTracker {
+public:
+    // `minAmplitude` in the units of the phasors; a cycle with a weaker
+    // phase is counted but not used
+    explicit PhaseRelationTracker(float alpha = 0.2f, float minAmplitude = 200.0f)
+        : alpha_(alpha), minAmplitude_(minAmplitude), valid_(false), cycles_(0), incomplete_(0) {
+        for (int k = 0; k < 3; k++) ratio_[k].re = ratio_[k].im = 0.0f;
+    }
+
+    // Feeds one cycle. Returns false if a phase was too weak to use.
+    bool update(const Phasor phasors[3]) {
+        cycles_++;
+        for (int i = 0; i < 3; i++) {
+            if (phasors[i].magnitude() < minAmplitude_) {
+                incomplete_++;
+                valid_ = false;
+                return false;
+            }
+        }
+        for (int k = 1; k < 3; k++) {
+            Phasor ratio = phasorDiv(phasors[k], phasors[0]);
+            if (!valid_) {
+                ratio_[k] = ratio;
+            } else {
+                ratio_[k].re += alpha_ * (ratio.re - ratio_[k].re);
+                ratio_[k].im += alpha_ * (ratio.im - ratio_[k].im);
+            }
+        }
+        valid_ = true;
+        return true;
+    }
+
+    bool valid() const { return valid_; }
+    uint32_t cycles() const { return cycles_; }
+    uint32_t incompleteCycles() const { return incomplete_; }
+
+    // Symmetrical components of the smoothed ratios (phase 1 = 1). The
+    // sequence follows the stronger component. Beyond 50% unbalance
+    // neither dominates clearly, and the sequence is reported as unknown.
+    PhaseRelations relations() const {
+        PhaseRelations result;
+        const Phasor one = {1.0f, 0.0f};
+        const Phasor a = {-0.5f, 0.8660254f};    // 1 at 120 degrees
+        const Phasor a2 = {-0.5f, -0.8660254f};  // 1 at 240 degrees
+        Phasor ratios[3] = {one, ratio_[1], ratio_[2]};
+
+        Phasor t1 = phasorMul(a, ratios[1]);
+        Phasor t2 = phasorMul(a2, ratios[2]);
+        Phasor positive = {(1.0f + t1.re + t2.re) / 3.0f, (t1.im + t2.im) / 3.0f};
+        t1 = phasorMul(a2, ratios[1]);
+        t2 = phasorMul(a, ratios[2]);
+        Phasor negative = {(1.0f + t1.re + t2.re) / 3.0f, (t1.im + t2.im) / 3.0f};
+
+        float v1 = positive.magnitude();
+        float v2 = negative.magnitude();
+        bool forward = v1 >= v2;
+        result.unbalance = forward ? 100.0f * v2 / v1 : 100.0f * v1 / v2;
+        result.sequence = result.unbalance > 50.0f ? SEQUENCE_UNKNOWN
+                        : forward ? SEQUENCE_POSITIVE : SEQUENCE_NEGATIVE;
+
+        // Phase k ideally sits 120 k degrees behind (or, reversed, ahead
+        // of) the dominant component
+        float reference = forward ? positive.degrees() : negative.degrees();
+        float step = forward ? -120.0f : 120.0f;
+        for (int k = 0; k < 3; k++) {
+            result.angle[k] = k == 0 ? 0.0f : ratios[k].degrees();
+            result.displacement[k] = wrapDegrees(result.angle[k] - (reference + step * k));
+        }
+        return result;
+    }
+
+private:
+    float alpha_;
+    float minAmplitude_;
+    Phasor ratio_[3];  // [0] unused: phase 1 is the reference
+    bool valid_;
+    uint32_t cycles_;
+    uint32_t incomplete_;
+};
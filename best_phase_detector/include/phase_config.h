@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+// Compile-time phase table. Everything that deals with phases (sampling,
+// relays, scoring, LCD, API) iterates over PHASE_TABLE, so a board variant
+// only needs a different profile here. Select one with
+// -DPHASE_PROFILE=PHASE_PROFILE_... in platformio.ini build_flags.
+
+struct PhaseConfig {
+    uint8_t adcPin;        // ZMPT101B output
+    uint8_t relayPin;      // Relay driver input
+    const char* name;
+    bool relayActiveLow;   // true: driving the pin LOW energises the relay
+};
+
+#define PHASE_PROFILE_THREE_PHASE 0
+#define PHASE_PROFILE_SINGLE_PHASE 1
+#define PHASE_PROFILE_MULTI_SOURCE 2  // Grid + generator + inverter
+
+#ifndef PHASE_PROFILE
+#define PHASE_PROFILE PHASE_PROFILE_THREE_PHASE
+#endif
+
+#if PHASE_PROFILE == PHASE_PROFILE_THREE_PHASE
+constexpr PhaseConfig PHASE_TABLE[] = {
+    {32, 18, "Phase 1", true},
+    {35, 16, "Phase 2", true},
+    {34, 23, "Phase 3", true},
+};
+#elif PHASE_PROFILE == PHASE_PROFILE_SINGLE_PHASE
+constexpr PhaseConfig PHASE_TABLE[] = {
+    {32, 18, "Mains", true},
+};
+#elif PHASE_PROFILE == PHASE_PROFILE_MULTI_SOURCE
+constexpr PhaseConfig PHASE_TABLE[] = {
+    {32, 18, "Grid", true},
+    {35, 16, "Generator", true},
+    {34, 23, "Inverter", true},
+};
+#else
+#error "Unknown PHASE_PROFILE"
+#endif
+
+constexpr int NUM_PHASES = sizeof(PHASE_TABLE) / sizeof(PHASE_TABLE[0]);
+
+// The LCD main screen shows two 7-character phase slots per 16x2 line
+static_assert(NUM_PHASES >= 1 && NUM_PHASES <= 4, "PHASE_TABLE must have 1 to 4 entries");
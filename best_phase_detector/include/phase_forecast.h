@@ -0,0 +1,59 @@
+#pragma once
+
+// Short-term voltage forecast using Holt's linear (double exponential)
+// smoothing. Readings arrive at irregular intervals, so the trend is kept in
+// volts per second and each update advances the level by the elapsed time.
+// Constant memory and O(1) work per reading.
+class HoltForecaster {
+public:
+    HoltForecaster(float alpha = 0.3f, float beta = 0.05f)
+        : alpha_(alpha), beta_(beta) {
+        reset();
+    }
+
+    void reset() {
+        level_ = 0.0f;
+        trend_ = 0.0f;
+        lastUpdate_ = 0;
+        samples_ = 0;
+    }
+
+    void update(float value, unsigned long now) {
+        if (samples_ == 0) {
+            level_ = value;
+            trend_ = 0.0f;
+        } else {
+            float dt = (now - lastUpdate_) / 1000.0f;
+            if (dt <= 0.0f) dt = 0.001f;
+
+            float previousLevel = level_;
+            level_ = alpha_ * value + (1.0f - alpha_) * (level_ + trend_ * dt);
+            trend_ = beta_ * ((level_ - previousLevel) / dt) + (1.0f - beta_) * trend_;
+        }
+        lastUpdate_ = now;
+        if (samples_ < 255) samples_++;
+    }
+
+    // Predicted value `horizonMs` after the last reading. Until a few
+    // readings have been seen the trend is unreliable, so only the level
+    // is returned.
+    float predict(unsigned long horizonMs) const {
+        if (samples_ < MIN_SAMPLES) return level_;
+        float predicted = level_ + trend_ * (horizonMs / 1000.0f);
+        return predicted < 0.0f ? 0.0f : predicted;
+    }
+
+    float level() const { return level_; }
+    float trendPerSecond() const { return trend_; }
+    bool isWarm() const { return samples_ >= MIN_SAMPLES; }
+
+private:
+    static const unsigned char MIN_SAMPLES = 5;
+
+    float alpha_;
+    float beta_;
+    float level_;
+    float trend_;
+    unsigned long lastUpdate_;
+    unsigned char samples_;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// RMS, EMA and phase scoring in two flavours: the float reference and a
+// Q16.16 fixed-point version. main.cpp picks one with USE_FIXED_POINT; both
+// are kept so results can be compared against each other.
+
+// ---------------------------------------------------------------------------
+// Scoring parameters
+// ---------------------------------------------------------------------------
+
+struct ScoringParams {
+    float targetVoltage;           // Voltage score peaks here
+    float maxVoltageError;         // Voltage score reaches 0 at this distance
+    float maxVariation;            // Stability score reaches 0 at this min/max spread
+    float voltageWeight;           // Weights without waveform data
+    float stabilityWeight;
+    float waveformVoltageWeight;   // Weights once waveform quality is known
+    float waveformStabilityWeight;
+    float waveformWeight;
+};
+
+const ScoringParams DEFAULT_SCORING_PARAMS = {
+    220.0f, 50.0f, 30.0f,
+    0.6f, 0.4f,
+    0.5f, 0.25f, 0.25f
+};
+
+// ---------------------------------------------------------------------------
+// Float reference
+// ---------------------------------------------------------------------------
+
+// RMS of the AC component of `count` raw ADC readings, in volts.
+inline float rmsFromSamples(const int* readings, int count, float voltsPerCount) {
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++) sum += readings[i];
+    float mean = sum / count;
+
+    float sumSquared = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float ac = (readings[i] - mean) * voltsPerCount;
+        sumSquared += ac * ac;
+    }
+    return sqrtf(sumSquared / count);
+}
+
+inline float ema(float average, float value, float alpha) {
+    return average * (1.0f - alpha) + value * alpha;
+}
+
+// Score 0-100 (plus whatever the weights add up to). `waveformScore` is
+// negative when no waveform analysis is available.
+inline float scorePhase(float avgVoltage, float predictedVoltage, float variation,
+                        float waveformScore, const ScoringParams& p) {
+    float stabilityScore = 100.0f * (1.0f - fminf(fmaxf(variation, 0.0f) / p.maxVariation, 1.0f));
+
+    float voltageError = fmaxf(fabsf(avgVoltage - p.targetVoltage),
+                               fabsf(predictedVoltage - p.targetVoltage));
+    float voltageScore = 100.0f * (1.0f - fminf(voltageError / p.maxVoltageError, 1.0f));
+
+    if (waveformScore < 0.0f) {
+        return voltageScore * p.voltageWeight + stabilityScore * p.stabilityWeight;
+    }
+    return voltageScore * p.waveformVoltageWeight + stabilityScore * p.waveformStabilityWeight +
+           waveformScore * p.waveformWeight;
+}
+
+// ---------------------------------------------------------------------------
+// Q16.16 fixed point
+// ---------------------------------------------------------------------------
+
+typedef int32_t q16_t;
+
+const q16_t Q16_ONE = 65536;
+
+inline q16_t toQ16(float value) { return (q16_t)lrintf(value * 65536.0f); }
+inline float fromQ16(q16_t value) { return value / 65536.0f; }
+
+// Unsigned Q8.24, for scale factors whose Q16 rounding would show in the
+// result (a 0.2 V/count scale is off by up to 38 ppm in Q16)
+inline uint32_t toQ24(float value) { return (uint32_t)lrintf(value * 16777216.0f); }
+
+// Products and quotients round to nearest, so chained operations do not
+// drift low
+inline q16_t q16Mul(q16_t a, q16_t b) { return (q16_t)(((int64_t)a * b + 0x8000) >> 16); }
+inline q16_t q16Div(q16_t a, q16_t b) {
+    int64_t n = (int64_t)a << 16;
+    return (q16_t)(((n < 0) == (b < 0) ? n + b / 2 : n - b / 2) / b);
+}
+inline q16_t q16Abs(q16_t a) { return a < 0 ? -a : a; }
+inline q16_t q16Min(q16_t a, q16_t b) { return a < b ? a : b; }
+inline q16_t q16Max(q16_t a, q16_t b) { return a > b ? a : b; }
+
+inline uint32_t isqrt64(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+// Single-pass integer RMS: feed raw readings while sampling, no second pass
+// and no per-sample float conversion. Exact for windows of up to ~8000
+// 12-bit samples.
+struct RmsAccumulator {
+    uint32_t count;
+    uint32_t sum;
+    uint64_t sumSquares;
+
+    RmsAccumulator() : count(0), sum(0), sumSquares(0) {}
+
+    void add(uint32_t reading) {
+        count++;
+        sum += reading;
+        sumSquares += reading * reading;
+    }
+
+    // AC RMS in volts (Q16.16) for a Q8.24 volts-per-count scale (toQ24).
+    q16_t rms(uint32_t voltsPerCountQ24) const {
+        if (count == 0) return 0;
+        // n^2 * variance, shifted so the root keeps 8 fractional bits
+        uint64_t spread = (uint64_t)count * sumSquares - (uint64_t)sum * sum;
+        uint64_t rmsCountsQ8 = (isqrt64(spread << 16) + count / 2) / count;
+        return (q16_t)((rmsCountsQ8 * voltsPerCountQ24 + 0x8000) >> 16);
+    }
+};
+
+inline q16_t emaQ16(q16_t average, q16_t value, q16_t alpha) {
+    return average + q16Mul(value - average, alpha);
+}
+
+struct ScoringParamsQ16 {
+    q16_t targetVoltage;
+    q16_t maxVoltageError;
+    q16_t maxVariation;
+    q16_t voltageWeight;
+    q16_t stabilityWeight;
+    q16_t waveformVoltageWeight;
+    q16_t waveformStabilityWeight;
+    q16_t waveformWeight;
+};
+
+inline ScoringParamsQ16 toQ16(const ScoringParams& p) {
+    ScoringParamsQ16 q = {
+        toQ16(p.targetVoltage), toQ16(p.maxVoltageError), toQ16(p.maxVariation),
+        toQ16(p.voltageWeight), toQ16(p.stabilityWeight),
+        toQ16(p.waveformVoltageWeight), toQ16(p.waveformStabilityWeight), toQ16(p.waveformWeight)
+    };
+    return q;
+}
+
+inline ScoringParams fromQ16(const ScoringParamsQ16& q) {
+    ScoringParams p = {
+        fromQ16(q.targetVoltage), fromQ16(q.maxVoltageError), fromQ16(q.maxVariation),
+        fromQ16(q.voltageWeight), fromQ16(q.stabilityWeight),
+        fromQ16(q.waveformVoltageWeight), fromQ16(q.waveformStabilityWeight), fromQ16(q.waveformWeight)
+    };
+    return p;
+}
+
+inline q16_t scorePhaseQ16(q16_t avgVoltage, q16_t predictedVoltage, q16_t variation,
+                           q16_t waveformScore, const ScoringParamsQ16& p) {
+    const q16_t HUNDRED = 100 * Q16_ONE;
+
+    q16_t variationRatio = q16Min(q16Div(q16Max(variation, 0), p.maxVariation), Q16_ONE);
+    q16_t stabilityScore = 100 * (Q16_ONE - variationRatio);
+
+    q16_t voltageError = q16Max(q16Abs(avgVoltage - p.targetVoltage),
+                                q16Abs(predictedVoltage - p.targetVoltage));
+    q16_t errorRatio = q16Min(q16Div(voltageError, p.maxVoltageError), Q16_ONE);
+    q16_t voltageScore = HUNDRED - 100 * errorRatio;
+
+    if (waveformScore < 0) {
+        return q16Mul(voltageScore, p.voltageWeight) + q16Mul(stabilityScore, p.stabilityWeight);
+    }
+    return q16Mul(voltageScore, p.waveformVoltageWeight) +
+           q16Mul(stabilityScore, p.waveformStabilityWeight) +
+           q16Mul(waveformScore, p.waveformWeight);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include "decision_config.h"
+#include "phase_math.h"
+
+// Per-phase statistics and the choice of the best phase, shared by
+// readVoltage()/findBestPhase() in main.cpp and the host decision model.
+
+// A plausible reading updates the running extremes; a dead phase (50 V or
+// less) does not pull the minimum down
+inline void trackExtremes(float reading, float& minVoltage, float& maxVoltage) {
+    if (reading < minVoltage && reading > 50.0f) minVoltage = reading;
+    if (reading > maxVoltage) maxVoltage = reading;
+}
+
+// Phase average, seeded with the first reading
+inline float updateAverage(float average, float reading, float alpha) {
+    return average == 0.0f ? reading : ema(average, reading, alpha);
+}
+
+inline bool voltageOutOfBand(float voltage) {
+    return voltage < UNDERVOLTAGE_THRESHOLD || voltage > OVERVOLTAGE_THRESHOLD;
+}
+
+enum PhaseVerdict : uint8_t {
+    PHASE_SCORED,
+    PHASE_REJECTED_LOW,         // Average below MIN_VOLTAGE
+    PHASE_REJECTED_FORECAST,    // Forecast leaves the safe band
+    PHASE_REJECTED_DISTORTION   // THD above the limit
+};
+
+struct PhaseCandidate {
+    // Filled in by the caller
+    float average;
+    float forecast;        // Predicted voltage at the forecast horizon
+    float variation;       // maxVoltage - minVoltage
+    float waveformScore;   // 0-100, -1 without waveform data
+    bool distorted;
+    // Filled in by selectBestPhase()
+    PhaseVerdict verdict;
+    float score;           // -1 unless scored
+};
+
+// Gates every phase and scores the rest with `score(index, candidate)`
+// (scorePhase() or its fixed-point twin). Returns the index of the highest
+// score, the lowest index on a tie, or -1 if no phase qualifies.
+template <typename Score>
+int selectBestPhase(PhaseCandidate* candidates, int count, Score score) {
+    int best = -1;
+    float bestScore = -1.0f;
+    for (int i = 0; i < count; i++) {
+        PhaseCandidate& candidate = candidates[i];
+        candidate.score = -1.0f;
+        if (candidate.average < MIN_VOLTAGE) {
+            candidate.verdict = PHASE_REJECTED_LOW;
+            continue;
+        }
+        // Reject phases forecast to leave the safe band before they get there
+        if (voltageOutOfBand(candidate.forecast)) {
+            candidate.verdict = PHASE_REJECTED_FORECAST;
+            continue;
+        }
+        if (candidate.distorted) {
+            candidate.verdict = PHASE_REJECTED_DISTORTION;
+            continue;
+        }
+
+        candidate.verdict = PHASE_SCORED;
+        candidate.score = score(i, candidate);
+        if (candidate.score > bestScore) {
+            bestScore = candidate.score;
+            best = i;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Power-quality analysis of one raw ADC capture window.
+//
+// The capture is only a few mains cycles long, so harmonics are measured
+// with Hann-windowed Goertzel filters tuned to multiples of the measured
+// fundamental rather than with a full FFT.
+
+struct PowerQuality {
+    float frequency;    // Hz, 0 when no stable zero crossings were found
+    float thd;          // Total harmonic distortion, percent of fundamental
+    float crestFactor;  // Peak / RMS of the AC component
+    float flicker;      // RMS of window-to-window relative change, percent
+    bool valid;
+};
+
+const int PQ_MAX_HARMONIC = 11;
+
+// Amplitude of the component at `freq` using a Hann-windowed Goertzel filter.
+inline float goertzelAmplitude(const uint16_t* samples, int count, float mean,
+                               float freq, float sampleRate) {
+    float omega = 2.0f * (float)M_PI * freq / sampleRate;
+    float coeff = 2.0f * cosf(omega);
+    float s1 = 0.0f;
+    float s2 = 0.0f;
+    float windowStep = 2.0f * (float)M_PI / (count - 1);
+
+    for (int i = 0; i < count; i++) {
+        float window = 0.5f - 0.5f * cosf(windowStep * i);
+        float s0 = (samples[i] - mean) * window + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+
+    float power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+    if (power < 0.0f) power = 0.0f;
+    // Hann window has a coherent gain of 0.5
+    return 2.0f * sqrtf(power) / (count * 0.5f);
+}
+
+// Fundamental frequency from interpolated rising zero crossings.
+inline float estimateFrequency(const uint16_t* samples, int count, float mean,
+                               float sampleRate) {
+    float firstCrossing = -1.0f;
+    float lastCrossing = -1.0f;
+    int crossings = 0;
+
+    // Small hysteresis band so noise around the midpoint is not counted
+    const float HYSTERESIS = 8.0f;
+    bool armed = false;
+
+    for (int i = 1; i < count; i++) {
+        float previous = samples[i - 1] - mean;
+        float current = samples[i] - mean;
+        if (current < -HYSTERESIS) armed = true;
+        if (armed && previous < 0.0f && current >= 0.0f) {
+            float position = (i - 1) + (-previous / (current - previous));
+            if (firstCrossing < 0.0f) firstCrossing = position;
+            lastCrossing = position;
+            crossings++;
+            armed = false;
+        }
+    }
+
+    if (crossings < 2) return 0.0f;
+    float periodSamples = (lastCrossing - firstCrossing) / (crossings - 1);
+    return sampleRate / periodSamples;
+}
+
+// Frequency, THD and crest factor of one window. `previousRms` carries the
+// last window's RMS (in ADC counts) for the flicker estimate and is updated.
+inline void analyzePowerQuality(const uint16_t* samples, int count, float sampleRate,
+                                float nominalFrequency, float& previousRms,
+                                PowerQuality& result) {
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    float mean = sum / count;
+
+    float sumSquares = 0.0f;
+    float peak = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float ac = samples[i] - mean;
+        sumSquares += ac * ac;
+        if (fabsf(ac) > peak) peak = fabsf(ac);
+    }
+    float rms = sqrtf(sumSquares / count);
+
+    // Too little signal to say anything about the waveform
+    if (rms < 4.0f) {
+        result.frequency = 0.0f;
+        result.thd = 0.0f;
+        result.crestFactor = 0.0f;
+        result.valid = false;
+        previousRms = 0.0f;
+        return;
+    }
+
+    result.crestFactor = peak / rms;
+
+    float frequency = estimateFrequency(samples, count, mean, sampleRate);
+    result.frequency = frequency;
+    float fundamental = frequency > 0.0f ? frequency : nominalFrequency;
+
+    float v1 = goertzelAmplitude(samples, count, mean, fundamental, sampleRate);
+    float harmonicPower = 0.0f;
+    for (int h = 2; h <= PQ_MAX_HARMONIC && h * fundamental < sampleRate * 0.5f; h++) {
+        float vh = goertzelAmplitude(samples, count, mean, h * fundamental, sampleRate);
+        harmonicPower += vh * vh;
+    }
+    result.thd = v1 > 0.0f ? 100.0f * sqrtf(harmonicPower) / v1 : 0.0f;
+
+    // Short-term flicker: smoothed RMS of relative window-to-window change
+    if (previousRms > 0.0f) {
+        float change = (rms - previousRms) / previousRms;
+        float flickerSquared = result.flicker * result.flicker / 10000.0f;
+        flickerSquared = flickerSquared * 0.9f + change * change * 0.1f;
+        result.flicker = 100.0f * sqrtf(flickerSquared);
+    }
+    previousRms = rms;
+    result.valid = true;
+}
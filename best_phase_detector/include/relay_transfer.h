@@ -0,0 +1,250 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Zero-crossing-timed phase transfer. The source relay is released so its
+// contacts open at a zero crossing of the source, and the target relay is
+// energised so its contacts close at a zero crossing of the target, each
+// command brought forward by the relay's expected operate or release time.
+// The target is held back until it cannot close before the source is open,
+// whatever the relays do within their timing bounds. The load sees a dead
+// time of the guard plus the spread of those bounds plus at most half a
+// cycle, instead of a fixed delay.
+//
+// All times are micros() values and compared with wrap-safe arithmetic.
+
+// Timing of one waveform, from a short raw ADC capture
+struct ZeroCrossing {
+    uint32_t timeUs;    // A rising zero crossing
+    uint32_t periodUs;  // 0 when no stable crossings were found
+    float midpoint;     // DC level, ADC counts
+    float amplitude;    // Peak above the midpoint, ADC counts
+
+    bool valid() const { return periodUs > 0; }
+};
+
+// Times the last rising crossing of a capture that started at `startUs`
+// with one sample every `sampleIntervalUs`. Crossings are interpolated
+// between samples. The period is only trusted if every cycle in the
+// capture agrees with the average within 5%, and a waveform below
+// `minAmplitude` counts is treated as dead.
+inline ZeroCrossing findZeroCrossing(const uint16_t* samples, int count, uint32_t startUs,
+                                     float sampleIntervalUs, float minAmplitude) {
+    ZeroCrossing result = {0, 0, 0.0f, 0.0f};
+    if (count < 2) return result;
+
+    // Midpoint from the extremes: a capture that is not a whole number of
+    // cycles would bias the mean, and with it every crossing
+    uint16_t low = samples[0];
+    uint16_t high = samples[0];
+    for (int i = 1; i < count; i++) {
+        if (samples[i] < low) low = samples[i];
+        if (samples[i] > high) high = samples[i];
+    }
+    float midpoint = (low + high) * 0.5f;
+    float peak = (high - low) * 0.5f;
+    result.midpoint = midpoint;
+    result.amplitude = peak;
+    if (peak < minAmplitude) return result;
+
+    // Same hysteresis as estimateFrequency(): arm on a clear negative half
+    const float hysteresis = peak * 0.1f;
+    const int MAX_CROSSINGS = 8;
+    float crossings[MAX_CROSSINGS];
+    int found = 0;
+    bool armed = false;
+    for (int i = 1; i < count && found < MAX_CROSSINGS; i++) {
+        float previous = samples[i - 1] - midpoint;
+        float current = samples[i] - midpoint;
+        if (current < -hysteresis) armed = true;
+        if (armed && previous < 0.0f && current >= 0.0f) {
+            crossings[found++] = (i - 1) + (-previous / (current - previous));
+            armed = false;
+        }
+    }
+    if (found < 2) return result;
+
+    float periodSamples = (crossings[found - 1] - crossings[0]) / (found - 1);
+    for (int i = 1; i < found; i++) {
+        if (fabsf(crossings[i] - crossings[i - 1] - periodSamples) > periodSamples * 0.05f) {
+            return result;
+        }
+    }
+    result.timeUs = startUs + (uint32_t)(crossings[found - 1] * sampleIntervalUs + 0.5f);
+    result.periodUs = (uint32_t)(periodSamples * sampleIntervalUs + 0.5f);
+    return result;
+}
+
+// First zero crossing, rising or falling, at or after `t`. Falling
+// crossings are taken half a period after rising ones.
+inline uint32_t nextZeroCrossing(const ZeroCrossing& wave, uint32_t t) {
+    int32_t elapsed = (int32_t)(t - wave.timeUs);
+    if (elapsed <= 0) return wave.timeUs;
+    uint32_t halves = ((uint32_t)elapsed * 2 + wave.periodUs - 1) / wave.periodUs;
+    return wave.timeUs + (uint32_t)((uint64_t)halves * wave.periodUs / 2);
+}
+
+// Coil command to contact movement, per relay. The expected times aim the
+// contacts at zero crossings. The bounds keep the sources apart: planning
+// assumes the target may close as early as `minOperateUs` after its coil
+// is energised and the source may open as late as `maxReleaseUs` after its
+// coil is released.
+struct RelayTiming {
+    uint32_t operateUs;     // Expected, energised to contacts closed
+    uint32_t releaseUs;     // Expected, released to contacts open
+    uint32_t minOperateUs;  // Fastest close that is still safe
+    uint32_t maxReleaseUs;  // Slowest open that is still safe
+};
+
+// Timing from the datasheet range, expected in the middle of it
+inline RelayTiming datasheetRelayTiming(uint32_t minOperateUs, uint32_t maxOperateUs,
+                                        uint32_t minReleaseUs, uint32_t maxReleaseUs) {
+    RelayTiming timing = {(minOperateUs + maxOperateUs) / 2, (minReleaseUs + maxReleaseUs) / 2,
+                          minOperateUs, maxReleaseUs};
+    return timing;
+}
+
+// Folds a measured time into an expected one. Readings outside a quarter
+// to four times the estimate are ignored as mis-detections. Returns
+// whether the estimate changed.
+inline bool learnRelayTime(uint32_t& estimate, uint32_t observedUs) {
+    if (observedUs < estimate / 4 || observedUs > estimate * 4) return false;
+    int32_t delta = (int32_t)observedUs - (int32_t)estimate;
+    if (delta / 4 == 0) return false;
+    estimate += delta / 4;
+    return true;
+}
+
+// Folds a measured operate time into `relay`. The measurement may read up
+// to `uncertaintyUs` high (the close is only seen once the load leaves the
+// band around a zero crossing), so the true time lies in
+// [observed - uncertainty, observed]. The expected time follows the middle
+// of that range. The minimum only ever moves down to cover it and never
+// rises again, so learning can widen the safety margin but not shrink it.
+inline bool learnOperateTime(RelayTiming& relay, uint32_t observedUs, uint32_t uncertaintyUs) {
+    if (observedUs < relay.operateUs / 4 || observedUs > relay.operateUs * 4) return false;
+    uint32_t earliest = observedUs > uncertaintyUs ? observedUs - uncertaintyUs : 0;
+    bool changed = learnRelayTime(relay.operateUs, observedUs - (observedUs - earliest) / 2);
+    if (earliest < relay.minOperateUs) {
+        relay.minOperateUs = earliest;
+        changed = true;
+    }
+    return changed;
+}
+
+// Folds a measured release time into `relay`. The measurement may read up
+// to `uncertaintyUs` low (the load drops into the band around a zero
+// crossing before the contacts open), so the true time lies in
+// [observed, observed + uncertainty]. The maximum only ever moves up.
+inline bool learnReleaseTime(RelayTiming& relay, uint32_t observedUs, uint32_t uncertaintyUs) {
+    if (observedUs < relay.releaseUs / 4 || observedUs > relay.releaseUs * 4) return false;
+    uint32_t latest = observedUs + uncertaintyUs;
+    bool changed = learnRelayTime(relay.releaseUs, observedUs + uncertaintyUs / 2);
+    if (latest > relay.maxReleaseUs) {
+        relay.maxReleaseUs = latest;
+        changed = true;
+    }
+    return changed;
+}
+
+// Time a sine spends within `threshold` of its midpoint on either side of a
+// zero crossing: how far a load-side measurement may be off. 0 if the
+// waveform has no usable timing.
+inline uint32_t zeroCrossingBandUs(const ZeroCrossing& wave, float threshold) {
+    if (!wave.valid() || wave.amplitude <= 0.0f) return 0;
+    float ratio = threshold / wave.amplitude;
+    if (ratio >= 1.0f) return wave.periodUs / 4;
+    return (uint32_t)(asinf(ratio) / (2.0f * (float)M_PI) * wave.periodUs + 0.5f);
+}
+
+struct TransferPlan {
+    uint32_t releaseAt;  // De-energise the source relay
+    uint32_t operateAt;  // Energise the target relay
+    uint32_t openAt;     // Expected source contact opening
+    uint32_t closeAt;    // Expected target contact closing
+    bool sourceSynced;   // openAt sits on a source zero crossing
+    bool targetSynced;   // closeAt sits on a target zero crossing
+
+    uint32_t gapUs() const { return closeAt - openAt; }
+};
+
+// Plans a break-before-make transfer starting no earlier than `earliest`.
+// `source` is NULL when no relay is energised. A waveform without a valid
+// zero crossing (a dead source, say) is switched as soon as possible.
+//
+// The target coil is energised late enough that even its fastest close,
+// operateAt + minOperateUs, comes `guardUs` after the source's slowest
+// open, releaseAt + maxReleaseUs. Any relay within its bounds therefore
+// breaks before it makes; timing errors only lengthen the gap.
+inline TransferPlan planTransfer(const ZeroCrossing* source, const RelayTiming* sourceRelay,
+                                 const ZeroCrossing& target, const RelayTiming& targetRelay,
+                                 uint32_t earliest, uint32_t guardUs) {
+    TransferPlan plan;
+    plan.sourceSynced = false;
+    plan.targetSynced = false;
+
+    uint32_t openLatest;  // Source contacts certainly open
+    if (source == NULL) {
+        plan.releaseAt = earliest;
+        plan.openAt = earliest;
+        openLatest = earliest;
+    } else {
+        plan.openAt = earliest + sourceRelay->releaseUs;
+        if (source->valid()) {
+            plan.openAt = nextZeroCrossing(*source, plan.openAt);
+            plan.sourceSynced = true;
+        }
+        plan.releaseAt = plan.openAt - sourceRelay->releaseUs;
+        openLatest = plan.releaseAt + sourceRelay->maxReleaseUs;
+        if ((int32_t)(openLatest - plan.openAt) < 0) openLatest = plan.openAt;
+    }
+
+    // Earliest coil command that keeps the fastest close clear of the
+    // slowest open, and never before the source coil is released
+    uint32_t coilFrom = openLatest + guardUs - targetRelay.minOperateUs;
+    if ((int32_t)(coilFrom - plan.releaseAt) < 0) coilFrom = plan.releaseAt;
+    uint32_t closeFrom = coilFrom + targetRelay.operateUs;
+    if ((int32_t)(plan.openAt + guardUs - closeFrom) > 0) closeFrom = plan.openAt + guardUs;
+    plan.closeAt = closeFrom;
+    if (target.valid()) {
+        plan.closeAt = nextZeroCrossing(target, closeFrom);
+        plan.targetSynced = true;
+    }
+    plan.operateAt = plan.closeAt - targetRelay.operateUs;
+    return plan;
+}
+
+// Measures the dead time seen by the load from a load-side sensor sampled
+// while the transfer runs: the longest stretch without a sample beyond
+// `threshold` counts from the midpoint. Each zero crossing of a healthy
+// waveform also dips below the threshold, so the result includes that
+// band (about 1 ms at 50 Hz for a threshold at 15% of the peak).
+struct LoadGapMeter {
+    float midpoint;
+    float threshold;
+    uint32_t lastLiveUs;
+    uint32_t gapStartUs;  // Last live sample before the longest gap
+    uint32_t gapEndUs;    // First live sample after it
+    uint32_t gapUs;
+
+    // A load that is already dead has its gap timed from `startUs`
+    void begin(float loadMidpoint, float liveThreshold, uint32_t startUs) {
+        midpoint = loadMidpoint;
+        threshold = liveThreshold;
+        lastLiveUs = startUs;
+        gapStartUs = gapEndUs = startUs;
+        gapUs = 0;
+    }
+
+    void sample(uint32_t timeUs, uint16_t value) {
+        if (fabsf(value - midpoint) < threshold) return;
+        if (timeUs - lastLiveUs > gapUs) {
+            gapUs = timeUs - lastLiveUs;
+            gapStartUs = lastLiveUs;
+            gapEndUs = timeUs;
+        }
+        lastLiveUs = timeUs;
+    }
+};
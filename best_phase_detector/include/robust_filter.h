@@ -0,0 +1,110 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Streaming Hampel identifier over the last WINDOW readings. A reading
+// further than `threshold` scaled MADs from the window median is flagged as
+// an outlier. Every reading still enters the window: a single bad window is
+// rejected, but a real step change is accepted once it holds the majority
+// (WINDOW / 2 + 1 readings).
+//
+// The window is kept sorted alongside its arrival order. Binary search
+// finds the slot, and the median is an index lookup. The MAD walks outward
+// from the median over half the window, so no per-reading sort is needed.
+
+template <int WINDOW>
+class HampelFilter {
+public:
+    // `minSpread` (same unit as the readings) floors the scaled MAD, so a
+    // perfectly flat window does not reject ordinary noise
+    HampelFilter(float threshold = 3.0f, float minSpread = 2.0f)
+        : threshold_(threshold), minSpread_(minSpread), count_(0), head_(0), rejected_(0) {}
+
+    // Adds `value` to the window. Returns false if it is an outlier
+    // against the readings before it.
+    bool update(float value) {
+        bool plausible = true;
+        if (count_ >= MIN_HISTORY) {
+            float m = median();
+            float spread = MAD_SCALE * mad(m);
+            if (spread < minSpread_) spread = minSpread_;
+            plausible = fabsf(value - m) <= threshold_ * spread;
+        }
+        if (!plausible) rejected_++;
+
+        if (count_ == WINDOW) {
+            remove(arrivals_[head_]);
+        }
+        arrivals_[head_] = value;
+        head_ = (head_ + 1) % WINDOW;
+        insert(value);
+        return plausible;
+    }
+
+    float median() const {
+        if (count_ == 0) return 0.0f;
+        int mid = count_ / 2;
+        return (count_ & 1) ? sorted_[mid] : (sorted_[mid - 1] + sorted_[mid]) * 0.5f;
+    }
+
+    uint32_t rejected() const { return rejected_; }
+
+private:
+    static const int MIN_HISTORY = 3;           // Accept everything until then
+    static constexpr float MAD_SCALE = 1.4826f; // MAD to standard deviation for normal noise
+
+    // Index of the first element greater than `value`
+    int upperBound(float value) const {
+        int low = 0, high = count_;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (sorted_[mid] <= value) low = mid + 1;
+            else high = mid;
+        }
+        return low;
+    }
+
+    void insert(float value) {
+        int at = upperBound(value);
+        for (int i = count_; i > at; i--) sorted_[i] = sorted_[i - 1];
+        sorted_[at] = value;
+        count_++;
+    }
+
+    void remove(float value) {
+        int at = upperBound(value) - 1;  // Last element equal to `value`
+        for (int i = at; i < count_ - 1; i++) sorted_[i] = sorted_[i + 1];
+        count_--;
+    }
+
+    // Median absolute deviation from `m`: deviations come out in ascending
+    // order when walking outward from the median on both sides
+    float mad(float m) const {
+        int needed = count_ / 2 + 1;
+        float deviations[WINDOW / 2 + 1];
+        int left = upperBound(m) - 1;
+        int right = left + 1;
+        for (int i = 0; i < needed; i++) {
+            float leftDeviation = left >= 0 ? m - sorted_[left] : INFINITY;
+            float rightDeviation = right < count_ ? sorted_[right] - m : INFINITY;
+            if (leftDeviation <= rightDeviation) {
+                deviations[i] = leftDeviation;
+                left--;
+            } else {
+                deviations[i] = rightDeviation;
+                right++;
+            }
+        }
+        int mid = count_ / 2;
+        return (count_ & 1) ? deviations[mid] : (deviations[mid - 1] + deviations[mid]) * 0.5f;
+    }
+
+    float threshold_;
+    float minSpread_;
+    float sorted_[WINDOW];
+    float arrivals_[WINDOW];  // Ring in arrival order, oldest at head_ once full
+    int count_;
+    int head_;
+    uint32_t rejected_;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "perf_counters.h"
+
+// Cooperative scheduler for the firmware's control task. Jobs are callbacks with a due time kept
+// in a hashed timer wheel: each pass only walks the slots of the ticks that
+// elapsed since the last one instead of checking every job. A periodic job
+// is rescheduled from its previous due time rather than from when it ran,
+// so start jitter does not accumulate into drift. Jobs run to completion;
+// a long job splits itself into steps by scheduling a one-shot follow-up.
+//
+// Time is passed in by the caller (millis(), and a microsecond clock for
+// runtime accounting), so the scheduler also runs on the host. A job may
+// schedule or cancel any job, itself included, from its callback; it must
+// not call run().
+
+typedef void (*JobFunction)(void* context);
+
+struct Job {
+    const char* name;
+    JobFunction function;
+    void* context;
+    uint32_t period;     // ms, 0 for a one-shot job
+    uint32_t deadline;   // ms a start may be late before it counts as missed
+
+    // Owned by the scheduler
+    uint32_t due;
+    bool scheduled;
+    int16_t slot;        // Wheel slot holding the job
+    Job* next;           // Next job in the same slot
+
+    // Accounting
+    PerfStat runtime;    // Execution time, us
+    PerfStat lateness;   // Start time past due, us (ms resolution)
+    uint32_t missedDeadlines;
+    uint32_t skippedRuns;  // Periods dropped after falling a full period behind
+
+    Job(const char* jobName, JobFunction jobFunction, void* jobContext = NULL,
+        uint32_t jobPeriod = 0, uint32_t jobDeadline = 0)
+        : name(jobName), function(jobFunction), context(jobContext), period(jobPeriod),
+          deadline(jobDeadline), due(0), scheduled(false), slot(0), next(NULL),
+          missedDeadlines(0), skippedRuns(0) {}
+};
+
+template <int SLOTS, uint32_t TICK_MS>
+class Scheduler {
+public:
+    explicit Scheduler(uint32_t (*clockUs)()) : clockUs_(clockUs), walking_(NULL), tick_(0), started_(false) {
+        for (int i = 0; i < SLOTS; i++) wheel_[i] = NULL;
+    }
+
+    // Schedules `job` to run at `due` (ms), replacing any pending run
+    void schedule(Job& job, uint32_t due) {
+        cancel(job);
+        job.due = due;
+        job.scheduled = true;
+        insert(job);
+    }
+
+    void scheduleIn(Job& job, uint32_t delay, uint32_t now) {
+        schedule(job, now + delay);
+    }
+
+    void cancel(Job& job) {
+        if (!job.scheduled) return;
+        // Still waiting in its slot, or in the slot run() is walking
+        if (!unlink(&wheel_[job.slot], job)) unlink(&walking_, job);
+        job.next = NULL;
+        job.scheduled = false;
+    }
+
+    // Runs every job due by `now`. Returns how many ran.
+    int run(uint32_t now) {
+        uint32_t nowTick = now / TICK_MS;
+        if (!started_) {
+            // Walk every slot once: jobs may have been scheduled for any time
+            tick_ = nowTick - SLOTS + 1;
+            started_ = true;
+        }
+
+        uint32_t ticks = nowTick - tick_ + 1;
+        if (ticks > (uint32_t)SLOTS) ticks = SLOTS;  // Every slot once is enough
+
+        int ran = 0;
+        for (uint32_t i = 0; i < ticks; i++) {
+            ran += runSlot((tick_ + i) % SLOTS, now);
+        }
+        // The current tick is walked again next time: jobs later in this
+        // tick than `now` are still waiting in it
+        tick_ = nowTick;
+        return ran;
+    }
+
+    // Milliseconds until the earliest scheduled job is due (0 if overdue),
+    // capped at `limit`
+    uint32_t timeUntilNext(uint32_t now, uint32_t limit) const {
+        uint32_t wait = limit;
+        for (int i = 0; i < SLOTS; i++) {
+            for (const Job* job = wheel_[i]; job != NULL; job = job->next) {
+                int32_t remaining = (int32_t)(job->due - now);
+                if (remaining <= 0) return 0;
+                if ((uint32_t)remaining < wait) wait = remaining;
+            }
+        }
+        return wait;
+    }
+
+private:
+    // Jobs due in a tick the wheel has already passed go into the current
+    // slot, which the next run() walks again
+    void insert(Job& job) {
+        uint32_t dueTick = job.due / TICK_MS;
+        if (started_ && (int32_t)(dueTick - tick_) < 0) dueTick = tick_;
+        job.slot = dueTick % SLOTS;
+        job.next = wheel_[job.slot];
+        wheel_[job.slot] = &job;
+    }
+
+    static bool unlink(Job** link, Job& job) {
+        while (*link != NULL && *link != &job) link = &(*link)->next;
+        if (*link == NULL) return false;
+        *link = job.next;
+        return true;
+    }
+
+    int runSlot(int slot, uint32_t now) {
+        // Detach the slot first: jobs are re-inserted (possibly into this
+        // same slot) while it is being walked. The rest of the chain stays
+        // in walking_, so a callback that cancels or reschedules a job
+        // still waiting in it unlinks that job instead of breaking the
+        // chain.
+        walking_ = wheel_[slot];
+        wheel_[slot] = NULL;
+
+        int ran = 0;
+        while (walking_ != NULL) {
+            Job* job = walking_;
+            walking_ = job->next;
+            job->next = NULL;
+            if ((int32_t)(job->due - now) > 0) {
+                insert(*job);  // A later round of the wheel
+            } else {
+                execute(*job, now);
+                ran++;
+            }
+        }
+        return ran;
+    }
+
+    void execute(Job& job, uint32_t now) {
+        uint32_t late = now - job.due;
+        job.lateness.record(late * 1000);
+        if (late > job.deadline) job.missedDeadlines++;
+
+        if (job.period > 0) {
+            job.due += job.period;
+            // Far behind (e.g. after a blocking call): skip the missed
+            // periods instead of running the job back to back
+            if ((int32_t)(job.due - now) <= 0) {
+                uint32_t behind = (now - job.due) / job.period + 1;
+                job.skippedRuns += behind;
+                job.due += behind * job.period;
+            }
+            insert(job);
+        } else {
+            job.scheduled = false;
+        }
+
+        uint32_t start = clockUs_();
+        job.function(job.context);
+        job.runtime.record(clockUs_() - start);
+    }
+
+    uint32_t (*clockUs_)();
+    Job* wheel_[SLOTS];
+    Job* walking_;    // Rest of the slot runSlot() is walking
+    uint32_t tick_;   // Last tick walked
+    bool started_;
+};
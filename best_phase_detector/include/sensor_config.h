@@ -0,0 +1,17 @@
+#pragma once
+
+// Voltage sensing front end: the ESP32 ADC reading ZMPT101B modules. Shared
+// by the application and the bench firmware so both process the same window.
+
+const float VREF = 3.3;
+const int ADC_MAX = 4095;
+const int SAMPLES = 300;  // Reduced for better performance (was 500)
+
+// Calibration factor - ADJUST THIS based on your ZMPT101B modules
+// Start with 250 and adjust after testing with a multimeter
+const float CALIBRATION_FACTOR = 250.0;
+
+// Outlier rejection per phase between RMS and the statistics (Hampel
+// identifier, robust_filter.h). A real step is accepted once it holds the
+// majority of the window, i.e. after three readings of that phase.
+const int OUTLIER_WINDOW = 5;
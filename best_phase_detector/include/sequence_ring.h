@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed-size ring of records addressed by sequence number. T needs a
+// `uint32_t seq` member.
+//
+// There is a single writer (the main loop); the slot is filled first and the
+// head is published afterwards, so a reader never sees a half-written
+// record. Old records are overwritten once the ring wraps; readers detect
+// this by the sequence number stored in the slot.
+template <typename T, int CAPACITY>
+class SequenceRing {
+public:
+    typedef T Entry;
+
+    SequenceRing() : head_(1) {
+        for (int i = 0; i < CAPACITY; i++) ring_[i].seq = 0;
+    }
+
+    // Sequence numbers start at 1 so that `since=0` means "everything".
+    uint32_t append(T& entry) {
+        uint32_t seq = head_;
+        entry.seq = seq;
+        ring_[seq % CAPACITY] = entry;
+        __atomic_store_n(&head_, seq + 1, __ATOMIC_RELEASE);
+        return seq;
+    }
+
+    // Re-insert a record loaded from flash. Must be called in ascending
+    // sequence order before any new records are appended.
+    void restore(const T& entry) {
+        if (entry.seq == 0 || entry.seq < head_) return;
+        ring_[entry.seq % CAPACITY] = entry;
+        head_ = entry.seq + 1;
+    }
+
+    uint32_t nextSeq() const { return __atomic_load_n(&head_, __ATOMIC_ACQUIRE); }
+
+    uint32_t oldestSeq() const {
+        uint32_t next = nextSeq();
+        return next > CAPACITY ? next - CAPACITY : 1;
+    }
+
+    // Copy out the record with sequence number `seq`. Fails if it has not
+    // been written yet or has already been overwritten.
+    bool read(uint32_t seq, T& out) const {
+        if (seq == 0 || seq >= nextSeq() || seq < oldestSeq()) return false;
+        out = ring_[seq % CAPACITY];
+        return out.seq == seq;
+    }
+
+    static int capacity() { return CAPACITY; }
+
+private:
+    T ring_[CAPACITY];
+    uint32_t head_;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stdint.h>
+#include "phase_angle.h"
+#include "phase_config.h"
+#include "power_quality.h"
+#include "status_fields.h"
+
+// The /api/status document. main.cpp publishes live values into a
+// PublishedStatus (see publishStatus()) and serves it with
+// buildStatusDocument(); the bench firmware builds the same document from
+// synthetic values.
+
+// Every response is built in one shared document and serialised into one
+// shared buffer
+const size_t JSON_DOCUMENT_CAPACITY = 6144;
+const size_t JSON_BUFFER_SIZE = 4096;
+
+enum SystemMode { MODE_AUTOMATIC, MODE_MANUAL };
+
+inline const char* systemModeName(int mode) {
+    return mode == MODE_AUTOMATIC ? "automatic" : "manual";
+}
+
+// Published copy of one phase. Power quality and angles stay invalid in
+// builds without ENABLE_POWER_QUALITY / ENABLE_PHASE_ANGLES.
+struct PhaseStatus {
+    float voltage;
+    float avgVoltage;
+    float minVoltage;
+    float maxVoltage;
+    float forecastVoltage;
+    float trend;  // V/min
+    PowerQuality pq;
+    float angle;  // Degrees relative to the first phase
+    bool isActive;
+};
+
+struct PublishedStatus {
+    int mode;           // SystemMode, -1 until first published
+    int selectedPhase;
+    int bestPhase;      // -1 is a valid "no phase qualifies"
+    bool supplyValid;   // Sequence, unbalance and angles are known
+    PhaseSequence sequence;
+    float unbalance;    // %
+    PhaseStatus phases[NUM_PHASES];
+
+    PublishedStatus()
+        : mode(-1), selectedPhase(-1), bestPhase(-2), supplyValid(false),
+          sequence(SEQUENCE_UNKNOWN), unbalance(0.0f), phases() {}
+};
+
+// Fills `doc` with the fields selected by the `fields` mask
+// (status_fields.h).
+inline void buildStatusDocument(JsonDocument& doc, const PublishedStatus& status, const char* deviceId,
+                                uint32_t fields) {
+    if (fields & statusFieldBit(STATUS_DEVICE_ID)) doc["deviceId"] = deviceId;
+    if (fields & statusFieldBit(STATUS_MODE)) doc["mode"] = systemModeName(status.mode);
+    if (fields & statusFieldBit(STATUS_BEST_PHASE)) doc["bestPhase"] = status.bestPhase;
+    if (fields & statusFieldBit(STATUS_SELECTED_PHASE)) doc["selectedPhase"] = status.selectedPhase;
+    if ((fields & statusFieldBit(STATUS_SUPPLY)) && status.supplyValid) {
+        JsonObject supplyObj = doc.createNestedObject("supply");
+        supplyObj["sequence"] = phaseSequenceName(status.sequence);
+        supplyObj["unbalance"] = status.unbalance;
+    }
+
+    if (!(fields & STATUS_PHASE_FIELDS)) return;
+    JsonArray phasesArray = doc.createNestedArray("phases");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        const PhaseStatus& published = status.phases[i];
+        JsonObject phaseObj = phasesArray.createNestedObject();
+        if (fields & statusFieldBit(STATUS_NAME)) phaseObj["name"] = PHASE_TABLE[i].name;
+        if (fields & statusFieldBit(STATUS_VOLTAGE)) phaseObj["voltage"] = published.voltage;
+        if (fields & statusFieldBit(STATUS_AVG_VOLTAGE)) phaseObj["avgVoltage"] = published.avgVoltage;
+        if (fields & statusFieldBit(STATUS_MIN_VOLTAGE)) phaseObj["minVoltage"] = published.minVoltage;
+        if (fields & statusFieldBit(STATUS_MAX_VOLTAGE)) phaseObj["maxVoltage"] = published.maxVoltage;
+        if (fields & statusFieldBit(STATUS_FORECAST_VOLTAGE)) {
+            phaseObj["forecastVoltage"] = published.forecastVoltage;
+        }
+        if (fields & statusFieldBit(STATUS_TREND)) phaseObj["trend"] = published.trend;
+        if ((fields & statusFieldBit(STATUS_POWER_QUALITY)) && published.pq.valid) {
+            phaseObj["frequency"] = published.pq.frequency;
+            phaseObj["thd"] = published.pq.thd;
+            phaseObj["crestFactor"] = published.pq.crestFactor;
+            phaseObj["flicker"] = published.pq.flicker;
+        }
+        if ((fields & statusFieldBit(STATUS_ANGLE)) && status.supplyValid) {
+            phaseObj["angle"] = published.angle;
+        }
+        if (fields & statusFieldBit(STATUS_IS_ACTIVE)) phaseObj["isActive"] = published.isActive;
+    }
+}
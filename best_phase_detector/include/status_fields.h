@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Fields of the /api/status document. Each field keeps a change counter, so
+// a response's ETag can be built from just the fields it contains: a client
+// that only asks for `selectedPhase` is not invalidated by voltage noise.
+
+enum StatusField : uint8_t {
+    STATUS_DEVICE_ID,
+    STATUS_MODE,
+    STATUS_BEST_PHASE,
+    STATUS_SELECTED_PHASE,
+    STATUS_SUPPLY,         // sequence, unbalance
+    // Per-phase fields, inside the "phases" array
+    STATUS_NAME,
+    STATUS_VOLTAGE,
+    STATUS_AVG_VOLTAGE,
+    STATUS_MIN_VOLTAGE,
+    STATUS_MAX_VOLTAGE,
+    STATUS_FORECAST_VOLTAGE,
+    STATUS_TREND,
+    STATUS_POWER_QUALITY,  // frequency, thd, crestFactor, flicker
+    STATUS_ANGLE,
+    STATUS_IS_ACTIVE,
+    STATUS_FIELD_COUNT
+};
+
+const char* const STATUS_FIELD_NAMES[STATUS_FIELD_COUNT] = {
+    "deviceId", "mode", "bestPhase", "selectedPhase", "supply",
+    "name", "voltage", "avgVoltage", "minVoltage", "maxVoltage",
+    "forecastVoltage", "trend", "powerQuality", "angle", "isActive"
+};
+
+const uint32_t STATUS_ALL_FIELDS = (1u << STATUS_FIELD_COUNT) - 1;
+const uint32_t STATUS_PHASE_FIELDS = STATUS_ALL_FIELDS & ~((1u << STATUS_NAME) - 1);
+
+inline uint32_t statusFieldBit(StatusField field) {
+    return 1u << field;
+}
+
+// Mask for a comma-separated field list such as "voltage,selectedPhase".
+// Returns 0 if the list is empty or names an unknown field.
+inline uint32_t parseStatusFields(const char* list) {
+    uint32_t mask = 0;
+    while (*list) {
+        const char* end = strchr(list, ',');
+        size_t length = end ? (size_t)(end - list) : strlen(list);
+
+        int field = 0;
+        while (field < STATUS_FIELD_COUNT &&
+               (strlen(STATUS_FIELD_NAMES[field]) != length ||
+                strncmp(STATUS_FIELD_NAMES[field], list, length) != 0)) {
+            field++;
+        }
+        if (field == STATUS_FIELD_COUNT) return 0;
+        mask |= 1u << field;
+
+        if (!end) break;
+        list = end + 1;
+    }
+    return mask;
+}
+
+struct StatusVersions {
+    uint32_t counters[STATUS_FIELD_COUNT];
+
+    StatusVersions() { memset(counters, 0, sizeof(counters)); }
+
+    void bump(StatusField field) { counters[field]++; }
+
+    // Counters only grow, so the sum over a mask changes whenever any of
+    // the selected fields does.
+    uint32_t version(uint32_t mask) const {
+        uint32_t sum = 0;
+        for (int i = 0; i < STATUS_FIELD_COUNT; i++) {
+            if (mask & (1u << i)) sum += counters[i];
+        }
+        return sum;
+    }
+};
+
+// Moves `published` to `value` once they differ by at least `deadband`.
+// Returns true if it moved.
+inline bool publishValue(float& published, float value, float deadband) {
+    float delta = value - published;
+    if (delta < deadband && delta > -deadband) return false;
+    published = value;
+    return true;
+}
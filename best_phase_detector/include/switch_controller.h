@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+
+// Switching policy for automatic mode.
+//
+// A candidate phase has to win every evaluation for `dwellTime` before the
+// relay moves. After a switch the controller locks out further automatic
+// switches; the lockout doubles each time switches follow each other within
+// `flapWindow` (up to `maxLockout`) and relaxes back towards `baseLockout`
+// once the system settles: it halves on a switch outside the flap window,
+// and once per `flapWindow` of quiet after the lockout has run out. Leaving a failed phase skips the dwell, uses the
+// short `outageLockout` and ignores the hourly limit so recovery is not held
+// back by relay-wear protection.
+struct SwitchPolicy {
+    unsigned long dwellTime;
+    unsigned long baseLockout;
+    unsigned long maxLockout;
+    unsigned long outageLockout;
+    unsigned long flapWindow;
+    uint8_t maxSwitchesPerHour;  // At most SwitchController::SWITCH_LOG_SIZE
+};
+
+constexpr SwitchPolicy DEFAULT_SWITCH_POLICY = {
+    15000,   // dwellTime: 15 s of continuous wins
+    30000,   // baseLockout: 30 s after a normal switch
+    600000,  // maxLockout: 10 min after repeated flapping
+    5000,    // outageLockout: 5 s when escaping a failed phase
+    120000,  // flapWindow: switches closer than 2 min count as flapping
+    6        // maxSwitchesPerHour
+};
+
+enum SwitchBlockReason {
+    SWITCH_ALLOWED,
+    SWITCH_BLOCKED_DWELL,
+    SWITCH_BLOCKED_LOCKOUT,
+    SWITCH_BLOCKED_RATE
+};
+
+class SwitchController {
+public:
+    static const int SWITCH_LOG_SIZE = 16;
+    static const unsigned long ONE_HOUR = 3600000UL;
+
+    explicit SwitchController(const SwitchPolicy& policy = DEFAULT_SWITCH_POLICY)
+        : policy_(clamped(policy)) {
+        reset();
+    }
+
+    void reset() {
+        candidate_ = -1;
+        candidateSince_ = 0;
+        lockout_ = policy_.baseLockout;
+        lastSwitch_ = 0;
+        hasSwitched_ = false;
+        logHead_ = 0;
+        logCount_ = 0;
+        blockReason_ = SWITCH_ALLOWED;
+    }
+
+    void setPolicy(const SwitchPolicy& policy) {
+        policy_ = clamped(policy);
+        reset();
+    }
+
+    const SwitchPolicy& policy() const { return policy_; }
+
+    // Feed one evaluation of the scorer. `current` is the energised phase
+    // (-1 if none); `currentFailed` is true when it is out of the safe band.
+    // Returns true when the controller wants the relay moved to `candidate`.
+    bool evaluate(unsigned long now, int candidate, int current, bool currentFailed) {
+        if (candidate < 0 || candidate == current) {
+            candidate_ = -1;
+            blockReason_ = SWITCH_ALLOWED;
+            return false;
+        }
+
+        if (candidate != candidate_) {
+            candidate_ = candidate;
+            candidateSince_ = now;
+        }
+
+        bool emergency = currentFailed || current < 0;
+        if (!emergency && now - candidateSince_ < policy_.dwellTime) {
+            blockReason_ = SWITCH_BLOCKED_DWELL;
+            return false;
+        }
+        if (lockoutRemaining(now, emergency) > 0) {
+            blockReason_ = SWITCH_BLOCKED_LOCKOUT;
+            return false;
+        }
+        if (!emergency && switchesInLastHour(now) >= policy_.maxSwitchesPerHour) {
+            blockReason_ = SWITCH_BLOCKED_RATE;
+            return false;
+        }
+
+        blockReason_ = SWITCH_ALLOWED;
+        return true;
+    }
+
+    // Record a relay transfer. `leftFailedPhase` resets the flap back-off,
+    // since escaping a dead phase is not chatter.
+    void recordSwitch(unsigned long now, bool leftFailedPhase) {
+        lockout_ = currentLockout(now);
+        if (leftFailedPhase) {
+            lockout_ = policy_.baseLockout;
+        } else if (hasSwitched_ && now - lastSwitch_ < policy_.flapWindow) {
+            lockout_ = lockout_ * 2 > policy_.maxLockout ? policy_.maxLockout : lockout_ * 2;
+        } else if (lockout_ > policy_.baseLockout) {
+            lockout_ = lockout_ / 2 < policy_.baseLockout ? policy_.baseLockout : lockout_ / 2;
+        }
+
+        lastSwitch_ = now;
+        hasSwitched_ = true;
+        candidate_ = -1;
+
+        switchLog_[logHead_] = now;
+        logHead_ = (logHead_ + 1) % SWITCH_LOG_SIZE;
+        if (logCount_ < SWITCH_LOG_SIZE) logCount_++;
+    }
+
+    unsigned long lockoutRemaining(unsigned long now, bool currentFailed) const {
+        if (!hasSwitched_) return 0;
+        unsigned long lockout = currentFailed ? policy_.outageLockout : lockout_;
+        unsigned long elapsed = now - lastSwitch_;
+        return elapsed >= lockout ? 0 : lockout - elapsed;
+    }
+
+    int switchesInLastHour(unsigned long now) const {
+        int count = 0;
+        for (int i = 0; i < logCount_; i++) {
+            if (now - switchLog_[i] < ONE_HOUR) count++;
+        }
+        return count;
+    }
+
+    // The lockout the next normal switch would start from, with the decay
+    // for the quiet time since the last lockout ran out. A long quiet spell
+    // ends back at baseLockout, so a flapping episode hours ago does not
+    // hold back the next recovery.
+    unsigned long currentLockout(unsigned long now) const {
+        if (!hasSwitched_) return lockout_;
+        unsigned long elapsed = now - lastSwitch_;
+        if (elapsed <= lockout_ || policy_.flapWindow == 0) return lockout_;
+        unsigned long quietWindows = (elapsed - lockout_) / policy_.flapWindow;
+        unsigned long lockout = lockout_;
+        for (unsigned long i = 0; i < quietWindows && lockout > policy_.baseLockout; i++) {
+            lockout /= 2;
+        }
+        return lockout < policy_.baseLockout ? policy_.baseLockout : lockout;
+    }
+    int candidate() const { return candidate_; }
+    unsigned long candidateAge(unsigned long now) const {
+        return candidate_ < 0 ? 0 : now - candidateSince_;
+    }
+    SwitchBlockReason blockReason() const { return blockReason_; }
+
+private:
+    // The switch log only remembers SWITCH_LOG_SIZE switches, so a higher
+    // hourly limit could never be reached and would switch the limit off
+    static SwitchPolicy clamped(SwitchPolicy policy) {
+        if (policy.maxSwitchesPerHour > SWITCH_LOG_SIZE) policy.maxSwitchesPerHour = SWITCH_LOG_SIZE;
+        return policy;
+    }
+
+    SwitchPolicy policy_;
+    int candidate_;
+    unsigned long candidateSince_;
+    unsigned long lockout_;
+    unsigned long lastSwitch_;
+    bool hasSwitched_;
+    unsigned long switchLog_[SWITCH_LOG_SIZE];
+    int logHead_;
+    int logCount_;
+    SwitchBlockReason blockReason_;
+};
+
+static_assert(DEFAULT_SWITCH_POLICY.maxSwitchesPerHour <= SwitchController::SWITCH_LOG_SIZE,
+              "the switch log cannot count up to the hourly limit");
@@ -0,0 +1,198 @@
+// On-target benchmark firmware (pio run -e bench -t upload -t monitor).
+// Times the hot kernels of main.cpp in CPU cycles with ESP.getCycleCount()
+// and prints one table row per kernel over serial:
+//
+//   rms_float    rmsFromSamples() over one SAMPLES window
+//   rms_q16      RmsAccumulator add() per sample plus rms()
+//   hampel       HampelFilter update() for one reading
+//   score_float  scorePhase() for every phase
+//   score_q16    scorePhaseQ16() for every phase
+//   json_status  Full /api/status document (buildStatusDocument) serialised
+//   lcd_flush    The main LCD screen (drawMainScreen)
+//
+// Each iteration is timed on its own. min is the kernel's own cost; max
+// includes interrupts and task switches that landed inside it. The table
+// is printed at boot and then every BENCH_REPEAT_INTERVAL.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Wire.h>
+#include <LiquidCrystal_I2C.h>
+#include <math.h>
+#include "phase_config.h"
+#include "phase_math.h"
+#include "robust_filter.h"
+#include "sensor_config.h"
+#include "status_document.h"
+#include "lcd_screens.h"
+
+const unsigned long BENCH_REPEAT_INTERVAL = 30000;
+
+LiquidCrystal_I2C lcd(0x27, 16, 2);
+StaticJsonDocument<JSON_DOCUMENT_CAPACITY> jsonDoc;
+char jsonBuffer[JSON_BUFFER_SIZE];
+
+// Synthetic ADC window: 230 V RMS, 50 Hz, sampled every ~210 us
+int samples[SAMPLES];
+float voltsPerCount;
+HampelFilter<OUTLIER_WINDOW> filter;
+ScoringParamsQ16 scoringQ16;
+
+// Status with power quality and phase angles, so every field is sent
+PublishedStatus status;
+
+// Results land here so the compiler cannot drop the kernels
+volatile float sinkFloat;
+volatile int32_t sinkInt;
+
+struct Kernel {
+    const char* name;
+    int iterations;
+    void (*run)(int iteration);
+};
+
+void benchRmsFloat(int iteration) {
+    (void)iteration;
+    sinkFloat = rmsFromSamples(samples, SAMPLES, voltsPerCount);
+}
+
+void benchRmsQ16(int iteration) {
+    (void)iteration;
+    RmsAccumulator accumulator;
+    for (int i = 0; i < SAMPLES; i++) {
+        accumulator.add(samples[i]);
+    }
+    sinkInt = accumulator.rms(toQ24(voltsPerCount));
+}
+
+void benchHampel(int iteration) {
+    // Ordinary noise with an occasional outlier, so both paths run
+    float value = 230.0f + (iteration % 7) * 0.3f;
+    if (iteration % 50 == 49) value = 12.0f;
+    sinkInt = filter.update(value);
+}
+
+void benchScoreFloat(int iteration) {
+    float total = 0.0f;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        float average = 225.0f + i * 3.0f + (iteration & 3);
+        total += scorePhase(average, average - 2.0f, 4.0f + i, 90.0f, DEFAULT_SCORING_PARAMS);
+    }
+    sinkFloat = total;
+}
+
+void benchScoreQ16(int iteration) {
+    q16_t total = 0;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        q16_t average = toQ16(225.0f + i * 3.0f + (iteration & 3));
+        total += scorePhaseQ16(average, average - toQ16(2.0f), toQ16(4.0f + i), toQ16(90.0f), scoringQ16);
+    }
+    sinkInt = total;
+}
+
+void benchJsonStatus(int iteration) {
+    status.bestPhase = iteration % NUM_PHASES;
+    jsonDoc.clear();
+    buildStatusDocument(jsonDoc, status, "bpd-a1b2c3", STATUS_ALL_FIELDS);
+    sinkInt = serializeJson(jsonDoc, jsonBuffer, sizeof(jsonBuffer));
+}
+
+// updateLCD() in MENU_MAIN: clear plus one I2C write per character
+void benchLcdFlush(int iteration) {
+    for (int i = 0; i < NUM_PHASES; i++) {
+        status.phases[i].voltage = 228.4f + i + (iteration & 1);
+    }
+    drawMainScreen(lcd, status.phases, true);
+}
+
+const Kernel KERNELS[] = {
+    {"rms_float", 1000, benchRmsFloat},
+    {"rms_q16", 1000, benchRmsQ16},
+    {"hampel", 10000, benchHampel},
+    {"score_float", 10000, benchScoreFloat},
+    {"score_q16", 10000, benchScoreQ16},
+    {"json_status", 1000, benchJsonStatus},
+    {"lcd_flush", 50, benchLcdFlush},
+};
+const int NUM_KERNELS = sizeof(KERNELS) / sizeof(KERNELS[0]);
+
+void runKernel(const Kernel& kernel) {
+    kernel.run(0);  // Warm the caches
+
+    uint32_t minCycles = UINT32_MAX;
+    uint32_t maxCycles = 0;
+    uint64_t totalCycles = 0;
+    for (int i = 0; i < kernel.iterations; i++) {
+        uint32_t start = ESP.getCycleCount();
+        kernel.run(i);
+        uint32_t cycles = ESP.getCycleCount() - start;
+        if (cycles < minCycles) minCycles = cycles;
+        if (cycles > maxCycles) maxCycles = cycles;
+        totalCycles += cycles;
+    }
+
+    uint32_t meanCycles = (uint32_t)(totalCycles / kernel.iterations);
+    Serial.printf("%-12s %6d %10u %10u %10u %9.1f\n", kernel.name, kernel.iterations,
+                  (unsigned)minCycles, (unsigned)meanCycles, (unsigned)maxCycles,
+                  (float)meanCycles / ESP.getCpuFreqMHz());
+}
+
+void runBenchmarks() {
+    Serial.printf("\n%d phases, %d samples per window, CPU %u MHz\n", NUM_PHASES, SAMPLES,
+                  (unsigned)ESP.getCpuFreqMHz());
+    Serial.printf("%-12s %6s %10s %10s %10s %9s\n", "kernel", "iters", "min cyc", "mean cyc", "max cyc", "mean us");
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        runKernel(KERNELS[i]);
+        delay(1);  // Let the idle task feed the watchdog
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    Wire.begin();
+    lcd.init();
+    lcd.backlight();
+
+    voltsPerCount = VREF / ADC_MAX * CALIBRATION_FACTOR;
+    float amplitude = 230.0f * sqrtf(2.0f) / voltsPerCount;
+    for (int i = 0; i < SAMPLES; i++) {
+        samples[i] = (int)lrintf(2048.0f + amplitude * sinf(2.0f * (float)M_PI * 50.0f * 210e-6f * i));
+    }
+    scoringQ16 = toQ16(DEFAULT_SCORING_PARAMS);
+
+    status.mode = MODE_AUTOMATIC;
+    status.selectedPhase = 0;
+    status.bestPhase = 0;
+    status.supplyValid = true;
+    status.sequence = SEQUENCE_POSITIVE;
+    status.unbalance = 0.8f;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        PhaseStatus& phase = status.phases[i];
+        phase.voltage = 228.4f + i;
+        phase.avgVoltage = 227.9f + i;
+        phase.minVoltage = 221.2f + i;
+        phase.maxVoltage = 233.7f + i;
+        phase.forecastVoltage = 226.5f + i;
+        phase.trend = -0.7f;
+        phase.pq.frequency = 50.02f;
+        phase.pq.thd = 3.1f;
+        phase.pq.crestFactor = 1.41f;
+        phase.pq.flicker = 0.2f;
+        phase.pq.valid = true;
+        phase.angle = i * -120.0f;
+        phase.isActive = i == 0;
+    }
+
+    Serial.println("Best Phase Detector kernel benchmark");
+    runBenchmarks();
+}
+
+void loop() {
+    static unsigned long lastRun = 0;
+    if (millis() - lastRun >= BENCH_REPEAT_INTERVAL) {
+        lastRun = millis();
+        runBenchmarks();
+    }
+}
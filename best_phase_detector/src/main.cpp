@@ -1,19 +1,94 @@
 #include <WiFi.h>
 #include <WebServer.h>
+#include <ESPmDNS.h>
 #include <ArduinoJson.h>
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <math.h>
+#include <stdarg.h>
+#include "phase_config.h"
+#include "switch_controller.h"
+#include "phase_forecast.h"
+#include "power_quality.h"
+#include "event_journal.h"
+#include "perf_counters.h"
+#include "phase_math.h"
+#include "command_queue.h"
+#include "status_fields.h"
+#include "admission_control.h"
+#include "scheduler.h"
+#include "adaptive_sampling.h"
+#include "robust_filter.h"
+#include "relay_transfer.h"
+#include "phase_angle.h"
+#include "sensor_config.h"
+#include "phase_selection.h"
+#include "status_document.h"
+#include "api_documents.h"
+#include "lcd_screens.h"
+
+// Power-quality analysis (frequency, THD, crest factor, flicker) on a
+// background task. Set to 0 to build without it.
+#ifndef ENABLE_POWER_QUALITY
+#define ENABLE_POWER_QUALITY 1
+#endif
+
+// Q16.16 fixed-point RMS, EMA and scoring instead of float. Set to 1 (or
+// build with -DUSE_FIXED_POINT=1) to use it.
+#ifndef USE_FIXED_POINT
+#define USE_FIXED_POINT 0
+#endif
+
+// Slow the read cadence down while every phase is steady (see
+// adaptive_sampling.h). Set to 0 for a fixed VOLTAGE_READ_INTERVAL.
+#ifndef ENABLE_ADAPTIVE_SAMPLING
+#define ENABLE_ADAPTIVE_SAMPLING 1
+#endif
+
+// ADC pin of an optional ZMPT101B on the load side of the relays. With it
+// every transfer measures the dead time the load saw and refines the relay
+// operate/release times. -1 when not fitted.
+#ifndef LOAD_SENSE_PIN
+#define LOAD_SENSE_PIN -1
+#endif
+
+// Inter-phase angles, phase sequence and voltage unbalance from a
+// time-aligned capture of all phases (phase_angle.h). Only meaningful when
+// the phases are the three phases of one supply.
+#ifndef ENABLE_PHASE_ANGLES
+#define ENABLE_PHASE_ANGLES (PHASE_PROFILE == PHASE_PROFILE_THREE_PHASE)
+#endif
+
+#if ENABLE_PHASE_ANGLES
+static_assert(NUM_PHASES == 3, "ENABLE_PHASE_ANGLES needs a three-phase PHASE_TABLE");
+#endif
+
+// Dynamic frequency scaling and automatic light sleep while the control task idles
+// between acquisition windows. Needs an SDK built with CONFIG_PM_ENABLE.
+#ifndef ENABLE_POWER_MANAGEMENT
+#define ENABLE_POWER_MANAGEMENT 0
+#endif
+
+#if ENABLE_POWER_MANAGEMENT
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
+#endif
+
+#if ENABLE_POWER_MANAGEMENT && defined(CONFIG_PM_ENABLE)
+#define POWER_MANAGEMENT_AVAILABLE 1
+#else
+#define POWER_MANAGEMENT_AVAILABLE 0
+#endif
 
 // Pin definitions
 #define BUTTON_1_PIN 13
 #define BUTTON_2_PIN 17
-#define RELAY_1_PIN 18  // Phase 1 relay
-#define RELAY_2_PIN 16   // Phase 2 relay
-#define RELAY_3_PIN 23  // Phase 3 relay
-#define VOLTAGE_SENSOR_1_PIN 32  // Phase 1
-#define VOLTAGE_SENSOR_2_PIN 35  // Phase 2
-#define VOLTAGE_SENSOR_3_PIN 34  // Phase 3
+// Voltage sensor and relay pins per phase live in PHASE_TABLE (phase_config.h)
 
 // LCD configuration
 LiquidCrystal_I2C lcd(0x27, 16, 2);
@@ -29,117 +104,514 @@ const char* ap_password = "phase12345";
 // Web server on port 80
 WebServer server(80);
 
-// Voltage sensor calibration
-const float VREF = 3.3;
-const int ADC_MAX = 4095;
-const int SAMPLES = 300;  // Reduced for better performance (was 500)
+// Advertised over mDNS/DNS-SD as _bpd._tcp so clients can find the device
+// without knowing its address. The device ID ("bpd-" + last 3 MAC bytes) is
+// also the hostname: http://bpd-xxxxxx.local/
+const char* FIRMWARE_VERSION = "1.1.0";
+const char* API_VERSION = "1";
+const char* API_CAPABILITIES = "status,setPhase,setMode,command,network,events,history,metrics";
+char deviceId[16];
 
-// Calibration factor - ADJUST THIS based on your ZMPT101B modules
-// Start with 250 and adjust after testing with a multimeter
-float CALIBRATION_FACTOR = 250.0;
+// Voltage sensor calibration (VREF, ADC_MAX, SAMPLES, CALIBRATION_FACTOR)
+// lives in sensor_config.h; the safety thresholds, VOLTAGE_EMA_ALPHA and
+// the acquisition and selection timing in decision_config.h
 
-// Safety thresholds
-const float OVERVOLTAGE_THRESHOLD = 260.0;
-const float UNDERVOLTAGE_THRESHOLD = 180.0;
-const float MIN_VOLTAGE = 150.0;
-const unsigned long MIN_SWITCH_INTERVAL = 30000;  // 30 seconds minimum between switches
+const float NOMINAL_FREQUENCY = 50.0;
 
-// Phase data structure
+// Phase data structure (runtime state; pins and names come from PHASE_TABLE)
 struct PhaseData {
-    float voltage;
-    float avgVoltage;
-    float minVoltage;
-    float maxVoltage;
-    bool isActive;
-    int relayPin;
-    String name;
+    float voltage = 0.0;
+    float avgVoltage = 0.0;
+    float minVoltage = 999.0;
+    float maxVoltage = 0.0;
+    bool isActive = false;
+    const char* name = "";
+#if USE_FIXED_POINT
+    q16_t avgVoltageQ16 = 0;  // Fixed-point EMA state; avgVoltage mirrors it
+#endif
 };
 
-PhaseData phases[3] = {
-    {0.0, 0.0, 999.0, 0.0, false, RELAY_1_PIN, "Phase 1"},
-    {0.0, 0.0, 999.0, 0.0, false, RELAY_2_PIN, "Phase 2"},
-    {0.0, 0.0, 999.0, 0.0, false, RELAY_3_PIN, "Phase 3"}
-};
+PhaseData phases[NUM_PHASES];
 
-// System state
-enum SystemMode { MODE_AUTOMATIC, MODE_MANUAL };
+// System state (SystemMode is in status_document.h)
 enum MenuState { MENU_MAIN, MENU_SELECT_PHASE, MENU_SETTINGS };
 
 SystemMode systemMode = MODE_AUTOMATIC;
 MenuState menuState = MENU_MAIN;
 int selectedPhase = 0;
 int currentMenuIndex = 0;
-unsigned long lastSwitchTime = 0;
 
-// Button state
+// Outcome of switchToPhase()
+enum SwitchResult {
+    SWITCH_DONE,
+    SWITCH_UNCHANGED,       // Target was already the active phase
+    SWITCH_INVALID_PHASE,
+    SWITCH_TARGET_LOW,      // Target below UNDERVOLTAGE_THRESHOLD
+    SWITCH_TARGET_HIGH      // Target above OVERVOLTAGE_THRESHOLD
+};
+
+// Phase and mode commands from HTTP clients, executed by the control task.
+// A handler asked to wait polls the command until it has run, at most
+// COMMAND_WAIT_LIMIT, and never runs it itself. The server handles one client
+// at a time, so the limit also bounds how long a long-poll holds up others.
+const int COMMAND_SLOTS = 16;  // Finished commands stay queryable until their slot is reused
+const int COMMAND_KEY_CACHE = 32;         // Finished keyed commands kept for retries once their slot is reused
+const uint32_t COMMAND_KEY_TTL = 600000;  // A retry is answered up to 10 minutes after the command finished
+const unsigned long COMMAND_WAIT_LIMIT = 2000;
+const unsigned long COMMAND_POLL_INTERVAL = 10;
+CommandQueue<COMMAND_SLOTS, COMMAND_KEY_CACHE> commandQueue(COMMAND_KEY_TTL);
+
+// Dwell, adaptive lockout and hourly rate limit for automatic switching
+SwitchController switchController;
+SwitchBlockReason lastLoggedBlock = SWITCH_ALLOWED;  // Journal each block episode once
+
+// Buttons are interrupt driven: every edge (re)arms a one-shot debounce
+// timer, and the timer callback classifies presses and queues them for the
+// control task. Input keeps working through readVoltage() and delay() calls.
+enum PressType : uint8_t { PRESS_SHORT, PRESS_LONG, PRESS_DOUBLE };
+
+struct ButtonEvent {
+    uint8_t button;  // 1 or 2
+    PressType type;
+};
+
 struct ButtonState {
     int pin;
-    bool lastState;
+    uint8_t number;
+    bool detectDouble;               // Hold short presses back to look for a second click
+    bool isPressed;                  // Debounced level, owned by the timer callbacks
     unsigned long pressStartTime;
-    bool isPressed;
-    bool wasLongPress;
+    bool clickPending;
+    esp_timer_handle_t debounceTimer;
+    esp_timer_handle_t clickTimer;
+    volatile bool wakeArmed;         // Pin temporarily on a level interrupt for light sleep
 };
 
-ButtonState button1 = {BUTTON_1_PIN, HIGH, 0, false, false};
-ButtonState button2 = {BUTTON_2_PIN, HIGH, 0, false, false};
+ButtonState button1 = {BUTTON_1_PIN, 1, true, false, 0, false, NULL, NULL, false};
+ButtonState button2 = {BUTTON_2_PIN, 2, false, false, 0, false, NULL, NULL, false};
+QueueHandle_t buttonQueue = NULL;
 
 const unsigned long LONG_PRESS_TIME = 1000;
 const unsigned long DEBOUNCE_TIME = 50;
+const unsigned long DOUBLE_PRESS_WINDOW = 300;
 
-// Timing
-unsigned long lastVoltageRead = 0;
-unsigned long lastLCDUpdate = 0;
-unsigned long lastTrendUpdate = 0;
-const unsigned long VOLTAGE_READ_INTERVAL = 200;
+// Timing (the voltage read, trend and min/max intervals are in decision_config.h)
 const unsigned long LCD_UPDATE_INTERVAL = 500;
-const unsigned long TREND_UPDATE_INTERVAL = 5000;
+const unsigned long LCD_MESSAGE_TIME = 2000;  // A warning stays up this long before the next redraw
+unsigned long lcdMessageUntil = 0;
+const unsigned long JOURNAL_CHECK_INTERVAL = 1000;
+const unsigned long PHASE_ANGLE_INTERVAL = 1000;
+
+#if ENABLE_ADAPTIVE_SAMPLING
+// ADAPTIVE_SAMPLING_PARAMS (decision_config.h)
+AdaptiveSampler<NUM_PHASES> adaptiveSampling(ADAPTIVE_SAMPLING_PARAMS);
+#endif
+
+// Idle between jobs instead of spinning. The wait never runs past the next
+// job deadline, so sampling and switching keep their timing; the cap bounds
+// how long a queued command waits. Button events end the wait early.
+const unsigned long MAX_IDLE_WAIT = 20;
+const unsigned long DUTY_WINDOW = 10000;   // Duty cycle is reported per 10 s window
+const float ACTIVE_CURRENT_MA = 70.0;      // Estimated draw while the control task works (240 MHz, radio idle)
+const float IDLE_CURRENT_MA = 25.0;        // Estimated draw while idle (80 MHz / light sleep)
+uint64_t activeTimeUs = 0;
+uint64_t idleTimeUs = 0;
+uint32_t windowActiveUs = 0;
+uint32_t windowIdleUs = 0;
+unsigned long dutyWindowStart = 0;
+unsigned long lastIdleEnd = 0;
+float dutyCycle = 1.0;  // Fraction of the last window spent working
+bool powerManagementActive = false;  // esp_pm_configure() accepted the configuration
+#if POWER_MANAGEMENT_AVAILABLE
+esp_pm_lock_handle_t activeLock = NULL;  // Held while the control task works: full clock, no light sleep
+portMUX_TYPE buttonWakeMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// /api/status serves a published copy of the live values (status_document.h).
+// A value is republished only when it moves by more than its deadband, and
+// every change bumps that field's counter in statusVersions, which the ETag
+// is built from. In a stable grid most polls end as 304 Not Modified.
+const float STATUS_VOLTAGE_DEADBAND = 0.5;     // V
+const float STATUS_TREND_DEADBAND = 0.5;       // V/min
+const float STATUS_FREQUENCY_DEADBAND = 0.05;  // Hz
+const float STATUS_THD_DEADBAND = 0.5;         // %
+const float STATUS_CREST_DEADBAND = 0.02;
+const float STATUS_FLICKER_DEADBAND = 0.1;     // %
+const float STATUS_ANGLE_DEADBAND = 0.5;       // Degrees
+const float STATUS_UNBALANCE_DEADBAND = 0.1;   // %
+PublishedStatus published;
+StatusVersions statusVersions;
+uint32_t statusNotModified = 0;
+uint32_t responseOverflows = 0;  // Responses replaced by a 500 because they did not fit
+int bestPhase = -1;  // Result of the last findBestPhase() in the trend update
 
 // Voltage history for trend analysis
 const int HISTORY_SIZE = 20;
-float voltageHistory[3][HISTORY_SIZE];
+float voltageHistory[NUM_PHASES][HISTORY_SIZE];
 int historyIndex = 0;
 
+// Outlier rejection per phase (OUTLIER_WINDOW in sensor_config.h)
+HampelFilter<OUTLIER_WINDOW> voltageFilter[NUM_PHASES];
+
+// Zero-crossing-timed relay transfer (relay_transfer.h). The maxima are
+// from the SRD-05VDC datasheet, which gives no minima; those are
+// conservative guesses. With LOAD_SENSE_PIN the measured times refine the
+// expected values and can only widen the bounds; all are kept in NVS.
+const uint32_t RELAY_OPERATE_MIN_US = 2000;
+const uint32_t RELAY_OPERATE_MAX_US = 10000;
+const uint32_t RELAY_RELEASE_MIN_US = 1000;
+const uint32_t RELAY_RELEASE_MAX_US = 5000;
+const uint32_t TRANSFER_GUARD_US = 2000;  // Contacts stay open at least this long
+const uint32_t TRANSFER_LEAD_US = 1000;   // Planning to the first relay command
+const int ZC_SAMPLES = 500;               // ~2.5 mains cycles at ~100 us per sample
+const float ZC_MIN_AMPLITUDE = 200.0;     // ADC counts (~30 V); below this a phase is dead
+const float LOAD_LIVE_FRACTION = 0.15;    // Load counts as live above this share of the peak
+const uint32_t LOAD_SAMPLE_SLACK_US = 100;  // Load sensor sampling granularity, and then some
+
+RelayTiming relayTiming[NUM_PHASES];
+Preferences relayStore;
+uint16_t zcSamples[ZC_SAMPLES];
+PerfStat transferGapPlanned;
+PerfStat transferGapMeasured;
+uint32_t unsyncedTransfers = 0;  // A phase had no usable zero crossing
+
+#if ENABLE_PHASE_ANGLES
+// One cycle of all three phases, sampled round robin, every
+// PHASE_ANGLE_INTERVAL. The ratios between phases are smoothed over about
+// five cycles before angles and unbalance are derived.
+const float ANGLE_LIMIT = 15.0;  // Angle score reaches 0 at this displacement (degrees)
+PhaseRelationTracker phaseRelations(0.2f, ZC_MIN_AMPLITUDE);
+PhaseRelations supply = {};
+PhaseSequence loggedSequence = SEQUENCE_UNKNOWN;
+#endif
+
+// Short-term voltage forecast per phase (Holt linear smoothing)
+HoltForecaster voltageForecast[NUM_PHASES];
+
+#if ENABLE_POWER_QUALITY
+const float THD_LIMIT = 15.0;           // Reject phases with more distortion than this (%)
+const float MAX_FREQUENCY_ERROR = 2.0;  // Waveform score reaches 0 at this deviation (Hz)
+
+PowerQuality powerQuality[NUM_PHASES] = {};
+float pqPreviousRms[NUM_PHASES] = {};
+
+// Single-slot handoff to the analysis task: readVoltage() copies a window in
+// when the slot is free, the task clears pqPhase when it is done with it.
+uint16_t pqSamples[SAMPLES];
+float pqSampleRate = 0.0;
+volatile int pqPhase = -1;
+TaskHandle_t pqTaskHandle = NULL;
+portMUX_TYPE pqMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Event journal: RAM ring mirrored to NVS in batches of JOURNAL_BATCH events,
+// one NVS record per batch so a flush only rewrites the batch that changed
+const int JOURNAL_CAPACITY = 64;
+const int JOURNAL_BATCH = 8;
+const int JOURNAL_FLASH_SLOTS = JOURNAL_CAPACITY / JOURNAL_BATCH;
+const unsigned long JOURNAL_FLUSH_INTERVAL = 30000;  // Flush a partial batch after 30 s
+
+typedef EventJournal<JOURNAL_CAPACITY, NUM_PHASES> Journal;
+Journal journal;
+Preferences journalStore;
+uint16_t bootCount = 0;
+uint32_t journalFlushedSeq = 1;         // First sequence number not yet in flash
+unsigned long journalFirstPending = 0;  // When the oldest unflushed event was logged
+
+// Reading history for /api/history (HistoryReading in api_documents.h)
+const int READING_HISTORY_CAPACITY = 240;  // 20 minutes at TREND_UPDATE_INTERVAL
+SequenceRing<HistoryReading, READING_HISTORY_CAPACITY> readingHistory;
+
+// Runtime performance counters (exported on /api/metrics)
+enum PerfSection {
+    PERF_READ_VOLTAGE,
+    PERF_FIND_BEST_PHASE,
+    PERF_UPDATE_LCD,
+    PERF_HANDLE_CLIENT,
+    PERF_LOOP_INTERVAL,
+    PERF_SECTION_COUNT
+};
+const char* const PERF_SECTION_NAMES[PERF_SECTION_COUNT] = {
+    "read_voltage", "find_best_phase", "update_lcd", "handle_client", "loop_interval"
+};
+PerfStat perfStats[PERF_SECTION_COUNT];
+
+enum HttpRoute {
+    ROUTE_ROOT,
+    ROUTE_STATUS,
+    ROUTE_SET_PHASE,
+    ROUTE_SET_MODE,
+    ROUTE_COMMAND,
+    ROUTE_NETWORK,
+    ROUTE_EVENTS,
+    ROUTE_HISTORY,
+    ROUTE_METRICS,
+    ROUTE_NOT_FOUND,
+    ROUTE_COUNT
+};
+const char* const HTTP_ROUTE_NAMES[ROUTE_COUNT] = {
+    "/", "/api/status", "/api/setPhase", "/api/setMode", "/api/command", "/api/network",
+    "/api/events", "/api/history", "/api/metrics", "not_found"
+};
+PerfStat httpStats[ROUTE_COUNT];
+
+// Microseconds between two esp_timer_get_time() readings, saturated to the
+// 32-bit range of PerfStat (71 minutes). The esp_timer runs at a fixed rate,
+// so durations stay right when dynamic frequency scaling changes the CPU
+// clock mid-scope, and long stalls do not wrap like the 32-bit cycle
+// counter does (every ~18 s at 240 MHz).
+uint32_t elapsedUs(int64_t start, int64_t end) {
+    int64_t us = end - start;
+    return us > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+// Times the enclosing scope
+struct PerfScope {
+    PerfStat& stat;
+    int64_t startUs;
+    
+    PerfScope(PerfStat& s) : stat(s), startUs(esp_timer_get_time()) {}
+    ~PerfScope() {
+        stat.record(elapsedUs(startUs, esp_timer_get_time()));
+    }
+};
+
+// Admission control: HTTP work runs below the control task, so it cannot
+// delay sampling or switching, but it still competes for the CPU and the
+// state lock. Each client gets a request rate, only HTTP_CLIENT_SLOTS clients
+// are served at a time, and handleClient() only runs while the network CPU
+// budget (a share of wall time, in microseconds) is positive. Excess requests
+// get 429.
+const int AP_MAX_CLIENTS = 4;               // Stations allowed on the soft AP
+const int HTTP_CLIENT_SLOTS = 6;
+const float CLIENT_REQUEST_RATE = 4.0;      // Requests per second per client
+const float CLIENT_REQUEST_BURST = 8.0;
+const uint32_t CLIENT_IDLE_TIMEOUT = 30000; // A silent client's slot is reusable after 30 s
+const float NETWORK_CPU_SHARE = 0.25;       // Of wall time, averaged over the burst
+const float NETWORK_BUDGET_BURST_US = 50000.0;
+ClientRateLimiter<HTTP_CLIENT_SLOTS> clientLimiter(CLIENT_REQUEST_RATE, CLIENT_REQUEST_BURST,
+                                                   CLIENT_IDLE_TIMEOUT);
+TokenBucket networkBudget;
+uint32_t httpShed[SHED_CLIENTS + 1] = {};  // Indexed by AdmissionResult
+uint32_t networkDeferred = 0;              // loop() passes that skipped handleClient()
+
+// Heap trend: one sample per minute for the last hour
+const int HEAP_HISTORY_SIZE = 60;
+const unsigned long HEAP_SAMPLE_INTERVAL = 60000;
+uint32_t heapFreeHistory[HEAP_HISTORY_SIZE];
+uint32_t heapLargestHistory[HEAP_HISTORY_SIZE];
+int heapHistoryIndex = 0;
+int heapHistoryCount = 0;
+TaskHandle_t loopTaskHandle = NULL;
+
+// Sampling, switching, buttons and queued commands run in the control task,
+// above loop() on the same core; loop() only serves HTTP. A slow client can
+// hold up a response but not a reading or a switch. stateMutex guards what
+// both sides touch (phases, mode, command queue, journal, history, published
+// status): the control task holds it while it works, handlers only while
+// they queue a command or build a document, never across network I/O.
+const UBaseType_t CONTROL_TASK_PRIORITY = 2;  // loop() runs at 1
+const unsigned long HTTP_POLL_INTERVAL = 10;
+TaskHandle_t controlTaskHandle = NULL;
+SemaphoreHandle_t stateMutex = NULL;
+
+struct StateLock {
+    StateLock() { xSemaphoreTake(stateMutex, portMAX_DELAY); }
+    ~StateLock() { xSemaphoreGive(stateMutex); }
+};
+
+// Periodic work runs as scheduler jobs (include/scheduler.h), due times
+// advancing by whole periods so they do not drift. Deadlines are the start
+// delay tolerated before a run counts as missed.
+const int SCHEDULER_SLOTS = 32;
+const uint32_t SCHEDULER_TICK_MS = 10;
+Scheduler<SCHEDULER_SLOTS, SCHEDULER_TICK_MS> scheduler([]() -> uint32_t { return micros(); });
+
+void readVoltageJob(void* context);
+void trendJob(void* context);
+void lcdJob(void* context);
+void resetMinMaxJob(void* context);
+void journalFlushJob(void* context);
+void heapSampleJob(void* context);
+#if ENABLE_PHASE_ANGLES
+void phaseAngleJob(void* context);
+#endif
+
+Job voltageJob("read_voltage", readVoltageJob, NULL, VOLTAGE_READ_INTERVAL, 100);
+Job trendUpdateJob("trend_update", trendJob, NULL, TREND_UPDATE_INTERVAL, 1000);
+Job lcdUpdateJob("update_lcd", lcdJob, NULL, LCD_UPDATE_INTERVAL, 250);
+Job minMaxResetJob("reset_min_max", resetMinMaxJob, NULL, MIN_MAX_RESET_INTERVAL, 10000);
+Job journalJob("flush_journal", journalFlushJob, NULL, JOURNAL_CHECK_INTERVAL, 1000);
+Job heapJob("sample_heap", heapSampleJob, NULL, HEAP_SAMPLE_INTERVAL, 10000);
+#if ENABLE_PHASE_ANGLES
+Job phaseAnglesJob("phase_angles", phaseAngleJob, NULL, PHASE_ANGLE_INTERVAL, 500);
+#endif
+Job* const JOBS[] = {
+    &voltageJob, &trendUpdateJob, &lcdUpdateJob, &minMaxResetJob, &journalJob, &heapJob,
+#if ENABLE_PHASE_ANGLES
+    &phaseAnglesJob,
+#endif
+};
+const int JOB_COUNT = sizeof(JOBS) / sizeof(JOBS[0]);
+
 // Thread safety flag
 volatile bool isReadingVoltage = false;
 
+// Web interface, served straight from flash
+const char INDEX_HTML[] PROGMEM = R"rawliteral(
+<!DOCTYPE html><html><head>
+<meta name='viewport' content='width=device-width, initial-scale=1'>
+<title>Best Phase Detector</title>
+<style>
+body{font-family:Arial;margin:20px;background:#f0f0f0;}
+.container{max-width:600px;margin:0 auto;background:white;padding:20px;border-radius:10px;box-shadow:0 2px 10px rgba(0,0,0,0.1);}
+h1{color:#333;text-align:center;}
+.phase{background:#f9f9f9;margin:10px 0;padding:15px;border-radius:5px;border-left:4px solid #ddd;}
+.phase.active{border-left-color:#4CAF50;}
+.voltage{font-size:24px;font-weight:bold;color:#333;}
+.stats{font-size:12px;color:#666;margin-top:5px;}
+button{background:#2196F3;color:white;border:none;padding:10px 20px;margin:5px;border-radius:5px;cursor:pointer;font-size:16px;}
+button:hover{background:#0b7dda;}
+button.active{background:#4CAF50;}
+.controls{text-align:center;margin-top:20px;}
+.mode{text-align:center;margin:20px 0;padding:10px;background:#e3f2fd;border-radius:5px;}
+</style></head><body>
+<div class='container'>
+<h1>Best Phase Detector</h1>
+<div id='status'>Loading...</div>
+<div class='mode' id='modeDisplay'></div>
+<div class='controls'>
+<button onclick='setMode("auto")' id='autoBtn'>Auto Mode</button>
+<button onclick='setMode("manual")' id='manBtn'>Manual Mode</button>
+</div>
+</div>
+<script>
+function updateStatus(){
+fetch('/api/status?fields=mode,selectedPhase,name,voltage,avgVoltage,minVoltage,maxVoltage,isActive').then(r=>r.json()).then(data=>{
+let html='';
+data.phases.forEach((p,i)=>{
+html+='<div class="phase'+(p.isActive?' active':'')+'">';
+html+='<div style="display:flex;justify-content:space-between;align-items:center;">';
+html+='<div><strong>'+p.name+'</strong>'+(p.isActive?' <span style="background:#4CAF50;color:white;padding:2px 5px;border-radius:3px;font-size:10px;">ACTIVE</span>':'')+'</div>';
+html+='<div class="voltage">'+p.voltage.toFixed(1)+'V</div>';
+html+='</div>';
+html+='<div class="stats">Avg: '+p.avgVoltage.toFixed(1)+'V | Range: '+p.minVoltage.toFixed(1)+'-'+p.maxVoltage.toFixed(1)+'V</div>';
+if(data.mode==='manual'){
+html+='<button onclick="setPhase('+i+')" style="margin-top:10px;width:100%;">Switch to this phase</button>';
+}
+html+='</div>';
+});
+document.getElementById('status').innerHTML=html;
+document.getElementById('modeDisplay').innerHTML='<strong>Mode: '+(data.mode==='automatic'?'Automatic':'Manual')+' <br> Active Phase: '+data.phases[data.selectedPhase].name+'</strong>';
+document.getElementById('autoBtn').className=data.mode==='automatic'?'active':'';
+document.getElementById('manBtn').className=data.mode==='manual'?'active':'';
+});
+}
+function setPhase(p){
+fetch('/api/setPhase',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify({phase:p})})
+.then(r=>r.json()).then(d=>{alert(d.message);updateStatus();});
+}
+function setMode(m){
+fetch('/api/setMode',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify({mode:m})})
+.then(r=>r.json()).then(d=>{updateStatus();});
+}
+updateStatus();setInterval(updateStatus,2000);
+</script></body></html>
+)rawliteral";
+
+// Shared JSON scratch space. Handlers run one at a time from
+// server.handleClient(), so a single document and output buffer serve every
+// response without touching the heap.
+StaticJsonDocument<JSON_DOCUMENT_CAPACITY> jsonDoc;
+char jsonBuffer[JSON_BUFFER_SIZE];
+
 // Function prototypes
 void setupWiFi();
 void setupWebServer();
+void setupMDNS();
 void handleRoot();
 void handleGetStatus();
+void publishStatus();
 void handleSetPhase();
 void handleSetMode();
 void handleGetNetwork();
+void handleGetEvents();
+void handleGetHistory();
+void handleCommand();
+void handleGetCommand();
+void sendCommand(const Command& command);
+Command awaitCommand(const Command* command, unsigned long timeout);
+bool submitCommand(CommandType type, int argument, JsonDocument& request, bool wait, Command& result);
+void handleGetMetrics();
 void handleNotFound();
+JsonDocument& responseDoc();
+bool admitRequest();
+void sendJson(int code, JsonDocument& doc);
+void sendResult(int code, bool success, const char* message);
+void sendCommandResult(int code, bool success, const char* message);
+void formatIP(char* buffer, size_t size, const IPAddress& ip);
 void readVoltage(int phaseIndex, int sensorPin);
+bool isPhaseOutOfBand(int phaseIndex);
 void updateVoltageTrends();
 int findBestPhase();
-void switchToPhase(int phaseIndex, bool force = false);
+SwitchResult switchToPhase(int phaseIndex, bool force = false);
+const char* switchResultReason(SwitchResult result);
+void processCommands();
+void executeCommand(Command* command);
 void updateLCD();
+void setupButton(ButtonState* button);
+void IRAM_ATTR onButtonEdge(void* arg);
+#if POWER_MANAGEMENT_AVAILABLE
+void armButtonWake(ButtonState* button);
+void IRAM_ATTR disarmButtonWake(ButtonState* button);
+void disarmButtonWakes();
+#endif
+void onButtonDebounced(void* arg);
+void onButtonClickTimeout(void* arg);
+void queueButtonEvent(ButtonState* button, PressType type);
 void handleButtons();
-int checkButton(ButtonState* button);
-void processButtonPress(ButtonState* button, bool isLongPress);
+void processButtonPress(uint8_t button, PressType type);
 void navigateMenu(int direction);
 void selectMenuItem();
+void setRelay(int phaseIndex, bool energised);
 void resetRelays();
 void testRelays();
+void setupRelayTiming();
+void saveRelayTiming();
+ZeroCrossing captureWaveform(uint8_t pin);
+uint32_t transferRelays(int fromPhase, int toPhase);
+void setSystemMode(SystemMode mode);
+void setupJournal();
+void logEvent(EventCause cause, int fromPhase, int toPhase, uint8_t detail = 0);
+void flushJournal();
+void sampleHeap();
+void setupPowerManagement();
+void idleUntilNextDeadline();
+void controlTask(void* parameter);
+#if ENABLE_POWER_QUALITY
+void powerQualityTask(void* parameter);
+PowerQuality getPowerQuality(int phaseIndex);
+#endif
 
 void setup() {
     Serial.begin(115200);
     Serial.println("\n\n=== Best Phase Detector Starting ===");
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    stateMutex = xSemaphoreCreateMutex();
     
     // Initialize pins
-    pinMode(BUTTON_1_PIN, INPUT_PULLUP);
-    pinMode(BUTTON_2_PIN, INPUT_PULLUP);
-    pinMode(RELAY_1_PIN, OUTPUT);
-    pinMode(RELAY_2_PIN, OUTPUT);
-    pinMode(RELAY_3_PIN, OUTPUT);
-    pinMode(VOLTAGE_SENSOR_1_PIN, INPUT);
-    pinMode(VOLTAGE_SENSOR_2_PIN, INPUT);
-    pinMode(VOLTAGE_SENSOR_3_PIN, INPUT);
-    
-    // Initialize relays (HIGH = OFF for active-low relays)
+    buttonQueue = xQueueCreate(8, sizeof(ButtonEvent));
+    setupButton(&button1);
+    setupButton(&button2);
+    for (int i = 0; i < NUM_PHASES; i++) {
+        phases[i].name = PHASE_TABLE[i].name;
+        pinMode(PHASE_TABLE[i].relayPin, OUTPUT);
+        pinMode(PHASE_TABLE[i].adcPin, INPUT);
+    }
+    
+    // Initialize relays (all de-energised)
     resetRelays();
+    setupRelayTiming();
     Serial.println("Relays initialized (all OFF)");
     
     // Initialize I2C for LCD
@@ -184,20 +656,32 @@ void setup() {
     delay(2000);
     
     // Test relays
-    Serial.println("Testing relays (you should hear 3 clicks)...");
+    Serial.print("Testing relays (you should hear ");
+    Serial.print(NUM_PHASES);
+    Serial.println(" clicks)...");
     lcd.clear();
     lcd.setCursor(0, 0);
     lcd.print("Testing Relays");
     testRelays();
     
+#if ENABLE_POWER_QUALITY
+    // Analysis runs on core 0 so it never competes with sampling on core 1
+    xTaskCreatePinnedToCore(powerQualityTask, "powerQuality", 4096, NULL, 1, &pqTaskHandle, 0);
+#endif
+    
+    // Restore the event journal from flash
+    setupJournal();
+    
     // Initialize WiFi
     setupWiFi();
+    setupPowerManagement();
     
     // Setup web server
     setupWebServer();
+    setupMDNS();
     
     // Initialize voltage history
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < NUM_PHASES; i++) {
         for (int j = 0; j < HISTORY_SIZE; j++) {
             voltageHistory[i][j] = 0.0;
         }
@@ -209,259 +693,539 @@ void setup() {
     lcd.setCursor(0, 1);
     lcd.print("Mode: Auto");
     Serial.println("=== System initialized successfully ===");
+    logEvent(EVENT_BOOT, -1, -1);
+    sampleHeap();
     delay(2000);
+    
+    unsigned long now = millis();
+    scheduler.schedule(voltageJob, now);
+    scheduler.schedule(trendUpdateJob, now);
+    scheduler.schedule(lcdUpdateJob, now);
+    scheduler.schedule(minMaxResetJob, now + MIN_MAX_RESET_INTERVAL);
+    scheduler.schedule(journalJob, now + JOURNAL_CHECK_INTERVAL);
+    scheduler.schedule(heapJob, now + HEAP_SAMPLE_INTERVAL);
+#if ENABLE_PHASE_ANGLES
+    scheduler.schedule(phaseAnglesJob, now + PHASE_ANGLE_INTERVAL);
+#endif
+    xTaskCreatePinnedToCore(controlTask, "control", 8192, NULL, CONTROL_TASK_PRIORITY,
+                            &controlTaskHandle, xPortGetCoreID());
 }
 
+// Serves HTTP only; everything else runs in controlTask()
 void loop() {
-    unsigned long currentMillis = millis();
+    // Handle web server requests while the network budget lasts; pending
+    // connections wait in the backlog otherwise
+    if (networkBudget.available(millis())) {
+        PerfScope scope(perfStats[PERF_HANDLE_CLIENT]);
+        uint32_t start = micros();
+        server.handleClient();
+        networkBudget.spend(micros() - start);
+    } else {
+        networkDeferred++;
+    }
     
-    // Read voltages periodically
-    // Read voltages periodically (Round-robin to avoid blocking)
-    if (currentMillis - lastVoltageRead >= VOLTAGE_READ_INTERVAL) {
-        static int phaseToRead = 0;
-        isReadingVoltage = true;
-        
-        // Read one phase per cycle
-        switch (phaseToRead) {
-            case 0: readVoltage(0, VOLTAGE_SENSOR_1_PIN); break;
-            case 1: readVoltage(1, VOLTAGE_SENSOR_2_PIN); break;
-            case 2: readVoltage(2, VOLTAGE_SENSOR_3_PIN); break;
+    delay(HTTP_POLL_INTERVAL);
+}
+
+void controlTask(void* parameter) {
+    int64_t lastPassUs = 0;
+    for (;;) {
+        // How late each pass starts relative to the previous one
+        int64_t passUs = esp_timer_get_time();
+        if (lastPassUs != 0) {
+            perfStats[PERF_LOOP_INTERVAL].record(elapsedUs(lastPassUs, passUs));
         }
+        lastPassUs = passUs;
         
-        phaseToRead = (phaseToRead + 1) % 3;
+        {
+            StateLock lock;
+            
+            // Sampling, trends and switching, LCD, journal and heap jobs
+            scheduler.run(millis());
+            
+            handleButtons();
+            
+            // Run phase/mode commands queued by the handlers
+            processCommands();
+        }
         
-        isReadingVoltage = false;
-        lastVoltageRead = currentMillis;
+        idleUntilNextDeadline();
     }
+}
+
+void readVoltageJob(void* context) {
+    // Round-robin: one phase per run to avoid blocking
+    static int phaseToRead = 0;
+    isReadingVoltage = true;
+    readVoltage(phaseToRead, PHASE_TABLE[phaseToRead].adcPin);
+    phaseToRead = (phaseToRead + 1) % NUM_PHASES;
+    isReadingVoltage = false;
     
-    // Update voltage trends
-    if (currentMillis - lastTrendUpdate >= TREND_UPDATE_INTERVAL) {
-        updateVoltageTrends();
+#if ENABLE_ADAPTIVE_SAMPLING
+    // Follow the adaptive cadence; a trip back to full rate reads the next
+    // phase right away
+    uint32_t interval = adaptiveSampling.interval();
+    if (interval < voltageJob.period) scheduler.schedule(voltageJob, millis());
+    voltageJob.period = interval;
+#endif
+}
+
+void trendJob(void* context) {
+    unsigned long currentMillis = millis();
+    updateVoltageTrends();
+    bestPhase = findBestPhase();
+    
+    // Automatic mode: switch to best phase once the controller agrees
+    if (systemMode == MODE_AUTOMATIC) {
+        int currentPhase = phases[selectedPhase].isActive ? selectedPhase : -1;
+        bool currentFailed = isPhaseOutOfBand(selectedPhase);
         
-        // Automatic mode: switch to best phase
-        if (systemMode == MODE_AUTOMATIC) {
-            int bestPhase = findBestPhase();
-            if (bestPhase >= 0 && bestPhase < 3 && bestPhase != selectedPhase) {
-                Serial.print("Auto mode: Switching from Phase ");
-                Serial.print(selectedPhase + 1);
-                Serial.print(" to Phase ");
-                Serial.println(bestPhase + 1);
-                switchToPhase(bestPhase, false);
-            }
+        bool switchWanted = switchController.evaluate(currentMillis, bestPhase, currentPhase, currentFailed);
+        SwitchBlockReason blockReason = switchController.blockReason();
+        if ((blockReason == SWITCH_BLOCKED_LOCKOUT || blockReason == SWITCH_BLOCKED_RATE) &&
+            blockReason != lastLoggedBlock) {
+            logEvent(blockReason == SWITCH_BLOCKED_RATE ? EVENT_BLOCKED_RATE : EVENT_BLOCKED_LOCKOUT,
+                     currentPhase, bestPhase);
+        }
+        lastLoggedBlock = blockReason;
+        
+        if (switchWanted) {
+            Serial.print("Auto mode: Switching from Phase ");
+            Serial.print(selectedPhase + 1);
+            Serial.print(" to Phase ");
+            Serial.println(bestPhase + 1);
+            switchToPhase(bestPhase, false);
+        } else if (switchController.blockReason() == SWITCH_BLOCKED_DWELL) {
+            Serial.print("Switch pending: Phase ");
+            Serial.print(bestPhase + 1);
+            Serial.print(" leading for ");
+            Serial.print(switchController.candidateAge(currentMillis) / 1000);
+            Serial.println("s");
+        } else if (switchController.blockReason() == SWITCH_BLOCKED_LOCKOUT) {
+            Serial.print("Switch blocked: Too soon (");
+            Serial.print(switchController.lockoutRemaining(currentMillis, currentFailed) / 1000);
+            Serial.println("s remaining)");
+        } else if (switchController.blockReason() == SWITCH_BLOCKED_RATE) {
+            Serial.println("Switch blocked: Hourly switch limit reached");
         }
-        lastTrendUpdate = currentMillis;
     }
+}
+
+void lcdJob(void* context) {
+    // Don't update LCD during voltage reading or over a warning
+    if (!isReadingVoltage && (long)(millis() - lcdMessageUntil) >= 0) {
+        updateLCD();
+    }
+}
+
+// Reset min/max periodically for fresh calculations
+void resetMinMaxJob(void* context) {
+    for (int i = 0; i < NUM_PHASES; i++) {
+        phases[i].minVoltage = phases[i].avgVoltage;
+        phases[i].maxVoltage = phases[i].avgVoltage;
+    }
+}
+
+// Mirror journal to flash once a batch fills up or has waited long enough
+void journalFlushJob(void* context) {
+    uint32_t pendingEvents = journal.nextSeq() - journalFlushedSeq;
+    if (pendingEvents >= (uint32_t)JOURNAL_BATCH ||
+        (pendingEvents > 0 && millis() - journalFirstPending >= JOURNAL_FLUSH_INTERVAL)) {
+        flushJournal();
+    }
+}
+
+// Track heap fragmentation over long uptimes
+void heapSampleJob(void* context) {
+    sampleHeap();
+}
+
+#if ENABLE_PHASE_ANGLES
+// One mains cycle of all phases, round robin, straight into a running DFT:
+// about 20 ms and no sample buffer
+void phaseAngleJob(void* context) {
+    float frequency = NOMINAL_FREQUENCY;
+#if ENABLE_POWER_QUALITY
+    PowerQuality pq = getPowerQuality(0);
+    if (pq.valid && pq.frequency > 0.0f) frequency = pq.frequency;
+#endif
+    uint32_t cycleUs = (uint32_t)(1000000.0f / frequency);
     
-    // Update LCD
-    if (currentMillis - lastLCDUpdate >= LCD_UPDATE_INTERVAL) {
-        if (!isReadingVoltage) {  // Don't update LCD during voltage reading
-            updateLCD();
+    CycleDft<NUM_PHASES> dft;
+    uint32_t start = micros();
+    dft.begin(start, frequency);
+    while (micros() - start < cycleUs) {
+        for (int i = 0; i < NUM_PHASES; i++) {
+            uint32_t at = micros();
+            dft.add(i, analogRead(PHASE_TABLE[i].adcPin), at);
         }
-        lastLCDUpdate = currentMillis;
     }
     
-    // Handle buttons
-    handleButtons();
+    Phasor phasors[NUM_PHASES];
+    for (int i = 0; i < NUM_PHASES; i++) phasors[i] = dft.phasor(i);
+    if (!phaseRelations.update(phasors)) return;
+    supply = phaseRelations.relations();
     
-    // Handle web server requests
-    server.handleClient();
+    if (supply.sequence != loggedSequence) {
+        Serial.print("Phase sequence: ");
+        Serial.print(phaseSequenceName(supply.sequence));
+        Serial.print(", unbalance ");
+        Serial.print(supply.unbalance, 1);
+        Serial.println("%");
+        loggedSequence = supply.sequence;
+    }
 }
+#endif
 
 void readVoltage(int phaseIndex, int sensorPin) {
-    // Read samples and calculate DC offset
-    float sum = 0;
+    PerfScope scope(perfStats[PERF_READ_VOLTAGE]);
+    
     int readings[SAMPLES];
+#if USE_FIXED_POINT
+    RmsAccumulator accumulator;
+#endif
     
+    unsigned long samplingStart = micros();
     for (int i = 0; i < SAMPLES; i++) {
         readings[i] = analogRead(sensorPin);
-        sum += readings[i];
+#if USE_FIXED_POINT
+        accumulator.add(readings[i]);
+#endif
         delayMicroseconds(200);  // ~100Hz sampling for 50Hz AC
     }
+    unsigned long samplingTime = micros() - samplingStart;
     
-    // Calculate DC offset (centered around VCC/2 for ZMPT101B)
-    float avgReading = sum / SAMPLES;
-    float dcOffset = (avgReading / ADC_MAX) * VREF;
-    
-    // Calculate RMS of AC component
-    float sumSquaredAC = 0;
-    for (int i = 0; i < SAMPLES; i++) {
-        float voltage = (readings[i] / (float)ADC_MAX) * VREF;
-        float acComponent = voltage - dcOffset;
-        sumSquaredAC += acComponent * acComponent;
+#if ENABLE_POWER_QUALITY
+    // Hand the raw window to the analysis task if it is idle
+    if (pqTaskHandle != NULL && pqPhase < 0) {
+        for (int i = 0; i < SAMPLES; i++) {
+            pqSamples[i] = readings[i];
+        }
+        pqSampleRate = SAMPLES * 1000000.0f / samplingTime;
+        pqPhase = phaseIndex;
+        xTaskNotifyGive(pqTaskHandle);
     }
+#else
+    (void)samplingTime;
+#endif
     
-    float rmsVoltageAC = sqrt(sumSquaredAC / SAMPLES);
+    // RMS of the AC component (the DC offset of ~VCC/2 is removed), scaled
+    // to mains volts. ZMPT101B typically outputs ~1V RMS for 250V AC input
+    float voltsPerCount = VREF / ADC_MAX * CALIBRATION_FACTOR;
+#if USE_FIXED_POINT
+    q16_t acVoltageQ16 = accumulator.rms(toQ24(voltsPerCount));
+    float acVoltage = fromQ16(acVoltageQ16);
+#else
+    float acVoltage = rmsFromSamples(readings, SAMPLES, voltsPerCount);
+#endif
     
-    // Convert to actual AC voltage
-    // ZMPT101B typically outputs ~1V RMS for 250V AC input
-    float acVoltage = rmsVoltageAC * CALIBRATION_FACTOR;
+    bool plausible = voltageFilter[phaseIndex].update(acVoltage);
     
-    // Apply some filtering to reduce noise
-    phases[phaseIndex].voltage = acVoltage;
+#if ENABLE_ADAPTIVE_SAMPLING
+    // Outliers included: full-rate reads confirm or dismiss them quickly
+    bool wasSlow = !adaptiveSampling.atFullRate();
+    SamplingTrip trip = adaptiveSampling.update(phaseIndex, acVoltage, phases[phaseIndex].avgVoltage,
+                                                voltageForecast[phaseIndex].trendPerSecond(), millis());
+    if (trip != TRIP_NONE && wasSlow) {
+        Serial.print("Sampling at full rate: ");
+        Serial.print(samplingTripName(trip));
+        Serial.print(" on ");
+        Serial.println(phases[phaseIndex].name);
+    }
+#endif
     
-    // Update min/max
-    if (acVoltage < phases[phaseIndex].minVoltage && acVoltage > 50.0) {
-        phases[phaseIndex].minVoltage = acVoltage;
+    // Protection (isPhaseOutOfBand()) sees an out-of-band window at once,
+    // outlier or not: a real outage or sag must not wait until it holds the
+    // majority of the outlier window
+    if (plausible || voltageOutOfBand(acVoltage)) {
+        phases[phaseIndex].voltage = acVoltage;
     }
-    if (acVoltage > phases[phaseIndex].maxVoltage) {
-        phases[phaseIndex].maxVoltage = acVoltage;
+    
+    // Keep implausible windows out of min/max, the average and the forecast
+    if (!plausible) {
+        Serial.print("Outlier rejected: ");
+        Serial.print(phases[phaseIndex].name);
+        Serial.print(" ");
+        Serial.print(acVoltage, 1);
+        Serial.print("V (median ");
+        Serial.print(voltageFilter[phaseIndex].median(), 1);
+        Serial.println("V)");
+        return;
     }
     
-    // Update average (exponential moving average)
-    if (phases[phaseIndex].avgVoltage == 0.0) {
-        phases[phaseIndex].avgVoltage = acVoltage;
+    trackExtremes(acVoltage, phases[phaseIndex].minVoltage, phases[phaseIndex].maxVoltage);
+    
+    // Update average (exponential moving average). The weight grows with
+    // the read interval so the average keeps its time constant.
+#if ENABLE_ADAPTIVE_SAMPLING
+    float emaAlpha = adaptiveSampling.emaAlpha(VOLTAGE_EMA_ALPHA);
+#else
+    float emaAlpha = VOLTAGE_EMA_ALPHA;
+#endif
+#if USE_FIXED_POINT
+    PhaseData& phase = phases[phaseIndex];
+    if (phase.avgVoltageQ16 == 0) {
+        phase.avgVoltageQ16 = acVoltageQ16;
     } else {
-        phases[phaseIndex].avgVoltage = (phases[phaseIndex].avgVoltage * 0.85) + (acVoltage * 0.15);
+        phase.avgVoltageQ16 = emaQ16(phase.avgVoltageQ16, acVoltageQ16, toQ16(emaAlpha));
     }
+    phase.avgVoltage = fromQ16(phase.avgVoltageQ16);
+#else
+    phases[phaseIndex].avgVoltage = updateAverage(phases[phaseIndex].avgVoltage, acVoltage, emaAlpha);
+#endif
+    
+    voltageForecast[phaseIndex].update(acVoltage, millis());
+}
+
+#if ENABLE_POWER_QUALITY
+void powerQualityTask(void* parameter) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        int phaseIndex = pqPhase;
+        if (phaseIndex < 0) continue;
+        
+        PowerQuality result = getPowerQuality(phaseIndex);
+        analyzePowerQuality(pqSamples, SAMPLES, pqSampleRate, NOMINAL_FREQUENCY,
+                            pqPreviousRms[phaseIndex], result);
+        
+        portENTER_CRITICAL(&pqMux);
+        powerQuality[phaseIndex] = result;
+        portEXIT_CRITICAL(&pqMux);
+        
+        pqPhase = -1;  // Release the sample slot
+    }
+}
+
+PowerQuality getPowerQuality(int phaseIndex) {
+    portENTER_CRITICAL(&pqMux);
+    PowerQuality result = powerQuality[phaseIndex];
+    portEXIT_CRITICAL(&pqMux);
+    return result;
+}
+#endif
+
+bool isPhaseOutOfBand(int phaseIndex) {
+    return voltageOutOfBand(phases[phaseIndex].voltage);
 }
 
 void updateVoltageTrends() {
     // Store current voltages in history
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < NUM_PHASES; i++) {
         voltageHistory[i][historyIndex] = phases[i].avgVoltage;
     }
     historyIndex = (historyIndex + 1) % HISTORY_SIZE;
     
-    // Reset min/max periodically for fresh calculations
-    static unsigned long lastReset = 0;
-    if (millis() - lastReset > 300000) {  // Reset every 5 minutes
-        for (int i = 0; i < 3; i++) {
-            phases[i].minVoltage = phases[i].avgVoltage;
-            phases[i].maxVoltage = phases[i].avgVoltage;
-        }
-        lastReset = millis();
+    HistoryReading reading;
+    reading.timestamp = millis();
+    reading.selectedPhase = selectedPhase;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        reading.voltage[i] = (int16_t)lroundf(phases[i].avgVoltage * 10.0f);
     }
+    readingHistory.append(reading);
 }
 
 int findBestPhase() {
-    int bestPhase = selectedPhase;
-    float bestScore = -1.0;
-    
-    const float HYSTERESIS_BONUS = 15.0;  // Prefer current phase to avoid excessive switching
-    const float TARGET_VOLTAGE = 220.0;
-    const float MAX_VARIATION = 30.0;
-    
-    Serial.println("\n--- Phase Analysis ---");
+    PerfScope scope(perfStats[PERF_FIND_BEST_PHASE]);
     
-    for (int i = 0; i < 3; i++) {
-        if (phases[i].avgVoltage < MIN_VOLTAGE) {
-            Serial.print(phases[i].name);
-            Serial.println(": REJECTED (voltage too low)");
-            continue;
-        }
-        
-        // Calculate stability score (0-100)
-        float variation = phases[i].maxVoltage - phases[i].minVoltage;
-        float stabilityScore = 100.0 * (1.0 - min(variation / MAX_VARIATION, 1.0f));
-        
-        // Calculate voltage quality score (0-100)
-        float voltageError = abs(phases[i].avgVoltage - TARGET_VOLTAGE);
-        float voltageScore = 100.0 * (1.0 - min(voltageError / 50.0f, 1.0f));
+    PhaseCandidate candidates[NUM_PHASES];
+#if ENABLE_POWER_QUALITY
+    PowerQuality pq[NUM_PHASES];
+#endif
+    for (int i = 0; i < NUM_PHASES; i++) {
+        PhaseCandidate& candidate = candidates[i];
+        candidate.average = phases[i].avgVoltage;
+        candidate.forecast = voltageForecast[i].predict(FORECAST_HORIZON);
+        candidate.variation = phases[i].maxVoltage - phases[i].minVoltage;
+        candidate.distorted = false;
         
-        // Combined score (weighted average)
-        float totalScore = (voltageScore * 0.6) + (stabilityScore * 0.4);
-        
-        // Add hysteresis bonus to current phase
-        if (i == selectedPhase) {
-            totalScore += HYSTERESIS_BONUS;
+        // Waveform quality score (0-100): distortion and frequency deviation
+        candidate.waveformScore = -1.0f;
+#if ENABLE_POWER_QUALITY
+        pq[i] = getPowerQuality(i);
+        if (pq[i].valid) {
+            candidate.distorted = pq[i].thd > THD_LIMIT;
+            float thdScore = 100.0f * (1.0f - min(pq[i].thd / THD_LIMIT, 1.0f));
+            float frequencyError = pq[i].frequency > 0.0f ? fabsf(pq[i].frequency - NOMINAL_FREQUENCY) : MAX_FREQUENCY_ERROR;
+            float frequencyScore = 100.0f * (1.0f - min(frequencyError / MAX_FREQUENCY_ERROR, 1.0f));
+            candidate.waveformScore = min(thdScore, frequencyScore);
         }
-        
+#endif
+#if ENABLE_PHASE_ANGLES
+        // A phase pulled away from its 120-degree position points at a
+        // supply-side fault (broken neutral, upstream unbalance)
+        if (phaseRelations.valid()) {
+            float angleScore = 100.0f * (1.0f - min(fabsf(supply.displacement[i]) / ANGLE_LIMIT, 1.0f));
+            candidate.waveformScore = candidate.waveformScore < 0.0f
+                ? angleScore : min(candidate.waveformScore, angleScore);
+        }
+#endif
+    }
+    
+    // Weighted voltage (worse of now and forecast), stability and waveform scores
+#if USE_FIXED_POINT
+    static const ScoringParamsQ16 scoringParams = toQ16(DEFAULT_SCORING_PARAMS);
+    int bestPhase = selectBestPhase(candidates, NUM_PHASES, [](int i, const PhaseCandidate& c) {
+        return fromQ16(scorePhaseQ16(phases[i].avgVoltageQ16, toQ16(c.forecast), toQ16(c.variation),
+                                     toQ16(c.waveformScore), scoringParams));
+    });
+#else
+    int bestPhase = selectBestPhase(candidates, NUM_PHASES, [](int i, const PhaseCandidate& c) {
+        return scorePhase(c.average, c.forecast, c.variation, c.waveformScore, DEFAULT_SCORING_PARAMS);
+    });
+#endif
+    
+    Serial.println("\n--- Phase Analysis ---");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        const PhaseCandidate& candidate = candidates[i];
         Serial.print(phases[i].name);
+        switch (candidate.verdict) {
+            case PHASE_REJECTED_LOW:
+                Serial.println(": REJECTED (voltage too low)");
+                continue;
+            case PHASE_REJECTED_FORECAST:
+                Serial.print(": REJECTED (forecast ");
+                Serial.print(candidate.forecast, 1);
+                Serial.println("V)");
+                continue;
+            case PHASE_REJECTED_DISTORTION:
+#if ENABLE_POWER_QUALITY
+                Serial.print(": REJECTED (THD ");
+                Serial.print(pq[i].thd, 1);
+                Serial.println("%)");
+#endif
+                continue;
+            case PHASE_SCORED:
+                break;
+        }
         Serial.print(": V=");
-        Serial.print(phases[i].avgVoltage, 1);
+        Serial.print(candidate.average, 1);
+        Serial.print("V, Fc=");
+        Serial.print(candidate.forecast, 1);
         Serial.print("V, Var=");
-        Serial.print(variation, 1);
+        Serial.print(candidate.variation, 1);
         Serial.print("V, Score=");
-        Serial.print(totalScore, 1);
-        if (i == selectedPhase) Serial.print(" (CURRENT+BONUS)");
+        Serial.print(candidate.score, 1);
+        if (i == selectedPhase) Serial.print(" (CURRENT)");
         Serial.println();
-        
-        if (totalScore > bestScore) {
-            bestScore = totalScore;
-            bestPhase = i;
-        }
     }
     
     Serial.print("Best phase: ");
-    Serial.println(phases[bestPhase].name);
+    Serial.println(bestPhase >= 0 ? phases[bestPhase].name : "none");
     
     return bestPhase;
 }
 
-void switchToPhase(int phaseIndex, bool force) {
-    if (phaseIndex < 0 || phaseIndex >= 3) {
+SwitchResult switchToPhase(int phaseIndex, bool force) {
+    if (phaseIndex < 0 || phaseIndex >= NUM_PHASES) {
         Serial.println("ERROR: Invalid phase index");
-        return;
+        return SWITCH_INVALID_PHASE;
     }
     
-    // Safety check: Don't switch too frequently (unless forced)
-    unsigned long timeSinceLastSwitch = millis() - lastSwitchTime;
-    if (!force && lastSwitchTime > 0 && timeSinceLastSwitch < MIN_SWITCH_INTERVAL) {
-        Serial.print("Switch blocked: Too soon (");
-        Serial.print((MIN_SWITCH_INTERVAL - timeSinceLastSwitch) / 1000);
-        Serial.println("s remaining)");
-        return;
+    // Re-selecting the live phase would only cause a needless blackout
+    if (phaseIndex == selectedPhase && phases[phaseIndex].isActive) {
+        return SWITCH_UNCHANGED;
     }
     
     // Safety check: Verify target phase voltage is in safe range
     if (phases[phaseIndex].avgVoltage < UNDERVOLTAGE_THRESHOLD) {
         Serial.println("Switch blocked: Target voltage too low!");
+        logEvent(EVENT_BLOCKED_LOW_VOLTAGE, selectedPhase, phaseIndex);
         lcd.clear();
         lcd.setCursor(0, 0);
         lcd.print("VOLTAGE TOO LOW!");
         lcd.setCursor(0, 1);
         lcd.print(phases[phaseIndex].name);
-        delay(2000);
-        return;
+        lcdMessageUntil = millis() + LCD_MESSAGE_TIME;
+        return SWITCH_TARGET_LOW;
     }
     
     if (phases[phaseIndex].avgVoltage > OVERVOLTAGE_THRESHOLD) {
         Serial.println("Switch blocked: Target voltage too high!");
+        logEvent(EVENT_BLOCKED_HIGH_VOLTAGE, selectedPhase, phaseIndex);
         lcd.clear();
         lcd.setCursor(0, 0);
         lcd.print("VOLTAGE TOO HIGH");
         lcd.setCursor(0, 1);
         lcd.print(phases[phaseIndex].name);
-        delay(2000);
-        return;
+        lcdMessageUntil = millis() + LCD_MESSAGE_TIME;
+        return SWITCH_TARGET_HIGH;
     }
     
-    // Turn off all relays first (safety)
-    resetRelays();
-    delay(100);
+    int previousPhase = phases[selectedPhase].isActive ? selectedPhase : -1;
     
-    // Turn on selected phase relay (LOW = ON for active-low relays)
-    digitalWrite(phases[phaseIndex].relayPin, LOW);
+    // Escaping a dead phase (or energising the first one) is not chatter
+    bool leftFailedPhase = force || !phases[selectedPhase].isActive || isPhaseOutOfBand(selectedPhase);
+    
+    // Break before make, with both contact movements on zero crossings
+    uint32_t gapUs = transferRelays(previousPhase, phaseIndex);
     phases[phaseIndex].isActive = true;
     
     // Update other phases
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < NUM_PHASES; i++) {
         if (i != phaseIndex) {
             phases[i].isActive = false;
         }
     }
     
     selectedPhase = phaseIndex;
-    lastSwitchTime = millis();
+    switchController.recordSwitch(millis(), leftFailedPhase);
+    logEvent(force ? EVENT_SWITCH_MANUAL : EVENT_SWITCH_AUTO, previousPhase, phaseIndex,
+             (uint8_t)min(gapUs / 1000, (uint32_t)255));
     
     Serial.print("Successfully switched to ");
     Serial.println(phases[phaseIndex].name);
+    return SWITCH_DONE;
 }
 
-void resetRelays() {
-    // HIGH = OFF for active-low relays
-    digitalWrite(RELAY_1_PIN, HIGH);
-    digitalWrite(RELAY_2_PIN, HIGH);
-    digitalWrite(RELAY_3_PIN, HIGH);
+const char* switchResultReason(SwitchResult result) {
+    switch (result) {
+        case SWITCH_DONE: return "switched";
+        case SWITCH_UNCHANGED: return "already active";
+        case SWITCH_INVALID_PHASE: return "invalid phase";
+        case SWITCH_TARGET_LOW: return "target voltage too low";
+        case SWITCH_TARGET_HIGH: return "target voltage too high";
+    }
+    return "unknown";
+}
+
+void processCommands() {
+    Command* command;
+    while ((command = commandQueue.nextPending()) != NULL) {
+        executeCommand(command);
+    }
+}
+
+void executeCommand(Command* command) {
+    if (command->type == COMMAND_SET_MODE) {
+        setSystemMode((SystemMode)command->argument);
+        commandQueue.complete(command, COMMAND_DONE, NULL, millis());
+        return;
+    }
     
-    for (int i = 0; i < 3; i++) {
+    // Manual phase selection implies manual mode, as on the buttons
+    setSystemMode(MODE_MANUAL);
+    SwitchResult result = switchToPhase(command->argument, true);
+    bool switched = result == SWITCH_DONE || result == SWITCH_UNCHANGED;
+    commandQueue.complete(command, switched ? COMMAND_DONE : COMMAND_REJECTED,
+                          switchResultReason(result), millis());
+}
+
+void setRelay(int phaseIndex, bool energised) {
+    const PhaseConfig& config = PHASE_TABLE[phaseIndex];
+    digitalWrite(config.relayPin, (energised != config.relayActiveLow) ? HIGH : LOW);
+}
+
+void resetRelays() {
+    for (int i = 0; i < NUM_PHASES; i++) {
+        setRelay(i, false);
         phases[i].isActive = false;
     }
 }
 
 void testRelays() {
     // Test each relay briefly
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < NUM_PHASES; i++) {
         Serial.print("Testing ");
         Serial.println(phases[i].name);
         lcd.setCursor(0, 1);
@@ -469,110 +1233,266 @@ void testRelays() {
         lcd.setCursor(0, 1);
         lcd.print(phases[i].name);
         
-        digitalWrite(phases[i].relayPin, LOW);  // ON
+        setRelay(i, true);
         delay(300);
-        digitalWrite(phases[i].relayPin, HIGH); // OFF
+        setRelay(i, false);
         delay(300);
     }
     Serial.println("Relay test complete");
 }
 
-void updateLCD() {
-    lcd.clear();
+// Operate/release times learned on earlier boots, else the datasheet values.
+// Stored bounds are never taken tighter than the datasheet's.
+void setupRelayTiming() {
+    RelayTiming datasheet = datasheetRelayTiming(RELAY_OPERATE_MIN_US, RELAY_OPERATE_MAX_US,
+                                                 RELAY_RELEASE_MIN_US, RELAY_RELEASE_MAX_US);
+    relayStore.begin("relays", false);
+    for (int i = 0; i < NUM_PHASES; i++) {
+        char key[12];
+        snprintf(key, sizeof(key), "op%d", i);
+        relayTiming[i].operateUs = relayStore.getUInt(key, datasheet.operateUs);
+        snprintf(key, sizeof(key), "rel%d", i);
+        relayTiming[i].releaseUs = relayStore.getUInt(key, datasheet.releaseUs);
+        snprintf(key, sizeof(key), "opmin%d", i);
+        relayTiming[i].minOperateUs = min(relayStore.getUInt(key, datasheet.minOperateUs), datasheet.minOperateUs);
+        snprintf(key, sizeof(key), "relmax%d", i);
+        relayTiming[i].maxReleaseUs = max(relayStore.getUInt(key, datasheet.maxReleaseUs), datasheet.maxReleaseUs);
+    }
+}
+
+void saveRelayTiming() {
+    for (int i = 0; i < NUM_PHASES; i++) {
+        char key[12];
+        snprintf(key, sizeof(key), "op%d", i);
+        relayStore.putUInt(key, relayTiming[i].operateUs);
+        snprintf(key, sizeof(key), "rel%d", i);
+        relayStore.putUInt(key, relayTiming[i].releaseUs);
+        snprintf(key, sizeof(key), "opmin%d", i);
+        relayStore.putUInt(key, relayTiming[i].minOperateUs);
+        snprintf(key, sizeof(key), "relmax%d", i);
+        relayStore.putUInt(key, relayTiming[i].maxReleaseUs);
+    }
+}
+
+// About two and a half mains cycles of `pin`, timed for zero crossings
+ZeroCrossing captureWaveform(uint8_t pin) {
+    uint32_t start = micros();
+    for (int i = 0; i < ZC_SAMPLES; i++) {
+        zcSamples[i] = analogRead(pin);
+        delayMicroseconds(90);
+    }
+    float interval = (float)(micros() - start) / ZC_SAMPLES;
+    return findZeroCrossing(zcSamples, ZC_SAMPLES, start, interval, ZC_MIN_AMPLITUDE);
+}
+
+// Moves the load from `fromPhase` (-1 if no relay is on) to `toPhase`: the
+// source contacts open on a source zero crossing and the target contacts
+// close on a target zero crossing (relay_transfer.h). Blocks for the
+// captures plus at most a cycle. Returns the dead time seen by the load in
+// us, measured with LOAD_SENSE_PIN and planned otherwise.
+uint32_t transferRelays(int fromPhase, int toPhase) {
+    for (int i = 0; i < NUM_PHASES; i++) {
+        if (i != fromPhase && i != toPhase) setRelay(i, false);
+    }
     
-    if (menuState == MENU_MAIN) {
-        // Line 1: Phase voltages
-        lcd.setCursor(0, 0);
-        lcd.print("P1:");
-        lcd.print((int)phases[0].voltage);
-        lcd.print(" P2:");
-        lcd.print((int)phases[1].voltage);
-        
-        // Line 2: Phase 3 voltage and mode
-        lcd.setCursor(0, 1);
-        lcd.print("P3:");
-        lcd.print((int)phases[2].voltage);
-        lcd.print(" ");
-        lcd.print(systemMode == MODE_AUTOMATIC ? "AUTO" : "MAN");
-        
-        // Show active phase indicator (*)
-        for (int i = 0; i < 3; i++) {
-            if (phases[i].isActive) {
-                if (i == 0) lcd.setCursor(2, 0);
-                else if (i == 1) lcd.setCursor(9, 0);
-                else lcd.setCursor(2, 1);
-                lcd.print("*");
+    ZeroCrossing source = {0, 0, 0.0f, 0.0f};
+    if (fromPhase >= 0) source = captureWaveform(PHASE_TABLE[fromPhase].adcPin);
+    ZeroCrossing target = captureWaveform(PHASE_TABLE[toPhase].adcPin);
+#if LOAD_SENSE_PIN >= 0
+    ZeroCrossing load = captureWaveform(LOAD_SENSE_PIN);
+    bool loadLive = load.amplitude >= ZC_MIN_AMPLITUDE;
+#endif
+    
+    TransferPlan plan = planTransfer(fromPhase >= 0 ? &source : NULL,
+                                     fromPhase >= 0 ? &relayTiming[fromPhase] : NULL,
+                                     target, relayTiming[toPhase],
+                                     micros() + TRANSFER_LEAD_US, TRANSFER_GUARD_US);
+    if (!plan.targetSynced || (fromPhase >= 0 && !plan.sourceSynced)) unsyncedTransfers++;
+    
+    // Busy-wait for the commands: delay() would only be good to a tick.
+    // With a load sensor, keep sampling it for a cycle past the close.
+    bool released = fromPhase < 0;
+    bool operated = false;
+#if LOAD_SENSE_PIN >= 0
+    LoadGapMeter meter;
+    meter.begin(load.midpoint, target.amplitude * LOAD_LIVE_FRACTION, micros());
+    uint32_t endAt = plan.closeAt + (target.valid() ? target.periodUs : 20000);
+#else
+    uint32_t endAt = plan.operateAt;
+#endif
+    while (true) {
+        uint32_t now = micros();
+        if (!released && (int32_t)(now - plan.releaseAt) >= 0) {
+            setRelay(fromPhase, false);
+            released = true;
+        }
+        if (!operated && (int32_t)(now - plan.operateAt) >= 0) {
+            setRelay(toPhase, true);
+            operated = true;
+        }
+        if (operated && (int32_t)(now - endAt) >= 0) break;
+#if LOAD_SENSE_PIN >= 0
+        meter.sample(now, analogRead(LOAD_SENSE_PIN));
+#endif
+    }
+    
+    // No gap to speak of when the load had no supply before
+    uint32_t gapUs = 0;
+    if (fromPhase >= 0) {
+        gapUs = plan.gapUs();
+        transferGapPlanned.record(gapUs);
+    }
+    
+#if LOAD_SENSE_PIN >= 0
+    // The first live sample after the longest gap is the close; the last one
+    // before it the open. A close can be seen late and an open early by up
+    // to the band around a zero crossing that is below the live threshold,
+    // which learning treats as uncertainty, never as a tighter bound.
+    float liveThreshold = target.amplitude * LOAD_LIVE_FRACTION;
+    uint32_t operateBand = zeroCrossingBandUs(target, liveThreshold);
+    uint32_t releaseBand = zeroCrossingBandUs(source, liveThreshold);
+    if ((int32_t)(meter.gapEndUs - plan.operateAt) > 0) {
+        bool learned = false;
+        if (operateBand > 0) {
+            learned = learnOperateTime(relayTiming[toPhase], meter.gapEndUs - plan.operateAt,
+                                       operateBand + LOAD_SAMPLE_SLACK_US);
+        }
+        if (fromPhase >= 0 && loadLive) {
+            gapUs = meter.gapUs;
+            transferGapMeasured.record(gapUs);
+            if (releaseBand > 0 && (int32_t)(meter.gapStartUs - plan.releaseAt) > 0) {
+                learned |= learnReleaseTime(relayTiming[fromPhase], meter.gapStartUs - plan.releaseAt,
+                                            releaseBand + LOAD_SAMPLE_SLACK_US);
             }
         }
+        if (learned) saveRelayTiming();
+    } else {
+        Serial.println("Transfer: no voltage on the load side after closing");
+    }
+#endif
+    
+    if (fromPhase < 0) return 0;
+    Serial.print("Transfer gap: ");
+    Serial.print(gapUs / 1000.0, 1);
+    Serial.print(" ms");
+    if (!plan.targetSynced || !plan.sourceSynced) {
+        Serial.print(" (no zero crossing on ");
+        Serial.print(plan.targetSynced ? phases[fromPhase].name : phases[toPhase].name);
+        Serial.print(")");
+    }
+    Serial.println();
+    return gapUs;
+}
+
+void updateLCD() {
+    PerfScope scope(perfStats[PERF_UPDATE_LCD]);
+    
+    if (menuState == MENU_MAIN) {
+        drawMainScreen(lcd, phases, systemMode == MODE_AUTOMATIC);
     }
     else if (menuState == MENU_SELECT_PHASE) {
-        lcd.setCursor(0, 0);
-        lcd.print("Select Phase:");
-        lcd.setCursor(0, 1);
-        lcd.print(phases[currentMenuIndex].name);
-        lcd.print(" ");
-        lcd.print((int)phases[currentMenuIndex].voltage);
-        lcd.print("V");
-        if (currentMenuIndex == selectedPhase) {
-            lcd.print("*");
-        }
+        drawSelectPhaseScreen(lcd, phases, currentMenuIndex, selectedPhase);
     }
     else if (menuState == MENU_SETTINGS) {
-        lcd.setCursor(0, 0);
-        lcd.print("Settings:");
-        lcd.setCursor(0, 1);
-        lcd.print("Mode: ");
-        lcd.print(systemMode == MODE_AUTOMATIC ? "Auto" : "Manual");
+        drawSettingsScreen(lcd, systemMode == MODE_AUTOMATIC);
     }
 }
 
-void handleButtons() {
-    int btn1Result = checkButton(&button1);
-    int btn2Result = checkButton(&button2);
+void setupButton(ButtonState* button) {
+    pinMode(button->pin, INPUT_PULLUP);
     
-    if (btn1Result != -1) {
-        processButtonPress(&button1, btn1Result == 1);
-    }
-    if (btn2Result != -1) {
-        processButtonPress(&button2, btn2Result == 1);
+    esp_timer_create_args_t debounceArgs = {};
+    debounceArgs.callback = onButtonDebounced;
+    debounceArgs.arg = button;
+    debounceArgs.name = "btnDebounce";
+    esp_timer_create(&debounceArgs, &button->debounceTimer);
+    
+    esp_timer_create_args_t clickArgs = {};
+    clickArgs.callback = onButtonClickTimeout;
+    clickArgs.arg = button;
+    clickArgs.name = "btnClick";
+    esp_timer_create(&clickArgs, &button->clickTimer);
+    
+    attachInterruptArg(digitalPinToInterrupt(button->pin), onButtonEdge, button, CHANGE);
+}
+
+// Any edge restarts the debounce timer; the level is sampled once it settles
+void IRAM_ATTR onButtonEdge(void* arg) {
+    ButtonState* button = (ButtonState*)arg;
+#if POWER_MANAGEMENT_AVAILABLE
+    // A wake level keeps firing while it holds: back to edges straight away
+    if (button->wakeArmed) {
+        portENTER_CRITICAL_ISR(&buttonWakeMux);
+        disarmButtonWake(button);
+        portEXIT_CRITICAL_ISR(&buttonWakeMux);
     }
+#endif
+    esp_timer_stop(button->debounceTimer);
+    esp_timer_start_once(button->debounceTimer, DEBOUNCE_TIME * 1000);
 }
 
-int checkButton(ButtonState* button) {
-    bool currentState = digitalRead(button->pin);
-    unsigned long currentTime = millis();
+void onButtonDebounced(void* arg) {
+    ButtonState* button = (ButtonState*)arg;
+    bool pressed = digitalRead(button->pin) == LOW;  // LOW because of pull-up
+    if (pressed == button->isPressed) return;
+    button->isPressed = pressed;
     
-    // Button is pressed (LOW because of pull-up)
-    if (currentState == LOW && button->lastState == HIGH) {
-        button->pressStartTime = currentTime;
-        button->isPressed = true;
-        button->wasLongPress = false;
+    unsigned long now = millis();
+    if (pressed) {
+        button->pressStartTime = now;
+        return;
     }
     
-    // Button is released
-    if (currentState == HIGH && button->lastState == LOW && button->isPressed) {
-        button->isPressed = false;
-        unsigned long pressDuration = currentTime - button->pressStartTime;
-        
-        if (pressDuration > DEBOUNCE_TIME) {
-            button->lastState = currentState;
-            if (pressDuration >= LONG_PRESS_TIME) {
-                button->wasLongPress = true;
-                return 1;  // Long press
-            } else {
-                button->wasLongPress = false;
-                return 0;  // Short press
-            }
+    unsigned long pressDuration = now - button->pressStartTime;
+    if (pressDuration >= LONG_PRESS_TIME) {
+        if (button->clickPending) {
+            esp_timer_stop(button->clickTimer);
+            button->clickPending = false;
         }
+        queueButtonEvent(button, PRESS_LONG);
+    } else if (!button->detectDouble) {
+        queueButtonEvent(button, PRESS_SHORT);
+    } else if (button->clickPending) {
+        esp_timer_stop(button->clickTimer);
+        button->clickPending = false;
+        queueButtonEvent(button, PRESS_DOUBLE);
+    } else {
+        button->clickPending = true;
+        esp_timer_start_once(button->clickTimer, DOUBLE_PRESS_WINDOW * 1000);
     }
-    
-    button->lastState = currentState;
-    return -1;  // No action
 }
 
-void processButtonPress(ButtonState* button, bool isLongPress) {
-    if (button->pin == BUTTON_1_PIN) {
-        if (isLongPress) {
+// No second click arrived in time: it was a single short press
+void onButtonClickTimeout(void* arg) {
+    ButtonState* button = (ButtonState*)arg;
+    if (!button->clickPending) return;
+    button->clickPending = false;
+    queueButtonEvent(button, PRESS_SHORT);
+}
+
+void queueButtonEvent(ButtonState* button, PressType type) {
+    ButtonEvent event = {button->number, type};
+    xQueueSend(buttonQueue, &event, 0);  // Drop rather than block the timer task
+}
+
+void handleButtons() {
+    ButtonEvent event;
+    while (xQueueReceive(buttonQueue, &event, 0) == pdTRUE) {
+        processButtonPress(event.button, event.type);
+    }
+}
+
+void processButtonPress(uint8_t button, PressType type) {
+    logEvent(EVENT_BUTTON, -1, -1, (button << 2) | type);
+    bool isLongPress = type == PRESS_LONG;
+    
+    if (button == 1) {
+        if (type == PRESS_DOUBLE) {
+            // Double press: Open settings
+            Serial.println("Button 1: Double press - Settings");
+            menuState = MENU_SETTINGS;
+            currentMenuIndex = 0;
+        } else if (isLongPress) {
             // Long press: Enter/Exit menu
             Serial.println("Button 1: Long press - Toggle menu");
             if (menuState == MENU_MAIN) {
@@ -587,7 +1507,7 @@ void processButtonPress(ButtonState* button, bool isLongPress) {
             navigateMenu(-1);
         }
     }
-    else if (button->pin == BUTTON_2_PIN) {
+    else if (button == 2) {
         if (isLongPress) {
             // Long press: Select/Confirm
             Serial.println("Button 2: Long press - Select");
@@ -602,7 +1522,7 @@ void processButtonPress(ButtonState* button, bool isLongPress) {
 
 void navigateMenu(int direction) {
     if (menuState == MENU_SELECT_PHASE) {
-        currentMenuIndex = (currentMenuIndex + direction + 3) % 3;
+        currentMenuIndex = (currentMenuIndex + direction + NUM_PHASES) % NUM_PHASES;
         Serial.print("Navigate to: ");
         Serial.println(phases[currentMenuIndex].name);
     }
@@ -617,20 +1537,220 @@ void selectMenuItem() {
     if (menuState == MENU_SELECT_PHASE) {
         Serial.print("Selecting ");
         Serial.println(phases[currentMenuIndex].name);
-        systemMode = MODE_MANUAL;
+        setSystemMode(MODE_MANUAL);
         switchToPhase(currentMenuIndex, true);
         menuState = MENU_MAIN;
     }
     else if (menuState == MENU_SETTINGS) {
         if (currentMenuIndex == 0) {
             // Toggle mode
-            systemMode = (systemMode == MODE_AUTOMATIC) ? MODE_MANUAL : MODE_AUTOMATIC;
+            setSystemMode((systemMode == MODE_AUTOMATIC) ? MODE_MANUAL : MODE_AUTOMATIC);
             Serial.print("Mode changed to: ");
             Serial.println(systemMode == MODE_AUTOMATIC ? "Automatic" : "Manual");
         }
     }
 }
 
+void setSystemMode(SystemMode mode) {
+    if (mode == systemMode) return;
+    systemMode = mode;
+    logEvent(EVENT_MODE_CHANGE, -1, -1, (uint8_t)mode);
+}
+
+void setupJournal() {
+    journalStore.begin("journal", false);
+    
+    // Discard records written with a different event layout
+    if (journalStore.getUInt("layout", 0) != sizeof(Journal::Entry)) {
+        journalStore.clear();
+        journalStore.putUInt("layout", sizeof(Journal::Entry));
+    }
+    
+    bootCount = journalStore.getUInt("boots", 0) + 1;
+    journalStore.putUInt("boots", bootCount);
+    
+    // Load every batch, then restore them oldest first
+    static Journal::Entry batches[JOURNAL_FLASH_SLOTS][JOURNAL_BATCH];
+    int counts[JOURNAL_FLASH_SLOTS];
+    int order[JOURNAL_FLASH_SLOTS];
+    for (int slot = 0; slot < JOURNAL_FLASH_SLOTS; slot++) {
+        char key[8];
+        snprintf(key, sizeof(key), "b%d", slot);
+        size_t bytes = journalStore.getBytes(key, batches[slot], sizeof(batches[slot]));
+        counts[slot] = bytes / sizeof(Journal::Entry);
+        order[slot] = slot;
+    }
+    for (int i = 1; i < JOURNAL_FLASH_SLOTS; i++) {
+        int slot = order[i];
+        uint32_t firstSeq = counts[slot] > 0 ? batches[slot][0].seq : 0;
+        int j = i - 1;
+        while (j >= 0 && (counts[order[j]] > 0 ? batches[order[j]][0].seq : 0) > firstSeq) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = slot;
+    }
+    for (int i = 0; i < JOURNAL_FLASH_SLOTS; i++) {
+        int slot = order[i];
+        for (int j = 0; j < counts[slot]; j++) {
+            journal.restore(batches[slot][j]);
+        }
+    }
+    journalFlushedSeq = journal.nextSeq();
+    
+    Serial.print("Event journal restored, next seq ");
+    Serial.print(journalFlushedSeq);
+    Serial.print(", boot ");
+    Serial.println(bootCount);
+}
+
+void logEvent(EventCause cause, int fromPhase, int toPhase, uint8_t detail) {
+    Journal::Entry event;
+    event.timestamp = millis();
+    event.bootCount = bootCount;
+    event.cause = cause;
+    event.detail = detail;
+    event.fromPhase = fromPhase;
+    event.toPhase = toPhase;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        event.voltage[i] = (int16_t)constrain(phases[i].voltage * 10.0f, -32768.0f, 32767.0f);
+    }
+    
+    if (journal.nextSeq() == journalFlushedSeq) {
+        journalFirstPending = event.timestamp;
+    }
+    journal.append(event);
+}
+
+void flushJournal() {
+    uint32_t nextSeq = journal.nextSeq();
+    if (journalFlushedSeq >= nextSeq) return;
+    
+    // Rewrite each batch that holds unflushed events
+    uint32_t firstBatch = (journalFlushedSeq - 1) / JOURNAL_BATCH;
+    uint32_t lastBatch = (nextSeq - 2) / JOURNAL_BATCH;
+    for (uint32_t batch = firstBatch; batch <= lastBatch; batch++) {
+        Journal::Entry events[JOURNAL_BATCH];
+        int count = 0;
+        for (uint32_t seq = batch * JOURNAL_BATCH + 1; seq <= (batch + 1) * JOURNAL_BATCH && seq < nextSeq; seq++) {
+            if (journal.read(seq, events[count])) count++;
+        }
+        
+        char key[8];
+        snprintf(key, sizeof(key), "b%d", (int)(batch % JOURNAL_FLASH_SLOTS));
+        journalStore.putBytes(key, events, count * sizeof(Journal::Entry));
+    }
+    journalFlushedSeq = nextSeq;
+}
+
+void sampleHeap() {
+    heapFreeHistory[heapHistoryIndex] = ESP.getFreeHeap();
+    heapLargestHistory[heapHistoryIndex] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    heapHistoryIndex = (heapHistoryIndex + 1) % HEAP_HISTORY_SIZE;
+    if (heapHistoryCount < HEAP_HISTORY_SIZE) heapHistoryCount++;
+}
+
+void setupPowerManagement() {
+#if POWER_MANAGEMENT_AVAILABLE
+    esp_pm_config_esp32_t config = {};
+    config.max_freq_mhz = 240;
+    config.min_freq_mhz = 80;
+    config.light_sleep_enable = true;
+    if (esp_pm_configure(&config) != ESP_OK) {
+        Serial.println("Power management: configuration rejected");
+        return;
+    }
+    powerManagementActive = true;
+    
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "control", &activeLock);
+    esp_pm_lock_acquire(activeLock);
+    
+    // Modem sleep on the station interface; the AP keeps the radio awake
+    WiFi.setSleep(true);
+    
+    // Buttons wake the chip through armButtonWake() while the control task idles
+    esp_sleep_enable_gpio_wakeup();
+    
+    Serial.println("Power management: DFS 80-240 MHz, automatic light sleep");
+#elif ENABLE_POWER_MANAGEMENT
+    Serial.println("Power management: not available (SDK built without CONFIG_PM_ENABLE)");
+#endif
+    lastIdleEnd = micros();
+    dutyWindowStart = millis();
+}
+
+#if POWER_MANAGEMENT_AVAILABLE
+// Light sleep only wakes on GPIO levels, and gpio_wakeup_enable() turns the
+// pin's CHANGE interrupt into a level one. Arm the level the button is not
+// at, so it fires once, on the next edge, like the interrupt it replaces.
+// Only done while activeLock is released, the only time light sleep can
+// happen.
+void armButtonWake(ButtonState* button) {
+    portENTER_CRITICAL(&buttonWakeMux);
+    bool low = digitalRead(button->pin) == LOW;
+    gpio_wakeup_enable((gpio_num_t)button->pin, low ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    button->wakeArmed = true;
+    portEXIT_CRITICAL(&buttonWakeMux);
+}
+
+// Restores the edge interrupt. Called with buttonWakeMux held, from the
+// ISR as well, hence the register-level calls.
+void IRAM_ATTR disarmButtonWake(ButtonState* button) {
+    if (!button->wakeArmed) return;
+    gpio_ll_wakeup_disable(&GPIO, button->pin);
+    gpio_ll_set_intr_type(&GPIO, button->pin, GPIO_INTR_ANYEDGE);
+    button->wakeArmed = false;
+}
+
+void disarmButtonWakes() {
+    portENTER_CRITICAL(&buttonWakeMux);
+    disarmButtonWake(&button1);
+    disarmButtonWake(&button2);
+    portEXIT_CRITICAL(&buttonWakeMux);
+}
+#endif
+
+void idleUntilNextDeadline() {
+    unsigned long now = millis();
+    unsigned long wait = scheduler.timeUntilNext(now, MAX_IDLE_WAIT);
+    
+    unsigned long idleStart = micros();
+    uint32_t activeUs = idleStart - lastIdleEnd;
+    
+    if (wait > 0) {
+#if POWER_MANAGEMENT_AVAILABLE
+        if (powerManagementActive) {
+            armButtonWake(&button1);
+            armButtonWake(&button2);
+            esp_pm_lock_release(activeLock);
+        }
+#endif
+        ButtonEvent event;
+        xQueuePeek(buttonQueue, &event, pdMS_TO_TICKS(wait));
+#if POWER_MANAGEMENT_AVAILABLE
+        if (powerManagementActive) {
+            esp_pm_lock_acquire(activeLock);
+            disarmButtonWakes();
+        }
+#endif
+    }
+    
+    lastIdleEnd = micros();
+    uint32_t idleUs = lastIdleEnd - idleStart;
+    activeTimeUs += activeUs;
+    idleTimeUs += idleUs;
+    windowActiveUs += activeUs;
+    windowIdleUs += idleUs;
+    
+    if (now - dutyWindowStart >= DUTY_WINDOW) {
+        uint32_t total = windowActiveUs + windowIdleUs;
+        dutyCycle = total > 0 ? (float)windowActiveUs / total : 1.0f;
+        windowActiveUs = 0;
+        windowIdleUs = 0;
+        dutyWindowStart = now;
+    }
+}
+
 void setupWiFi() {
     Serial.println("\n=== WiFi Setup ===");
     
@@ -640,7 +1760,7 @@ void setupWiFi() {
     Serial.print("Starting Access Point: ");
     Serial.println(ap_ssid);
     
-    bool apStarted = WiFi.softAP(ap_ssid, ap_password);
+    bool apStarted = WiFi.softAP(ap_ssid, ap_password, 1, 0, AP_MAX_CLIENTS);
     
     if (apStarted) {
         IPAddress apIP = WiFi.softAPIP();
@@ -696,12 +1816,32 @@ void setupWiFi() {
 }
 
 void setupWebServer() {
-    server.on("/", handleRoot);
-    server.on("/api/status", HTTP_GET, handleGetStatus);
-    server.on("/api/setPhase", HTTP_POST, handleSetPhase);
-    server.on("/api/setMode", HTTP_POST, handleSetMode);
-    server.on("/api/network", HTTP_GET, handleGetNetwork);
-    server.onNotFound(handleNotFound);
+    networkBudget.init(NETWORK_CPU_SHARE * 1000.0f, NETWORK_BUDGET_BURST_US, millis());
+    
+    // Every route is counted and timed for /api/metrics, and only runs if
+    // the client is admitted
+    auto instrumented = [](HttpRoute route, void (*handler)()) {
+        return [route, handler]() {
+            PerfScope scope(httpStats[route]);
+            if (admitRequest()) handler();
+        };
+    };
+    
+    server.on("/", instrumented(ROUTE_ROOT, handleRoot));
+    server.on("/api/status", HTTP_GET, instrumented(ROUTE_STATUS, handleGetStatus));
+    server.on("/api/setPhase", HTTP_POST, instrumented(ROUTE_SET_PHASE, handleSetPhase));
+    server.on("/api/setMode", HTTP_POST, instrumented(ROUTE_SET_MODE, handleSetMode));
+    server.on("/api/command", HTTP_POST, instrumented(ROUTE_COMMAND, handleCommand));
+    server.on("/api/command", HTTP_GET, instrumented(ROUTE_COMMAND, handleGetCommand));
+    server.on("/api/network", HTTP_GET, instrumented(ROUTE_NETWORK, handleGetNetwork));
+    server.on("/api/events", HTTP_GET, instrumented(ROUTE_EVENTS, handleGetEvents));
+    server.on("/api/history", HTTP_GET, instrumented(ROUTE_HISTORY, handleGetHistory));
+    server.on("/api/metrics", HTTP_GET, instrumented(ROUTE_METRICS, handleGetMetrics));
+    server.onNotFound(instrumented(ROUTE_NOT_FOUND, handleNotFound));
+    
+    // Conditional GET on /api/status
+    static const char* headerKeys[] = {"If-None-Match"};
+    server.collectHeaders(headerKeys, 1);
     
     server.begin();
     Serial.println("HTTP server started");
@@ -709,178 +1849,632 @@ void setupWebServer() {
     Serial.println(WiFi.softAPIP());
 }
 
+void setupMDNS() {
+    uint64_t mac = ESP.getEfuseMac();
+    // The eFuse MAC is little-endian: bytes 3-5 are the device-specific part
+    snprintf(deviceId, sizeof(deviceId), "bpd-%02x%02x%02x",
+             (uint8_t)(mac >> 24), (uint8_t)(mac >> 32), (uint8_t)(mac >> 40));
+    
+    if (!MDNS.begin(deviceId)) {
+        Serial.println("mDNS failed to start");
+        return;
+    }
+    
+    // The responder follows both the AP and the STA interface, including
+    // address changes after a DHCP renewal
+    MDNS.setInstanceName(deviceId);
+    MDNS.addService("bpd", "tcp", 80);
+    MDNS.addServiceTxt("bpd", "tcp", "id", deviceId);
+    MDNS.addServiceTxt("bpd", "tcp", "fw", FIRMWARE_VERSION);
+    MDNS.addServiceTxt("bpd", "tcp", "api", API_VERSION);
+    MDNS.addServiceTxt("bpd", "tcp", "caps", API_CAPABILITIES);
+    MDNS.addService("http", "tcp", 80);
+    
+    Serial.print("mDNS: http://");
+    Serial.print(deviceId);
+    Serial.println(".local/");
+}
+
 void handleRoot() {
-    String html = "<!DOCTYPE html><html><head>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<title>Best Phase Detector</title>";
-    html += "<style>";
-    html += "body{font-family:Arial;margin:20px;background:#f0f0f0;}";
-    html += ".container{max-width:600px;margin:0 auto;background:white;padding:20px;border-radius:10px;box-shadow:0 2px 10px rgba(0,0,0,0.1);}";
-    html += "h1{color:#333;text-align:center;}";
-    html += ".phase{background:#f9f9f9;margin:10px 0;padding:15px;border-radius:5px;border-left:4px solid #ddd;}";
-    html += ".phase.active{border-left-color:#4CAF50;}";
-    html += ".voltage{font-size:24px;font-weight:bold;color:#333;}";
-    html += ".stats{font-size:12px;color:#666;margin-top:5px;}";
-    html += "button{background:#2196F3;color:white;border:none;padding:10px 20px;margin:5px;border-radius:5px;cursor:pointer;font-size:16px;}";
-    html += "button:hover{background:#0b7dda;}";
-    html += "button.active{background:#4CAF50;}";
-    html += ".controls{text-align:center;margin-top:20px;}";
-    html += ".mode{text-align:center;margin:20px 0;padding:10px;background:#e3f2fd;border-radius:5px;}";
-    html += "</style></head><body>";
-    html += "<div class='container'>";
-    html += "<h1>Best Phase Detector</h1>";
-    html += "<div id='status'>Loading...</div>";
-    html += "<div class='mode' id='modeDisplay'></div>";
-    html += "<div class='controls'>";
-    html += "<button onclick='setMode(\"auto\")' id='autoBtn'>Auto Mode</button>";
-    html += "<button onclick='setMode(\"manual\")' id='manBtn'>Manual Mode</button>";
-    html += "</div>";
-    html += "</div>";
-    html += "<script>";
-    html += "function updateStatus(){";
-    html += "fetch('/api/status').then(r=>r.json()).then(data=>{";
-    html += "let html='';";
-    html += "data.phases.forEach((p,i)=>{";
-    html += "html+='<div class=\"phase'+(p.isActive?' active':'')+'\">';";
-    html += "html+='<div style=\"display:flex;justify-content:space-between;align-items:center;\">';";
-    html += "html+='<div><strong>'+p.name+'</strong>'+(p.isActive?' <span style=\"background:#4CAF50;color:white;padding:2px 5px;border-radius:3px;font-size:10px;\">ACTIVE</span>':'')+'</div>';";
-    html += "html+='<div class=\"voltage\">'+p.voltage.toFixed(1)+'V</div>';";
-    html += "html+='</div>';";
-    html += "html+='<div class=\"stats\">Avg: '+p.avgVoltage.toFixed(1)+'V | Range: '+p.minVoltage.toFixed(1)+'-'+p.maxVoltage.toFixed(1)+'V</div>';";
-    html += "if(data.mode==='manual'){";
-    html += "html+='<button onclick=\"setPhase('+i+')\" style=\"margin-top:10px;width:100%;\">Switch to this phase</button>';";
-    html += "}";
-    html += "html+='</div>';";
-    html += "});";
-    html += "document.getElementById('status').innerHTML=html;";
-    html += "document.getElementById('modeDisplay').innerHTML='<strong>Mode: '+(data.mode==='automatic'?'Automatic':'Manual')+' <br> Active Phase: '+data.phases[data.selectedPhase].name+'</strong>';";
-    html += "document.getElementById('autoBtn').className=data.mode==='automatic'?'active':'';";
-    html += "document.getElementById('manBtn').className=data.mode==='manual'?'active':'';";
-    html += "});";
-    html += "}";
-    html += "function setPhase(p){";
-    html += "fetch('/api/setPhase',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify({phase:p})})";
-    html += ".then(r=>r.json()).then(d=>{alert(d.message);updateStatus();});";
-    html += "}";
-    html += "function setMode(m){";
-    html += "fetch('/api/setMode',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify({mode:m})})";
-    html += ".then(r=>r.json()).then(d=>{updateStatus();});";
-    html += "}";
-    html += "updateStatus();setInterval(updateStatus,2000);";
-    html += "</script></body></html>";
-    
-    server.send(200, "text/html", html);
+    server.send_P(200, "text/html", INDEX_HTML);
+}
+
+// Applies the per-client rate limit; a shed request is answered with 429
+// and a Retry-After hint.
+bool admitRequest() {
+    uint32_t retryAfterMs = 0;
+    AdmissionResult result = clientLimiter.admit((uint32_t)server.client().remoteIP(), millis(),
+                                                 &retryAfterMs);
+    if (result == ADMIT) return true;
+    
+    httpShed[result]++;
+    char retryAfter[12];
+    snprintf(retryAfter, sizeof(retryAfter), "%lu", (unsigned long)(retryAfterMs + 999) / 1000);
+    server.sendHeader("Retry-After", retryAfter);
+    sendResult(429, false, result == SHED_RATE ? "Too many requests" : "Too many clients");
+    return false;
+}
+
+JsonDocument& responseDoc() {
+    jsonDoc.clear();
+    return jsonDoc;
+}
+
+// A document that outgrew its pool or the buffer would go out as broken JSON;
+// it is answered with 500 instead
+const char RESPONSE_TOO_LARGE[] PROGMEM = "{\"success\":false,\"message\":\"Response too large\"}";
+
+void sendJson(int code, JsonDocument& doc) {
+    size_t length = serializeJson(doc, jsonBuffer, sizeof(jsonBuffer));
+    // serializeJson() stops one short of the buffer size to add the
+    // terminator, so a full buffer means the output was cut
+    if (doc.overflowed() || length >= sizeof(jsonBuffer) - 1) {
+        responseOverflows++;
+        Serial.println("Response too large, sent 500");
+        server.send_P(500, "application/json", RESPONSE_TOO_LARGE);
+        return;
+    }
+    server.send_P(code, "application/json", jsonBuffer, length);
+}
+
+void sendResult(int code, bool success, const char* message) {
+    JsonDocument& doc = responseDoc();
+    buildResult(doc, success, message);
+    sendJson(code, doc);
+}
+
+void sendCommandResult(int code, bool success, const char* message) {
+    JsonDocument& doc = responseDoc();
+    {
+        StateLock lock;
+        buildCommandResult(doc, success, message, systemMode, selectedPhase, phases);
+    }
+    sendJson(code, doc);
+}
+
+// Holds the request until the control task has run `command` or `timeout`
+// ms have passed, and returns a copy as it then stands. The state lock is
+// free while it waits. `command` must be pending, so it is in a queue slot,
+// which only handlers reuse.
+Command awaitCommand(const Command* command, unsigned long timeout) {
+    unsigned long start = millis();
+    for (;;) {
+        {
+            StateLock lock;
+            if (command->state != COMMAND_PENDING || millis() - start >= timeout) return *command;
+        }
+        delay(COMMAND_POLL_INTERVAL);
+    }
+}
+
+// Queues a command carrying the request's idempotency key and copies it to
+// `result`, with `wait` once it has run (awaitCommand()). Sends 503 and
+// returns false if the queue is full.
+bool submitCommand(CommandType type, int argument, JsonDocument& request, bool wait, Command& result) {
+    bool duplicate;
+    const char* key = request["key"] | "";
+    Command* command;
+    {
+        StateLock lock;
+        command = commandQueue.submit(type, argument, key, millis(), duplicate);
+        if (command) result = *command;
+    }
+    if (!command) {
+        sendResult(503, false, "Command queue full");
+        return false;
+    }
+    if (duplicate) {
+        Serial.print("Command retry, returning #");
+        Serial.println(result.id);
+    }
+    if (wait && result.state == COMMAND_PENDING) result = awaitCommand(command, COMMAND_WAIT_LIMIT);
+    return true;
+}
+
+void sendCommand(const Command& command) {
+    JsonDocument& doc = responseDoc();
+    {
+        StateLock lock;
+        buildCommandDocument(doc, command, systemMode, selectedPhase);
+    }
+    sendJson(command.state == COMMAND_PENDING ? 202 : 200, doc);
+}
+
+// POST /api/command {"type": "setPhase", "phase": n | "type": "setMode",
+// "mode": "auto"|"manual", "key": "...", "wait": true}
+// Without `wait` the command runs after the response is sent (202); its
+// outcome is then available from GET /api/command?id=<id>, which can
+// long-poll it. `wait` holds the request until the control task has run the
+// command, at most COMMAND_WAIT_LIMIT; a command still pending then is
+// answered with 202.
+void handleCommand() {
+    StaticJsonDocument<256> request;
+    if (!server.hasArg("plain") || deserializeJson(request, server.arg("plain"))) {
+        sendResult(400, false, "Invalid JSON");
+        return;
+    }
+    
+    const char* type = request["type"] | "";
+    bool wait = request["wait"] | false;
+    Command command;
+    
+    if (strcmp(type, "setPhase") == 0) {
+        int phase = request["phase"] | -1;
+        if (phase < 0 || phase >= NUM_PHASES) {
+            sendResult(400, false, "Invalid phase number");
+            return;
+        }
+        if (!submitCommand(COMMAND_SET_PHASE, phase, request, wait, command)) return;
+    } else if (strcmp(type, "setMode") == 0) {
+        const char* mode = request["mode"] | "";
+        if (strcmp(mode, "auto") == 0 || strcmp(mode, "automatic") == 0) {
+            if (!submitCommand(COMMAND_SET_MODE, MODE_AUTOMATIC, request, wait, command)) return;
+        } else if (strcmp(mode, "manual") == 0) {
+            if (!submitCommand(COMMAND_SET_MODE, MODE_MANUAL, request, wait, command)) return;
+        } else {
+            sendResult(400, false, "Invalid mode");
+            return;
+        }
+    } else {
+        sendResult(400, false, "Unknown command type");
+        return;
+    }
+    
+    sendCommand(command);
+}
+
+// GET /api/command?id=<id>[&wait=<ms>]. With `wait` a pending command is
+// long-polled: the response goes out once it has run, or with 202 after
+// `wait` ms (at most COMMAND_WAIT_LIMIT).
+void handleGetCommand() {
+    unsigned long wait = server.hasArg("wait") ? strtoul(server.arg("wait").c_str(), NULL, 10) : 0;
+    if (wait > COMMAND_WAIT_LIMIT) wait = COMMAND_WAIT_LIMIT;
+    
+    Command command;
+    Command* queued;
+    {
+        StateLock lock;
+        queued = commandQueue.find(strtoul(server.arg("id").c_str(), NULL, 10), millis());
+        if (queued) command = *queued;
+    }
+    if (!queued) {
+        sendResult(404, false, "Unknown or expired command");
+        return;
+    }
+    if (wait > 0 && command.state == COMMAND_PENDING) command = awaitCommand(queued, wait);
+    sendCommand(command);
+}
+
+// Copies live values into `published` where they moved past their deadband
+// and bumps the version of every field that changed.
+void publishStatus() {
+    if (published.mode != systemMode) {
+        published.mode = systemMode;
+        statusVersions.bump(STATUS_MODE);
+    }
+    if (published.selectedPhase != selectedPhase) {
+        published.selectedPhase = selectedPhase;
+        statusVersions.bump(STATUS_SELECTED_PHASE);
+    }
+    if (published.bestPhase != bestPhase) {
+        published.bestPhase = bestPhase;
+        statusVersions.bump(STATUS_BEST_PHASE);
+    }
+#if ENABLE_PHASE_ANGLES
+    bool supplyValid = phaseRelations.valid();
+    bool supplyChanged = supplyValid != published.supplyValid || supply.sequence != published.sequence;
+    published.supplyValid = supplyValid;
+    published.sequence = supply.sequence;
+    supplyChanged |= publishValue(published.unbalance, supply.unbalance, STATUS_UNBALANCE_DEADBAND);
+    if (supplyChanged) statusVersions.bump(STATUS_SUPPLY);
+#endif
+    
+    for (int i = 0; i < NUM_PHASES; i++) {
+        PhaseStatus& phase = published.phases[i];
+        if (publishValue(phase.voltage, phases[i].voltage, STATUS_VOLTAGE_DEADBAND)) {
+            statusVersions.bump(STATUS_VOLTAGE);
+        }
+        if (publishValue(phase.avgVoltage, phases[i].avgVoltage, STATUS_VOLTAGE_DEADBAND)) {
+            statusVersions.bump(STATUS_AVG_VOLTAGE);
+        }
+        if (publishValue(phase.minVoltage, phases[i].minVoltage, STATUS_VOLTAGE_DEADBAND)) {
+            statusVersions.bump(STATUS_MIN_VOLTAGE);
+        }
+        if (publishValue(phase.maxVoltage, phases[i].maxVoltage, STATUS_VOLTAGE_DEADBAND)) {
+            statusVersions.bump(STATUS_MAX_VOLTAGE);
+        }
+        if (publishValue(phase.forecastVoltage, voltageForecast[i].predict(FORECAST_HORIZON),
+                         STATUS_VOLTAGE_DEADBAND)) {
+            statusVersions.bump(STATUS_FORECAST_VOLTAGE);
+        }
+        if (publishValue(phase.trend, voltageForecast[i].trendPerSecond() * 60.0f,
+                         STATUS_TREND_DEADBAND)) {
+            statusVersions.bump(STATUS_TREND);
+        }
+#if ENABLE_POWER_QUALITY
+        PowerQuality pq = getPowerQuality(i);
+        bool pqChanged = pq.valid != phase.pq.valid;
+        phase.pq.valid = pq.valid;
+        // Evaluate every field so each published value catches up
+        pqChanged |= publishValue(phase.pq.frequency, pq.frequency, STATUS_FREQUENCY_DEADBAND);
+        pqChanged |= publishValue(phase.pq.thd, pq.thd, STATUS_THD_DEADBAND);
+        pqChanged |= publishValue(phase.pq.crestFactor, pq.crestFactor, STATUS_CREST_DEADBAND);
+        pqChanged |= publishValue(phase.pq.flicker, pq.flicker, STATUS_FLICKER_DEADBAND);
+        if (pqChanged) statusVersions.bump(STATUS_POWER_QUALITY);
+#endif
+#if ENABLE_PHASE_ANGLES
+        if (publishValue(phase.angle, supply.angle[i], STATUS_ANGLE_DEADBAND)) {
+            statusVersions.bump(STATUS_ANGLE);
+        }
+#endif
+        if (phase.isActive != phases[i].isActive) {
+            phase.isActive = phases[i].isActive;
+            statusVersions.bump(STATUS_IS_ACTIVE);
+        }
+    }
 }
 
+// GET /api/status[?fields=voltage,selectedPhase]. The ETag covers only the
+// requested fields; a matching If-None-Match gets 304 with no body.
 void handleGetStatus() {
-    DynamicJsonDocument doc(1024);
+    uint32_t fields = STATUS_ALL_FIELDS;
+    if (server.hasArg("fields")) {
+        fields = parseStatusFields(server.arg("fields").c_str());
+        if (fields == 0) {
+            sendResult(400, false, "Unknown field");
+            return;
+        }
+    }
     
-    doc["mode"] = (systemMode == MODE_AUTOMATIC) ? "automatic" : "manual";
-    doc["bestPhase"] = findBestPhase();
-    doc["selectedPhase"] = selectedPhase;
+    char etag[40];
+    {
+        StateLock lock;
+        publishStatus();
+        snprintf(etag, sizeof(etag), "\"%u-%lx-%lu\"", bootCount,
+                 (unsigned long)fields, (unsigned long)statusVersions.version(fields));
+    }
+    server.sendHeader("ETag", etag);
+    server.sendHeader("Cache-Control", "no-cache");  // Browsers revalidate instead of reusing blindly
     
-    JsonArray phasesArray = doc.createNestedArray("phases");
-    for (int i = 0; i < 3; i++) {
-        JsonObject phaseObj = phasesArray.createNestedObject();
-        phaseObj["name"] = phases[i].name;
-        phaseObj["voltage"] = phases[i].voltage;
-        phaseObj["avgVoltage"] = phases[i].avgVoltage;
-        phaseObj["minVoltage"] = phases[i].minVoltage;
-        phaseObj["maxVoltage"] = phases[i].maxVoltage;
-        phaseObj["isActive"] = phases[i].isActive;
+    const String& ifNoneMatch = server.header("If-None-Match");
+    if (ifNoneMatch.length() > 0 && strstr(ifNoneMatch.c_str(), etag) != NULL) {
+        statusNotModified++;
+        server.send(304);
+        return;
     }
     
-    String response;
-    serializeJson(doc, response);
-    server.send(200, "application/json", response);
+    // `published` only changes in publishStatus(), which handlers alone call
+    JsonDocument& doc = responseDoc();
+    buildStatusDocument(doc, published, deviceId, fields);
+    sendJson(200, doc);
 }
 
 void handleSetPhase() {
     if (server.hasArg("plain")) {
-        DynamicJsonDocument doc(256);
-        deserializeJson(doc, server.arg("plain"));
+        StaticJsonDocument<256> request;
+        deserializeJson(request, server.arg("plain"));
         
-        if (doc.containsKey("phase")) {
-            int phase = doc["phase"];
-            if (phase >= 0 && phase < 3) {
-                systemMode = MODE_MANUAL;
-                switchToPhase(phase, true);
+        if (request.containsKey("phase")) {
+            int phase = request["phase"];
+            if (phase >= 0 && phase < NUM_PHASES) {
+                Command command;
+                if (!submitCommand(COMMAND_SET_PHASE, phase, request, true, command)) return;
+                if (command.state == COMMAND_PENDING) {
+                    sendCommand(command);
+                    return;
+                }
                 
-                DynamicJsonDocument response(256);
-                response["success"] = true;
-                response["message"] = "Switched to " + phases[phase].name;
-                
-                String responseStr;
-                serializeJson(response, responseStr);
-                server.send(200, "application/json", responseStr);
+                char message[64];
+                if (command.state == COMMAND_DONE) {
+                    snprintf(message, sizeof(message), "Switched to %s", PHASE_TABLE[phase].name);
+                } else {
+                    snprintf(message, sizeof(message), "Switch to %s %s: %s", PHASE_TABLE[phase].name,
+                             commandStateName(command.state), command.reason ? command.reason : "");
+                }
+                sendCommandResult(command.state == COMMAND_DONE ? 200 : 409,
+                                  command.state == COMMAND_DONE, message);
                 return;
             }
         }
     }
     
-    DynamicJsonDocument response(256);
-    response["success"] = false;
-    response["message"] = "Invalid phase number";
-    
-    String responseStr;
-    serializeJson(response, responseStr);
-    server.send(400, "application/json", responseStr);
+    sendResult(400, false, "Invalid phase number");
 }
 
 void handleSetMode() {
     if (server.hasArg("plain")) {
-        DynamicJsonDocument doc(256);
-        deserializeJson(doc, server.arg("plain"));
+        StaticJsonDocument<256> request;
+        deserializeJson(request, server.arg("plain"));
         
-        if (doc.containsKey("mode")) {
-            String mode = doc["mode"];
-            if (mode == "auto" || mode == "automatic") {
-                systemMode = MODE_AUTOMATIC;
-            } else if (mode == "manual") {
-                systemMode = MODE_MANUAL;
+        if (request.containsKey("mode")) {
+            const char* mode = request["mode"] | "";
+            Command command = {};
+            if (strcmp(mode, "auto") == 0 || strcmp(mode, "automatic") == 0) {
+                if (!submitCommand(COMMAND_SET_MODE, MODE_AUTOMATIC, request, true, command)) return;
+            } else if (strcmp(mode, "manual") == 0) {
+                if (!submitCommand(COMMAND_SET_MODE, MODE_MANUAL, request, true, command)) return;
             }
             
-            DynamicJsonDocument response(256);
-            response["success"] = true;
-            response["message"] = "Mode set to " + String((systemMode == MODE_AUTOMATIC) ? "automatic" : "manual");
-            
-            String responseStr;
-            serializeJson(response, responseStr);
-            server.send(200, "application/json", responseStr);
+            if (command.id != 0 && command.state == COMMAND_PENDING) {
+                sendCommand(command);
+                return;
+            }
+            SystemMode current;
+            {
+                StateLock lock;
+                current = systemMode;
+            }
+            sendCommandResult(200, true, (current == MODE_AUTOMATIC) ? "Mode set to automatic" : "Mode set to manual");
             return;
         }
     }
     
-    DynamicJsonDocument response(256);
-    response["success"] = false;
-    response["message"] = "Invalid mode";
-    
-    String responseStr;
-    serializeJson(response, responseStr);
-    server.send(400, "application/json", responseStr);
+    sendResult(400, false, "Invalid mode");
+}
+
+void formatIP(char* buffer, size_t size, const IPAddress& ip) {
+    snprintf(buffer, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
 }
 
 void handleGetNetwork() {
-    DynamicJsonDocument doc(512);
+    JsonDocument& doc = responseDoc();
+    char apIP[16];
+    char staIP[16];
     
-    IPAddress apIP = WiFi.softAPIP();
-    doc["ap_ssid"] = ap_ssid;
-    doc["ap_ip"] = apIP.toString();
-    doc["ap_connected"] = true;
+    formatIP(apIP, sizeof(apIP), WiFi.softAPIP());
+    bool staConnected = WiFi.status() == WL_CONNECTED;
+    if (staConnected) formatIP(staIP, sizeof(staIP), WiFi.localIP());
+    buildNetworkDocument(doc, deviceId, FIRMWARE_VERSION, ap_ssid, apIP, ssid, staConnected ? staIP : NULL);
     
-    if (WiFi.status() == WL_CONNECTED) {
-        doc["sta_connected"] = true;
-        doc["sta_ip"] = WiFi.localIP().toString();
-        doc["sta_ssid"] = ssid;
-    } else {
-        doc["sta_connected"] = false;
-        doc["sta_ip"] = "";
-        doc["sta_ssid"] = "";
+    sendJson(200, doc);
+}
+
+void handleGetEvents() {
+    uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(), NULL, 10) : 0;
+    int limit = server.hasArg("limit") ? server.arg("limit").toInt() : EVENTS_PAGE_SIZE;
+    if (limit < 1 || limit > EVENTS_PAGE_SIZE) limit = EVENTS_PAGE_SIZE;
+    
+    JsonDocument& doc = responseDoc();
+    {
+        StateLock lock;
+        buildEventsPage(doc, journal, bootCount, millis(), since, limit);
     }
+    sendJson(200, doc);
+}
+
+// GET /api/history?since=<seq>&limit=<n>. `uptime` lets clients turn `time`
+// into wall-clock time; when `boot` changes, sequence numbers have restarted.
+void handleGetHistory() {
+    uint32_t since = server.hasArg("since") ? strtoul(server.arg("since").c_str(), NULL, 10) : 0;
+    int limit = server.hasArg("limit") ? server.arg("limit").toInt() : HISTORY_PAGE_SIZE;
+    if (limit < 1 || limit > HISTORY_PAGE_SIZE) limit = HISTORY_PAGE_SIZE;
+    
+    JsonDocument& doc = responseDoc();
+    {
+        StateLock lock;
+        buildHistoryPage(doc, readingHistory, bootCount, millis(), TREND_UPDATE_INTERVAL, since, limit);
+    }
+    sendJson(200, doc);
+}
+
+// Streams Prometheus text through a small buffer instead of building the
+// whole document in memory
+struct MetricsWriter {
+    char buffer[768];
+    size_t length;
+    
+    MetricsWriter() : length(0) {}
+    
+    __attribute__((format(printf, 2, 3))) void printf(const char* format, ...) {
+        char line[160];
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (written <= 0) return;
+        size_t lineLength = min((size_t)written, sizeof(line) - 1);
+        
+        if (length + lineLength > sizeof(buffer)) flush();
+        memcpy(buffer + length, line, lineLength);
+        length += lineLength;
+    }
+    
+    void flush() {
+        if (length > 0) server.sendContent(buffer, length);
+        length = 0;
+    }
+    
+    void header(const char* name, const char* type, const char* help) {
+        printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+    
+    void histogram(const char* name, const char* label, const char* value, const PerfStat& stat) {
+        uint32_t cumulative = 0;
+        for (int i = 0; i < PERF_BUCKET_COUNT - 1; i++) {
+            cumulative += stat.buckets[i];
+            printf("%s_bucket{%s=\"%s\",le=\"%.6f\"} %u\n", name, label, value,
+                   PERF_BUCKET_BOUNDS_US[i] / 1000000.0, (unsigned)cumulative);
+        }
+        printf("%s_bucket{%s=\"%s\",le=\"+Inf\"} %u\n", name, label, value, (unsigned)stat.count);
+        printf("%s_sum{%s=\"%s\"} %.6f\n", name, label, value, stat.totalUs / 1000000.0);
+        printf("%s_count{%s=\"%s\"} %u\n", name, label, value, (unsigned)stat.count);
+    }
+    
+    void seconds(const char* name, const char* label, const char* value, uint32_t us) {
+        printf("%s{%s=\"%s\"} %.6f\n", name, label, value, us / 1000000.0);
+    }
+};
+
+// Counters are read without the state lock: the page streams to the client,
+// and a value one update stale does no harm
+void handleGetMetrics() {
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "text/plain; version=0.0.4", "");
+    MetricsWriter out;
+    
+    out.header("bpd_uptime_seconds", "counter", "Time since boot");
+    out.printf("bpd_uptime_seconds %lu\n", millis() / 1000);
+    
+    out.header("bpd_section_duration_seconds", "histogram", "Duration of instrumented firmware paths");
+    for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+        out.histogram("bpd_section_duration_seconds", "section", PERF_SECTION_NAMES[i], perfStats[i]);
+    }
+    out.header("bpd_section_duration_min_seconds", "gauge", "Fastest observed duration per path");
+    for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+        const PerfStat& stat = perfStats[i];
+        out.seconds("bpd_section_duration_min_seconds", "section", PERF_SECTION_NAMES[i],
+                    stat.count > 0 ? stat.minUs : 0);
+    }
+    out.header("bpd_section_duration_max_seconds", "gauge", "Slowest observed duration per path");
+    for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+        out.seconds("bpd_section_duration_max_seconds", "section", PERF_SECTION_NAMES[i], perfStats[i].maxUs);
+    }
+    
+    out.header("bpd_job_duration_seconds", "histogram", "Runtime per scheduler job");
+    for (int i = 0; i < JOB_COUNT; i++) {
+        out.histogram("bpd_job_duration_seconds", "job", JOBS[i]->name, JOBS[i]->runtime);
+    }
+    out.header("bpd_job_lateness_seconds", "histogram", "Start delay past the due time per scheduler job");
+    for (int i = 0; i < JOB_COUNT; i++) {
+        out.histogram("bpd_job_lateness_seconds", "job", JOBS[i]->name, JOBS[i]->lateness);
+    }
+    out.header("bpd_job_missed_deadlines_total", "counter", "Runs that started later than the job's deadline");
+    for (int i = 0; i < JOB_COUNT; i++) {
+        out.printf("bpd_job_missed_deadlines_total{job=\"%s\"} %u\n", JOBS[i]->name, (unsigned)JOBS[i]->missedDeadlines);
+    }
+    out.header("bpd_job_skipped_runs_total", "counter", "Periods skipped after a job fell a full period behind");
+    for (int i = 0; i < JOB_COUNT; i++) {
+        out.printf("bpd_job_skipped_runs_total{job=\"%s\"} %u\n", JOBS[i]->name, (unsigned)JOBS[i]->skippedRuns);
+    }
+    
+    out.header("bpd_http_request_duration_seconds", "histogram", "HTTP handler latency per route");
+    for (int i = 0; i < ROUTE_COUNT; i++) {
+        out.histogram("bpd_http_request_duration_seconds", "route", HTTP_ROUTE_NAMES[i], httpStats[i]);
+    }
+    out.header("bpd_http_requests_total", "counter", "HTTP requests handled per route");
+    for (int i = 0; i < ROUTE_COUNT; i++) {
+        out.printf("bpd_http_requests_total{route=\"%s\"} %u\n", HTTP_ROUTE_NAMES[i], (unsigned)httpStats[i].count);
+    }
+    out.header("bpd_http_shed_total", "counter", "Requests refused with 429 by admission control");
+    out.printf("bpd_http_shed_total{reason=\"rate\"} %u\n", (unsigned)httpShed[SHED_RATE]);
+    out.printf("bpd_http_shed_total{reason=\"clients\"} %u\n", (unsigned)httpShed[SHED_CLIENTS]);
+    out.header("bpd_http_active_clients", "gauge", "Clients holding a rate-limit slot");
+    out.printf("bpd_http_active_clients %d\n", clientLimiter.activeClients(millis()));
+    out.header("bpd_network_deferred_total", "counter", "loop() passes that skipped the web server to stay within its CPU budget");
+    out.printf("bpd_network_deferred_total %u\n", (unsigned)networkDeferred);
+    out.header("bpd_status_not_modified_total", "counter", "Status polls answered with 304 Not Modified");
+    out.printf("bpd_status_not_modified_total %u\n", (unsigned)statusNotModified);
+    out.header("bpd_http_response_overflow_total", "counter", "JSON responses too large for the buffer, sent as 500");
+    out.printf("bpd_http_response_overflow_total %u\n", (unsigned)responseOverflows);
+    
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    out.header("bpd_heap_free_bytes", "gauge", "Free heap");
+    out.printf("bpd_heap_free_bytes %u\n", (unsigned)freeHeap);
+    out.header("bpd_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    out.printf("bpd_heap_min_free_bytes %u\n", (unsigned)ESP.getMinFreeHeap());
+    out.header("bpd_heap_largest_free_block_bytes", "gauge", "Largest allocatable block");
+    out.printf("bpd_heap_largest_free_block_bytes %u\n", (unsigned)largestBlock);
+    out.header("bpd_heap_fragmentation_ratio", "gauge", "1 - largest free block / free heap");
+    out.printf("bpd_heap_fragmentation_ratio %.4f\n", freeHeap > 0 ? 1.0 - (double)largestBlock / freeHeap : 0.0);
+    
+    // Trend over the sampled window (up to one hour), in bytes per hour
+    if (heapHistoryCount >= 2) {
+        int newest = (heapHistoryIndex + HEAP_HISTORY_SIZE - 1) % HEAP_HISTORY_SIZE;
+        int oldest = (heapHistoryIndex + HEAP_HISTORY_SIZE - heapHistoryCount) % HEAP_HISTORY_SIZE;
+        double hours = (heapHistoryCount - 1) * (HEAP_SAMPLE_INTERVAL / 3600000.0);
+        out.header("bpd_heap_free_trend_bytes_per_hour", "gauge", "Change of free heap over the last hour");
+        out.printf("bpd_heap_free_trend_bytes_per_hour %.1f\n",
+                   ((double)heapFreeHistory[newest] - heapFreeHistory[oldest]) / hours);
+        out.header("bpd_heap_largest_block_trend_bytes_per_hour", "gauge", "Change of largest free block over the last hour");
+        out.printf("bpd_heap_largest_block_trend_bytes_per_hour %.1f\n",
+                   ((double)heapLargestHistory[newest] - heapLargestHistory[oldest]) / hours);
+    }
+    
+    out.header("bpd_task_stack_free_bytes", "gauge", "Stack high-water mark (never used) per task");
+    out.printf("bpd_task_stack_free_bytes{task=\"loop\"} %u\n", (unsigned)uxTaskGetStackHighWaterMark(loopTaskHandle));
+    out.printf("bpd_task_stack_free_bytes{task=\"control\"} %u\n", (unsigned)uxTaskGetStackHighWaterMark(controlTaskHandle));
+#if ENABLE_POWER_QUALITY
+    if (pqTaskHandle != NULL) {
+        out.printf("bpd_task_stack_free_bytes{task=\"powerQuality\"} %u\n", (unsigned)uxTaskGetStackHighWaterMark(pqTaskHandle));
+    }
+#endif
+    
+    out.header("bpd_voltage_outliers_total", "counter", "Voltage readings rejected by the outlier filter");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        out.printf("bpd_voltage_outliers_total{phase=\"%s\"} %u\n", phases[i].name, (unsigned)voltageFilter[i].rejected());
+    }
+    
+    out.header("bpd_transfer_gap_seconds", "histogram", "Dead time seen by the load per phase transfer");
+    out.histogram("bpd_transfer_gap_seconds", "source", "planned", transferGapPlanned);
+    out.histogram("bpd_transfer_gap_seconds", "source", "measured", transferGapMeasured);
+    out.header("bpd_transfer_unsynced_total", "counter", "Transfers where a phase had no usable zero crossing");
+    out.printf("bpd_transfer_unsynced_total %u\n", (unsigned)unsyncedTransfers);
+    out.header("bpd_relay_operate_seconds", "gauge", "Expected relay operate time, aims the close at a zero crossing");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        out.printf("bpd_relay_operate_seconds{phase=\"%s\"} %.6f\n", phases[i].name, relayTiming[i].operateUs / 1000000.0);
+    }
+    out.header("bpd_relay_release_seconds", "gauge", "Expected relay release time, aims the open at a zero crossing");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        out.printf("bpd_relay_release_seconds{phase=\"%s\"} %.6f\n", phases[i].name, relayTiming[i].releaseUs / 1000000.0);
+    }
+    out.header("bpd_relay_operate_min_seconds", "gauge", "Fastest relay close the transfer plan allows for");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        out.printf("bpd_relay_operate_min_seconds{phase=\"%s\"} %.6f\n", phases[i].name, relayTiming[i].minOperateUs / 1000000.0);
+    }
+    out.header("bpd_relay_release_max_seconds", "gauge", "Slowest relay open the transfer plan allows for");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        out.printf("bpd_relay_release_max_seconds{phase=\"%s\"} %.6f\n", phases[i].name, relayTiming[i].maxReleaseUs / 1000000.0);
+    }
+    
+#if ENABLE_PHASE_ANGLES
+    out.header("bpd_phase_cycles_total", "counter", "Synchronised cycles captured for phase angles");
+    out.printf("bpd_phase_cycles_total %u\n", (unsigned)phaseRelations.cycles());
+    out.header("bpd_phase_incomplete_cycles_total", "counter", "Cycles not used because a phase was too weak");
+    out.printf("bpd_phase_incomplete_cycles_total %u\n", (unsigned)phaseRelations.incompleteCycles());
+    if (phaseRelations.valid()) {
+        out.header("bpd_phase_angle_degrees", "gauge", "Phase angle relative to the first phase");
+        for (int i = 0; i < NUM_PHASES; i++) {
+            out.printf("bpd_phase_angle_degrees{phase=\"%s\"} %.2f\n", phases[i].name, supply.angle[i]);
+        }
+        out.header("bpd_phase_displacement_degrees", "gauge", "Deviation from the ideal 120-degree position");
+        for (int i = 0; i < NUM_PHASES; i++) {
+            out.printf("bpd_phase_displacement_degrees{phase=\"%s\"} %.2f\n", phases[i].name, supply.displacement[i]);
+        }
+        out.header("bpd_phase_sequence", "gauge", "1 for 1-2-3, -1 for 1-3-2, 0 if unclear");
+        out.printf("bpd_phase_sequence %d\n", supply.sequence);
+        out.header("bpd_voltage_unbalance_ratio", "gauge", "Negative- over positive-sequence voltage");
+        out.printf("bpd_voltage_unbalance_ratio %.5f\n", supply.unbalance / 100.0);
+    }
+#endif
+    
+#if ENABLE_ADAPTIVE_SAMPLING
+    out.header("bpd_sampling_interval_seconds", "gauge", "Current interval between voltage reads");
+    out.printf("bpd_sampling_interval_seconds %.3f\n", adaptiveSampling.interval() / 1000.0);
+    out.header("bpd_sampling_trips_total", "counter", "Readings that held or returned sampling to full rate, per cause");
+    for (int i = TRIP_DEVIATION; i < TRIP_CAUSE_COUNT; i++) {
+        out.printf("bpd_sampling_trips_total{cause=\"%s\"} %u\n", samplingTripName(i),
+                   (unsigned)adaptiveSampling.trips((SamplingTrip)i));
+    }
+    
+#endif
+    out.header("bpd_power_active_seconds_total", "counter", "Time the control task spent working");
+    out.printf("bpd_power_active_seconds_total %.3f\n", activeTimeUs / 1000000.0);
+    out.header("bpd_power_idle_seconds_total", "counter", "Time the control task spent idle between jobs");
+    out.printf("bpd_power_idle_seconds_total %.3f\n", idleTimeUs / 1000000.0);
+    out.header("bpd_power_duty_cycle", "gauge", "Fraction of the last 10 s window spent working");
+    out.printf("bpd_power_duty_cycle %.4f\n", dutyCycle);
+    out.header("bpd_power_estimated_current_milliamps", "gauge", "Estimated supply current from the duty cycle");
+    out.printf("bpd_power_estimated_current_milliamps %.1f\n",
+               dutyCycle * ACTIVE_CURRENT_MA + (1.0f - dutyCycle) * IDLE_CURRENT_MA);
+    out.header("bpd_power_management_enabled", "gauge", "1 when DFS and automatic light sleep are configured");
+    out.printf("bpd_power_management_enabled %d\n", powerManagementActive ? 1 : 0);
+    
+    out.header("bpd_journal_next_seq", "counter", "Sequence number of the next journal event");
+    out.printf("bpd_journal_next_seq %u\n", (unsigned)journal.nextSeq());
     
-    String response;
-    serializeJson(doc, response);
-    server.send(200, "application/json", response);
+    out.flush();
+    server.sendContent("");  // Terminating chunk
 }
 
 void handleNotFound() {
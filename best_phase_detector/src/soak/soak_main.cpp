@@ -0,0 +1,237 @@
+// Heap soak firmware (pio run -e soak -t upload -t monitor).
+// Answers months of simulated API traffic with the application's response
+// builders (status_document.h, api_documents.h) and the shared JSON
+// document and buffer, as fast as the CPU allows, and tracks the heap:
+//
+//   every simulated second  CLIENTS polls of /api/status, one in four of
+//                           them with ?fields=selectedPhase
+//   every 5 s               a history reading (trend update)
+//   every minute            a /api/history sync per client
+//   every 10 minutes        an event, a command with its result, and a
+//                           /api/events sync per client
+//   every hour              /api/network
+//
+// One line per simulated day: requests, allocated heap blocks, free heap,
+// its low-water mark, the largest free block and the fragmentation ratio.
+// Wi-Fi stays off, so nothing else allocates while it runs. The verdict at
+// the end of SOAK_DAYS fails if the request path left allocated blocks
+// behind, or if the free heap or the largest free block shrank.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_heap_caps.h>
+#include "api_documents.h"
+#include "event_journal.h"
+#include "phase_config.h"
+#include "sequence_ring.h"
+#include "status_document.h"
+#include "status_fields.h"
+
+#ifndef SOAK_DAYS
+#define SOAK_DAYS 90
+#endif
+
+const int CLIENTS = 4;
+const uint32_t SECONDS_PER_DAY = 86400;
+
+StaticJsonDocument<JSON_DOCUMENT_CAPACITY> jsonDoc;
+char jsonBuffer[JSON_BUFFER_SIZE];
+
+EventJournal<64, NUM_PHASES> journal;
+SequenceRing<HistoryReading, 240> readingHistory;
+PublishedStatus status;
+Command command;
+
+uint32_t requests = 0;
+uint32_t overflows = 0;
+
+// Results land here so the compiler cannot drop the serialisation
+volatile size_t sinkLength;
+
+JsonDocument& responseDoc() {
+    jsonDoc.clear();
+    return jsonDoc;
+}
+
+void serialize(JsonDocument& doc) {
+    size_t length = serializeJson(doc, jsonBuffer, sizeof(jsonBuffer));
+    if (doc.overflowed() || length >= sizeof(jsonBuffer) - 1) overflows++;
+    sinkLength = length;
+    requests++;
+}
+
+void pollStatus(uint32_t second, int client) {
+    uint32_t fields = (second + client) % 4 == 0 ? statusFieldBit(STATUS_SELECTED_PHASE) : STATUS_ALL_FIELDS;
+    JsonDocument& doc = responseDoc();
+    buildStatusDocument(doc, status, "bpd-a1b2c3", fields);
+    serialize(doc);
+}
+
+void appendReading(uint32_t second) {
+    HistoryReading reading;
+    reading.timestamp = second * 1000;
+    reading.selectedPhase = status.selectedPhase;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        reading.voltage[i] = (int16_t)(2280 + i * 10 + second % 17);
+    }
+    readingHistory.append(reading);
+}
+
+void syncHistory(uint32_t second, int client) {
+    // Clients are a minute behind, so each sync returns about twelve rows
+    uint32_t next = readingHistory.nextSeq();
+    uint32_t since = next > 12 + (uint32_t)client ? next - 12 - client : 0;
+    JsonDocument& doc = responseDoc();
+    buildHistoryPage(doc, readingHistory, 1, second * 1000, 5000, since, HISTORY_PAGE_SIZE);
+    serialize(doc);
+}
+
+void switchPhase(uint32_t second) {
+    int from = status.selectedPhase;
+    int to = (from + 1) % NUM_PHASES;
+
+    JournalEvent<NUM_PHASES> event;
+    event.timestamp = second * 1000;
+    event.bootCount = 1;
+    event.cause = EVENT_SWITCH_AUTO;
+    event.detail = 15;
+    event.fromPhase = from;
+    event.toPhase = to;
+    for (int i = 0; i < NUM_PHASES; i++) event.voltage[i] = (int16_t)(2280 + i * 10);
+    journal.append(event);
+
+    status.selectedPhase = to;
+    for (int i = 0; i < NUM_PHASES; i++) status.phases[i].isActive = i == to;
+
+    // handleSetPhase(): the message is formatted into a stack buffer
+    char message[64];
+    snprintf(message, sizeof(message), "Switched to %s", PHASE_TABLE[to].name);
+    JsonDocument& doc = responseDoc();
+    buildCommandResult(doc, true, message, status.mode, status.selectedPhase, status.phases);
+    serialize(doc);
+
+    command.id++;
+    command.type = COMMAND_SET_PHASE;
+    command.argument = to;
+    command.state = COMMAND_DONE;
+    snprintf(command.key, sizeof(command.key), "soak-%lu", (unsigned long)command.id);
+    JsonDocument& commandDoc = responseDoc();
+    buildCommandDocument(commandDoc, command, status.mode, status.selectedPhase);
+    serialize(commandDoc);
+}
+
+void syncEvents(uint32_t second, int client) {
+    uint32_t next = journal.nextSeq();
+    uint32_t since = next > 2 + (uint32_t)client ? next - 2 - client : 0;
+    JsonDocument& doc = responseDoc();
+    buildEventsPage(doc, journal, 1, second * 1000, since, EVENTS_PAGE_SIZE);
+    serialize(doc);
+}
+
+void getNetwork() {
+    JsonDocument& doc = responseDoc();
+    buildNetworkDocument(doc, "bpd-a1b2c3", "1.1.0", "BestPhaseDetector", "192.168.4.1", "", NULL);
+    serialize(doc);
+}
+
+void simulateSecond(uint32_t second) {
+    // Voltages wander so the document content changes like a real grid's
+    for (int i = 0; i < NUM_PHASES; i++) {
+        PhaseStatus& phase = status.phases[i];
+        phase.voltage = 228.0f + i + (second % 23) * 0.1f;
+        phase.avgVoltage = phase.voltage - 0.3f;
+        phase.forecastVoltage = phase.voltage + 0.4f;
+        phase.trend = ((int)(second % 11) - 5) * 0.2f;
+    }
+
+    for (int client = 0; client < CLIENTS; client++) pollStatus(second, client);
+    if (second % 5 == 0) appendReading(second);
+    if (second % 60 == 0) {
+        for (int client = 0; client < CLIENTS; client++) syncHistory(second, client);
+    }
+    if (second % 600 == 0) {
+        switchPhase(second);
+        for (int client = 0; client < CLIENTS; client++) syncEvents(second, client);
+    }
+    if (second % 3600 == 0) getNetwork();
+}
+
+struct HeapSnapshot {
+    size_t allocatedBlocks;
+    size_t freeBytes;
+    size_t minimumFree;
+    size_t largestBlock;
+};
+
+HeapSnapshot snapshotHeap() {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+    HeapSnapshot snapshot = {info.allocated_blocks, info.total_free_bytes, info.minimum_free_bytes,
+                             info.largest_free_block};
+    return snapshot;
+}
+
+void printSnapshot(int day, const HeapSnapshot& heap) {
+    float fragmentation = heap.freeBytes > 0 ? 1.0f - (float)heap.largestBlock / heap.freeBytes : 0.0f;
+    Serial.printf("%4d %10lu %8u %9u %9u %9u %6.3f\n", day, (unsigned long)requests,
+                  (unsigned)heap.allocatedBlocks, (unsigned)heap.freeBytes, (unsigned)heap.minimumFree,
+                  (unsigned)heap.largestBlock, fragmentation);
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    status.mode = MODE_AUTOMATIC;
+    status.selectedPhase = 0;
+    status.bestPhase = 0;
+    status.supplyValid = NUM_PHASES == 3;
+    status.sequence = SEQUENCE_POSITIVE;
+    status.unbalance = 0.8f;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        PhaseStatus& phase = status.phases[i];
+        phase.minVoltage = 221.2f + i;
+        phase.maxVoltage = 233.7f + i;
+        phase.pq.frequency = 50.02f;
+        phase.pq.thd = 3.1f;
+        phase.pq.crestFactor = 1.41f;
+        phase.pq.flicker = 0.2f;
+        phase.pq.valid = true;
+        phase.angle = i * -120.0f;
+        phase.isActive = i == 0;
+    }
+
+    Serial.printf("\nBest Phase Detector heap soak: %d simulated days, %d clients\n", SOAK_DAYS, CLIENTS);
+    Serial.printf("%4s %10s %8s %9s %9s %9s %6s\n", "day", "requests", "blocks", "free", "min free",
+                  "largest", "frag");
+
+    // One simulated hour first, so every ring and static buffer has been
+    // touched before the baseline is taken
+    for (uint32_t second = 1; second <= 3600; second++) simulateSecond(second);
+    HeapSnapshot baseline = snapshotHeap();
+    printSnapshot(0, baseline);
+
+    HeapSnapshot heap = baseline;
+    unsigned long started = millis();
+    for (int day = 1; day <= SOAK_DAYS; day++) {
+        for (uint32_t second = 0; second < SECONDS_PER_DAY; second++) {
+            simulateSecond(3600 + (day - 1) * SECONDS_PER_DAY + second);
+            if (second % 1000 == 0) delay(1);  // Let the idle task feed the watchdog
+        }
+        heap = snapshotHeap();
+        printSnapshot(day, heap);
+    }
+
+    bool leaked = heap.allocatedBlocks != baseline.allocatedBlocks || heap.freeBytes < baseline.freeBytes;
+    bool fragmented = heap.largestBlock < baseline.largestBlock;
+    Serial.printf("%lu requests in %lu s, %lu too large for the buffer\n", (unsigned long)requests,
+                  (millis() - started) / 1000, (unsigned long)overflows);
+    Serial.printf("soak: %s\n", leaked ? "FAIL (heap leaked)"
+                               : fragmented ? "FAIL (largest free block shrank)"
+                               : overflows ? "FAIL (responses overflowed)"
+                               : "PASS");
+}
+
+void loop() {
+    delay(1000);
+}
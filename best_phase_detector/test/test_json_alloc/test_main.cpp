@@ -0,0 +1,244 @@
+// Every JSON API response, built by the same code as the firmware handlers
+// (status_document.h, api_documents.h) into a document and buffer of the
+// firmware's sizes, must be answered without a heap allocation: malloc()
+// calls, ArduinoJson's included, and operator new are counted around each
+// build and serialisation. The largest pages must also fit, since
+// sendJson() answers an overflowed document with 500.
+//
+//   pio test -e native
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <new>
+#include "api_documents.h"
+#include "event_journal.h"
+#include "sequence_ring.h"
+#include "status_document.h"
+#include "status_fields.h"
+
+// --- Allocation counting (-Wl,--wrap=malloc,calloc,realloc in platformio.ini)
+
+static long allocations = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    allocations++;
+    return __real_realloc(pointer, size);
+}
+}
+
+void* operator new(size_t size) {
+    allocations++;
+    void* pointer = __real_malloc(size ? size : 1);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+// --- Firmware-sized document and buffer, and a device with full history
+
+static StaticJsonDocument<JSON_DOCUMENT_CAPACITY> jsonDoc;
+static char jsonBuffer[JSON_BUFFER_SIZE];
+
+static EventJournal<64, NUM_PHASES> journal;
+static SequenceRing<HistoryReading, 240> readingHistory;
+static PublishedStatus status;
+
+// Requests answered per case, so a one-off allocation on the first request
+// shows as well as a per-request one
+const int REQUESTS = 100;
+
+JsonDocument& responseDoc() {
+    jsonDoc.clear();
+    return jsonDoc;
+}
+
+// Serialises like sendJson() and checks the response was sent whole
+size_t serialize(JsonDocument& doc) {
+    size_t length = serializeJson(doc, jsonBuffer, sizeof(jsonBuffer));
+    TEST_ASSERT_FALSE_MESSAGE(doc.overflowed(), "document overflowed JSON_DOCUMENT_CAPACITY");
+    TEST_ASSERT_TRUE_MESSAGE(length < sizeof(jsonBuffer) - 1, "response did not fit JSON_BUFFER_SIZE");
+    return length;
+}
+
+template <typename Request>
+long allocationsFor(Request request) {
+    long before = allocations;
+    for (int i = 0; i < REQUESTS; i++) request(i);
+    return allocations - before;
+}
+
+void setUp() {
+    status = PublishedStatus();
+    status.mode = MODE_AUTOMATIC;
+    status.selectedPhase = 0;
+    status.bestPhase = 0;
+    status.supplyValid = true;
+    status.sequence = SEQUENCE_NEGATIVE;
+    status.unbalance = 12.345f;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        PhaseStatus& phase = status.phases[i];
+        // Long decimals, so the numbers serialise at their widest
+        phase.voltage = 228.123f + i;
+        phase.avgVoltage = 227.987f + i;
+        phase.minVoltage = 221.234f + i;
+        phase.maxVoltage = 233.789f + i;
+        phase.forecastVoltage = 226.543f + i;
+        phase.trend = -10.123f;
+        phase.pq.frequency = 50.0234f;
+        phase.pq.thd = 13.123f;
+        phase.pq.crestFactor = 1.4142f;
+        phase.pq.flicker = 0.2345f;
+        phase.pq.valid = true;
+        phase.angle = -119.987f * i;
+        phase.isActive = i == 0;
+    }
+
+    for (uint32_t i = 0; i < 300; i++) {
+        JournalEvent<NUM_PHASES> event;
+        event.timestamp = 4000000000u - i;
+        event.bootCount = 65535;
+        event.cause = EVENT_BLOCKED_HIGH_VOLTAGE;
+        event.detail = 255;
+        event.fromPhase = -1;
+        event.toPhase = -1;
+        for (int p = 0; p < NUM_PHASES; p++) event.voltage[p] = -32768;
+        journal.append(event);
+
+        HistoryReading reading;
+        reading.timestamp = 4000000000u - i;
+        reading.selectedPhase = -1;
+        for (int p = 0; p < NUM_PHASES; p++) reading.voltage[p] = -32768;
+        readingHistory.append(reading);
+    }
+}
+
+void tearDown() {}
+
+void test_status_document_does_not_allocate() {
+    long count = allocationsFor([](int i) {
+        // The full document, and every single-field document
+        uint32_t fields = i % (STATUS_FIELD_COUNT + 1) == STATUS_FIELD_COUNT
+            ? STATUS_ALL_FIELDS : statusFieldBit((StatusField)(i % (STATUS_FIELD_COUNT + 1)));
+        JsonDocument& doc = responseDoc();
+        buildStatusDocument(doc, status, "bpd-a1b2c3", fields);
+        serialize(doc);
+    });
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, count, "/api/status allocated");
+}
+
+void test_results_do_not_allocate() {
+    long count = allocationsFor([](int i) {
+        // handleSetPhase() formats its message into a stack buffer
+        char message[64];
+        snprintf(message, sizeof(message), "Switch to %s %s: %s", PHASE_TABLE[i % NUM_PHASES].name,
+                 commandStateName(COMMAND_REJECTED), "Target below undervoltage threshold");
+        JsonDocument& doc = responseDoc();
+        buildCommandResult(doc, false, message, MODE_MANUAL, i % NUM_PHASES, status.phases);
+        serialize(doc);
+        TEST_ASSERT_EQUAL_INT(NUM_PHASES, doc["phases"].size());
+
+        JsonDocument& result = responseDoc();
+        buildResult(result, false, "Too many requests");
+        serialize(result);
+    });
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, count, "/api/setPhase, /api/setMode or an error result allocated");
+}
+
+void test_command_does_not_allocate() {
+    long count = allocationsFor([](int i) {
+        Command command = {};
+        command.id = 4000000000u + i;
+        command.type = COMMAND_SET_PHASE;
+        command.state = COMMAND_SUPERSEDED;
+        command.reason = "Superseded by a newer command";
+        memset(command.key, 'k', COMMAND_KEY_LENGTH - 1);
+        JsonDocument& doc = responseDoc();
+        buildCommandDocument(doc, command, MODE_AUTOMATIC, 0);
+        serialize(doc);
+    });
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, count, "/api/command allocated");
+}
+
+void test_network_does_not_allocate() {
+    long count = allocationsFor([](int i) {
+        JsonDocument& doc = responseDoc();
+        buildNetworkDocument(doc, "bpd-a1b2c3", "1.1.0", "BestPhaseDetector", "192.168.4.1",
+                             "A network name of 32 characters", i % 2 ? "255.255.255.255" : NULL);
+        serialize(doc);
+    });
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, count, "/api/network allocated");
+}
+
+void test_full_pages_do_not_allocate() {
+    long count = allocationsFor([](int i) {
+        JsonDocument& doc = responseDoc();
+        buildEventsPage(doc, journal, 65535, 4000000000u, i, EVENTS_PAGE_SIZE);
+        serialize(doc);
+        TEST_ASSERT_EQUAL_INT(EVENTS_PAGE_SIZE, doc["events"].size());
+
+        JsonDocument& history = responseDoc();
+        buildHistoryPage(history, readingHistory, 65535, 4000000000u, 5000, i, HISTORY_PAGE_SIZE);
+        serialize(history);
+        TEST_ASSERT_EQUAL_INT(HISTORY_PAGE_SIZE, history["readings"].size());
+    });
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, count, "/api/events or /api/history allocated");
+}
+
+// The counters themselves: a String-style allocation must show up
+void test_allocations_are_counted() {
+    long count = allocationsFor([](int) {
+        DynamicJsonDocument doc(64);
+        doc["message"] = "heap";
+    });
+    TEST_ASSERT_TRUE_MESSAGE(count >= REQUESTS, "malloc() calls were not counted");
+    count = allocationsFor([](int) { delete new int(1); });
+    TEST_ASSERT_EQUAL_INT_MESSAGE(REQUESTS, count, "operator new was not counted");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_allocations_are_counted);
+    RUN_TEST(test_status_document_does_not_allocate);
+    RUN_TEST(test_results_do_not_allocate);
+    RUN_TEST(test_command_does_not_allocate);
+    RUN_TEST(test_network_does_not_allocate);
+    RUN_TEST(test_full_pages_do_not_allocate);
+    return UNITY_END();
+}
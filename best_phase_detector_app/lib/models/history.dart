@@ -0,0 +1,101 @@
+/// One averaged reading from the device's /api/history.
+class VoltageReading {
+  final int seq;
+  final DateTime time;
+  final int selectedPhase;
+  final List<double> voltages;
+
+  VoltageReading({
+    required this.seq,
+    required this.time,
+    required this.selectedPhase,
+    required this.voltages,
+  });
+
+  /// Parses a device row `[seq, time, selectedPhase, voltage x10...]`.
+  /// `time` is device uptime in ms; [bootTime] converts it to wall time.
+  factory VoltageReading.fromRow(List<dynamic> row, DateTime bootTime) {
+    return VoltageReading(
+      seq: row[0],
+      time: bootTime.add(Duration(milliseconds: row[1])),
+      selectedPhase: row[2],
+      voltages: row.skip(3).map((v) => (v as num) / 10.0).toList(),
+    );
+  }
+
+  factory VoltageReading.fromJson(Map<String, dynamic> json) {
+    return VoltageReading(
+      seq: json['seq'],
+      time: DateTime.fromMillisecondsSinceEpoch(json['time']),
+      selectedPhase: json['selectedPhase'],
+      voltages: (json['voltages'] as List<dynamic>)
+          .map((v) => (v as num).toDouble())
+          .toList(),
+    );
+  }
+
+  Map<String, dynamic> toJson() => {
+        'seq': seq,
+        'time': time.millisecondsSinceEpoch,
+        'selectedPhase': selectedPhase,
+        'voltages': voltages,
+      };
+}
+
+/// A journal entry from the device's /api/events.
+class DeviceEvent {
+  final int seq;
+  final int boot;
+  final String cause;
+  final int fromPhase;
+  final int toPhase;
+  final DateTime? time; // Only known for events from the current boot
+
+  DeviceEvent({
+    required this.seq,
+    required this.boot,
+    required this.cause,
+    required this.fromPhase,
+    required this.toPhase,
+    this.time,
+  });
+
+  factory DeviceEvent.fromDevice(
+    Map<String, dynamic> json,
+    int currentBoot,
+    DateTime bootTime,
+  ) {
+    return DeviceEvent(
+      seq: json['seq'],
+      boot: json['boot'],
+      cause: json['cause'] ?? '',
+      fromPhase: json['from'] ?? -1,
+      toPhase: json['to'] ?? -1,
+      time: json['boot'] == currentBoot
+          ? bootTime.add(Duration(milliseconds: json['time']))
+          : null,
+    );
+  }
+
+  factory DeviceEvent.fromJson(Map<String, dynamic> json) {
+    return DeviceEvent(
+      seq: json['seq'],
+      boot: json['boot'],
+      cause: json['cause'],
+      fromPhase: json['fromPhase'],
+      toPhase: json['toPhase'],
+      time: json['time'] == null
+          ? null
+          : DateTime.fromMillisecondsSinceEpoch(json['time']),
+    );
+  }
+
+  Map<String, dynamic> toJson() => {
+        'seq': seq,
+        'boot': boot,
+        'cause': cause,
+        'fromPhase': fromPhase,
+        'toPhase': toPhase,
+        'time': time?.millisecondsSinceEpoch,
+      };
+}
@@ -25,15 +25,37 @@ class PhaseData {
       isActive: json['isActive'] ?? false,
     );
   }
+
+  Map<String, dynamic> toJson() => {
+        'name': name,
+        'voltage': voltage,
+        'avgVoltage': avgVoltage,
+        'minVoltage': minVoltage,
+        'maxVoltage': maxVoltage,
+        'isActive': isActive,
+      };
+
+  PhaseData copyWith({bool? isActive}) {
+    return PhaseData(
+      name: name,
+      voltage: voltage,
+      avgVoltage: avgVoltage,
+      minVoltage: minVoltage,
+      maxVoltage: maxVoltage,
+      isActive: isActive ?? this.isActive,
+    );
+  }
 }
 
 class SystemStatus {
+  final String deviceId;
   final String mode;
   final int bestPhase;
   final int selectedPhase;
   final List<PhaseData> phases;
 
   SystemStatus({
+    required this.deviceId,
     required this.mode,
     required this.bestPhase,
     required this.selectedPhase,
@@ -42,6 +64,7 @@ class SystemStatus {
 
   factory SystemStatus.fromJson(Map<String, dynamic> json) {
     return SystemStatus(
+      deviceId: json['deviceId'] ?? '',
       mode: json['mode'] ?? 'automatic',
       bestPhase: json['bestPhase'] ?? -1,
       selectedPhase: json['selectedPhase'] ?? -1,
@@ -51,5 +74,34 @@ class SystemStatus {
           [],
     );
   }
+
+  Map<String, dynamic> toJson() => {
+        'deviceId': deviceId,
+        'mode': mode,
+        'bestPhase': bestPhase,
+        'selectedPhase': selectedPhase,
+        'phases': phases.map((p) => p.toJson()).toList(),
+      };
+
+  /// Applies the mode and relay state returned by a command response.
+  /// Each phase's isActive comes from the response's `phases`; the selected
+  /// phase is not necessarily energised (no relay is while none qualifies).
+  /// Phases the response does not cover keep their current state.
+  SystemStatus withControlState(Map<String, dynamic> json) {
+    final reported = json['phases'] as List<dynamic>? ?? const [];
+    return SystemStatus(
+      deviceId: deviceId,
+      mode: json['mode'] ?? mode,
+      bestPhase: bestPhase,
+      selectedPhase: json['selectedPhase'] ?? selectedPhase,
+      phases: [
+        for (var i = 0; i < phases.length; i++)
+          i < reported.length
+              ? phases[i].copyWith(
+                  isActive: (reported[i] as Map<String, dynamic>)['isActive'])
+              : phases[i],
+      ],
+    );
+  }
 }
 
@@ -2,7 +2,9 @@ import 'package:best_phase_detector_app/models/phase_data.dart';
 import 'package:flutter/material.dart';
 import 'package:provider/provider.dart';
 
+import '../services/discovery_service.dart';
 import '../services/phase_service.dart';
+import '../widgets/voltage_sparkline.dart';
 
 class HomeScreen extends StatefulWidget {
   const HomeScreen({super.key});
@@ -15,9 +17,12 @@ class _HomeScreenState extends State<HomeScreen> {
   @override
   void initState() {
     super.initState();
-    WidgetsBinding.instance.addPostFrameCallback((_) {
+    WidgetsBinding.instance.addPostFrameCallback((_) async {
       final service = Provider.of<PhaseService>(context, listen: false);
-      if (!service.isConnected) {
+      if (service.isConnected) return;
+      await service.start();
+      // With cached data on screen, reconnecting is left to the banner
+      if (mounted && !service.isConnected && service.status == null) {
         _showConnectionDialog(context);
       }
     });
@@ -26,6 +31,24 @@ class _HomeScreenState extends State<HomeScreen> {
   void _showConnectionDialog(BuildContext context) {
     final service = Provider.of<PhaseService>(context, listen: false);
     final ipController = TextEditingController(text: service.serverIP);
+    final discovery = service.discover();
+
+    void connectWith(Future<void> Function() connect) {
+      connect().then((_) {
+        if (!context.mounted) return;
+        Navigator.pop(context);
+        if (!service.isConnected) {
+          ScaffoldMessenger.of(context).showSnackBar(
+            SnackBar(
+              content: Text(
+                service.errorMessage ?? 'Connection failed',
+              ),
+              backgroundColor: Colors.red,
+            ),
+          );
+        }
+      });
+    }
 
     showDialog(
       context: context,
@@ -34,11 +57,50 @@ class _HomeScreenState extends State<HomeScreen> {
         content: Column(
           mainAxisSize: MainAxisSize.min,
           children: [
+            FutureBuilder<List<DiscoveredDevice>>(
+              future: discovery,
+              builder: (context, snapshot) {
+                if (snapshot.connectionState != ConnectionState.done) {
+                  return const ListTile(
+                    leading: SizedBox(
+                      width: 24,
+                      height: 24,
+                      child: CircularProgressIndicator(strokeWidth: 2),
+                    ),
+                    title: Text('Searching for devices...'),
+                  );
+                }
+                final devices = snapshot.data ?? [];
+                if (devices.isEmpty) {
+                  return const ListTile(
+                    leading: Icon(Icons.search_off),
+                    title: Text('No devices found'),
+                    subtitle: Text('Enter the address below'),
+                  );
+                }
+                return Column(
+                  children: devices
+                      .map(
+                        (device) => ListTile(
+                          leading: const Icon(Icons.electrical_services),
+                          title: Text(device.id),
+                          subtitle: Text(
+                            '${device.address}  v${device.firmware}',
+                          ),
+                          onTap: () =>
+                              connectWith(() => service.connectTo(device)),
+                        ),
+                      )
+                      .toList(),
+                );
+              },
+            ),
+            const SizedBox(height: 12),
             TextField(
               controller: ipController,
               decoration: const InputDecoration(
                 labelText: 'Device IP Address',
-                hintText: '192.168.1.100',
+                hintText: '192.168.4.1',
                 border: OutlineInputBorder(),
               ),
               keyboardType: TextInputType.number,
@@ -53,19 +115,7 @@ class _HomeScreenState extends State<HomeScreen> {
           ElevatedButton(
             onPressed: () {
               service.setServerIP(ipController.text);
-              service.connect().then((_) {
-                Navigator.pop(context);
-                if (!service.isConnected) {
-                  ScaffoldMessenger.of(context).showSnackBar(
-                    SnackBar(
-                      content: Text(
-                        service.errorMessage ?? 'Connection failed',
-                      ),
-                      backgroundColor: Colors.red,
-                    ),
-                  );
-                }
-              });
+              connectWith(service.connect);
             },
             child: const Text('Connect'),
           ),
@@ -101,7 +151,7 @@ class _HomeScreenState extends State<HomeScreen> {
             return const Center(child: CircularProgressIndicator());
           }
 
-          if (!service.isConnected) {
+          if (!service.isConnected && service.status == null) {
             return Center(
               child: Column(
                 mainAxisAlignment: MainAxisAlignment.center,
@@ -142,11 +192,19 @@ class _HomeScreenState extends State<HomeScreen> {
               child: Column(
                 crossAxisAlignment: CrossAxisAlignment.stretch,
                 children: [
+                  if (!service.isConnected) ...[
+                    _buildOfflineBanner(service),
+                    const SizedBox(height: 16),
+                  ],
                   _buildStatusCard(status, service),
                   const SizedBox(height: 16),
                   _buildModeSelector(status, service),
                   const SizedBox(height: 16),
                   _buildPhaseCards(status, service),
+                  if (service.events.isNotEmpty) ...[
+                    const SizedBox(height: 16),
+                    _buildEventsCard(status, service),
+                  ],
                 ],
               ),
             ),
@@ -162,6 +220,77 @@ class _HomeScreenState extends State<HomeScreen> {
     );
   }
 
+  Widget _buildOfflineBanner(PhaseService service) {
+    final time = service.statusTime;
+    return Card(
+      color: Colors.orange.shade50,
+      child: ListTile(
+        leading: const Icon(Icons.cloud_off, color: Colors.orange),
+        title: const Text('Offline'),
+        subtitle: Text(
+          time == null
+              ? 'Showing saved data'
+              : 'Showing data from ${_formatTime(time)}',
+        ),
+        trailing: TextButton(
+          onPressed: () => service.connect(),
+          child: const Text('Reconnect'),
+        ),
+      ),
+    );
+  }
+
+  Widget _buildEventsCard(SystemStatus status, PhaseService service) {
+    String phaseName(int index) =>
+        index >= 0 && index < status.phases.length
+            ? status.phases[index].name
+            : '-';
+
+    return Card(
+      elevation: 4,
+      child: Padding(
+        padding: const EdgeInsets.all(16),
+        child: Column(
+          crossAxisAlignment: CrossAxisAlignment.start,
+          children: [
+            Text('Recent Events', style: Theme.of(context).textTheme.titleMedium),
+            const SizedBox(height: 8),
+            ...service.events.reversed.take(5).map(
+                  (event) => Padding(
+                    padding: const EdgeInsets.symmetric(vertical: 4),
+                    child: Row(
+                      children: [
+                        SizedBox(
+                          width: 56,
+                          child: Text(
+                            event.time == null ? '--:--' : _formatTime(event.time!),
+                            style: TextStyle(
+                              fontSize: 12,
+                              color: Colors.grey.shade600,
+                            ),
+                          ),
+                        ),
+                        Expanded(
+                          child: Text(
+                            '${event.cause.replaceAll('_', ' ')}  '
+                            '${phaseName(event.fromPhase)} -> ${phaseName(event.toPhase)}',
+                          ),
+                        ),
+                      ],
+                    ),
+                  ),
+                ),
+          ],
+        ),
+      ),
+    );
+  }
+
+  String _formatTime(DateTime time) {
+    String two(int n) => n.toString().padLeft(2, '0');
+    return '${two(time.hour)}:${two(time.minute)}';
+  }
+
   Widget _buildStatusCard(SystemStatus status, PhaseService service) {
     return Card(
       elevation: 4,
@@ -394,6 +523,8 @@ class _HomeScreenState extends State<HomeScreen> {
                 ),
               ],
             ),
+            const SizedBox(height: 12),
+            VoltageSparkline(readings: service.history, phase: index),
             if (isManualMode) ...[
               const SizedBox(height: 16),
               SizedBox(
@@ -412,8 +543,11 @@ class _HomeScreenState extends State<HomeScreen> {
                               );
                             } else {
                               ScaffoldMessenger.of(context).showSnackBar(
-                                const SnackBar(
-                                  content: Text('Failed to switch phase'),
+                                SnackBar(
+                                  content: Text(
+                                    service.errorMessage ??
+                                        'Failed to switch phase',
+                                  ),
                                   backgroundColor: Colors.red,
                                 ),
                               );
@@ -0,0 +1,122 @@
+import 'package:multicast_dns/multicast_dns.dart';
+
+/// A detector found through its `_bpd._tcp` mDNS service record.
+class DiscoveredDevice {
+  final String id;
+  final String host;
+  final int port;
+  final String firmware;
+  final List<String> capabilities;
+
+  DiscoveredDevice({
+    required this.id,
+    required this.host,
+    required this.port,
+    required this.firmware,
+    required this.capabilities,
+  });
+
+  /// Address to use in request URLs (port omitted when it is 80).
+  String get address => port == 80 ? host : '$host:$port';
+}
+
+class DiscoveryService {
+  static const String serviceType = '_bpd._tcp.local';
+
+  /// Browses the local network for detectors. Returns whatever answered
+  /// within [timeout]; an empty list if none did or multicast is blocked.
+  static Future<List<DiscoveredDevice>> discover({
+    Duration timeout = const Duration(seconds: 2),
+  }) async {
+    final client = MDnsClient();
+    final devices = <String, DiscoveredDevice>{};
+
+    try {
+      await client.start();
+      await for (final ptr in client.lookup<PtrResourceRecord>(
+        ResourceRecordQuery.serverPointer(serviceType),
+        timeout: timeout,
+      )) {
+        final txt = await _lookupTxt(client, ptr.domainName, timeout);
+        await for (final srv in client.lookup<SrvResourceRecord>(
+          ResourceRecordQuery.service(ptr.domainName),
+          timeout: timeout,
+        )) {
+          final device = await _resolve(client, ptr, srv, txt, timeout);
+          if (device != null) {
+            devices[device.id] = device;
+            // One reachable address is enough; don't wait out the timeout
+            // for further SRV records of the same instance
+            break;
+          }
+        }
+      }
+    } catch (_) {
+      // No multicast on this network (or platform); callers fall back to
+      // a manually entered address.
+    } finally {
+      client.stop();
+    }
+
+    return devices.values.toList();
+  }
+
+  /// Finds the detector with the given ID, e.g. after its address changed.
+  static Future<DiscoveredDevice?> find(String id) async {
+    for (final device in await discover()) {
+      if (device.id == id) return device;
+    }
+    return null;
+  }
+
+  /// The device behind [srv] at its first IPv4 address, or null if the
+  /// target did not resolve within [timeout].
+  static Future<DiscoveredDevice?> _resolve(
+    MDnsClient client,
+    PtrResourceRecord ptr,
+    SrvResourceRecord srv,
+    Map<String, String> txt,
+    Duration timeout,
+  ) async {
+    await for (final ip in client.lookup<IPAddressResourceRecord>(
+      ResourceRecordQuery.addressIPv4(srv.target),
+      timeout: timeout,
+    )) {
+      final id = txt['id'] ?? ptr.domainName.split('.').first;
+      return DiscoveredDevice(
+        id: id,
+        host: ip.address.address,
+        port: srv.port,
+        firmware: txt['fw'] ?? '',
+        capabilities: (txt['caps'] ?? '')
+            .split(',')
+            .where((c) => c.isNotEmpty)
+            .toList(),
+      );
+    }
+    return null;
+  }
+
+  static Future<Map<String, String>> _lookupTxt(
+    MDnsClient client,
+    String name,
+    Duration timeout,
+  ) async {
+    final entries = <String, String>{};
+    await for (final record in client.lookup<TxtResourceRecord>(
+      ResourceRecordQuery.text(name),
+      timeout: timeout,
+    )) {
+      for (final line in record.text.split('\n')) {
+        final separator = line.indexOf('=');
+        if (separator > 0) {
+          entries[line.substring(0, separator)] = line.substring(
+            separator + 1,
+          );
+        }
+      }
+      break;
+    }
+    return entries;
+  }
+}
@@ -0,0 +1,121 @@
+import 'dart:convert';
+import 'package:shared_preferences/shared_preferences.dart';
+import '../models/history.dart';
+import '../models/phase_data.dart';
+
+/// Local copy of one device's readings, events and last status. Survives
+/// app restarts and lost connections, and remembers how far it has synced
+/// so only newer entries are requested from the device.
+class HistoryCache {
+  static const int maxReadings = 4320; // 6 hours at the device's 5 s interval
+  static const int maxEvents = 200;
+  static const String _lastDeviceKey = 'lastDevice';
+  static const String _lastAddressKey = 'lastAddress';
+
+  final String deviceId;
+  int boot = 0; // Device boot the reading sequence numbers belong to
+  int readingSeq = 0; // Last reading sequence number stored
+  int eventSeq = 0; // Last event sequence number stored
+  final List<VoltageReading> readings = [];
+  final List<DeviceEvent> events = [];
+  SystemStatus? status;
+  DateTime? statusTime;
+
+  HistoryCache(this.deviceId);
+
+  static String _key(String deviceId) => 'history.$deviceId';
+
+  static Future<HistoryCache> load(String deviceId) async {
+    final prefs = await SharedPreferences.getInstance();
+    final cache = HistoryCache(deviceId);
+    final stored = prefs.getString(_key(deviceId));
+    if (stored == null) return cache;
+
+    try {
+      final data = json.decode(stored) as Map<String, dynamic>;
+      cache.boot = data['boot'] ?? 0;
+      cache.readingSeq = data['readingSeq'] ?? 0;
+      cache.eventSeq = data['eventSeq'] ?? 0;
+      cache.readings.addAll(
+        (data['readings'] as List<dynamic>? ?? [])
+            .map((r) => VoltageReading.fromJson(r as Map<String, dynamic>)),
+      );
+      cache.events.addAll(
+        (data['events'] as List<dynamic>? ?? [])
+            .map((e) => DeviceEvent.fromJson(e as Map<String, dynamic>)),
+      );
+      if (data['status'] != null) {
+        cache.status = SystemStatus.fromJson(data['status']);
+        cache.statusTime = DateTime.fromMillisecondsSinceEpoch(
+          data['statusTime'],
+        );
+      }
+    } catch (_) {
+      // Unreadable cache (older format); start over
+      return HistoryCache(deviceId);
+    }
+    return cache;
+  }
+
+  Future<void> save() async {
+    final prefs = await SharedPreferences.getInstance();
+    await prefs.setString(
+      _key(deviceId),
+      json.encode({
+        'boot': boot,
+        'readingSeq': readingSeq,
+        'eventSeq': eventSeq,
+        'readings': readings.map((r) => r.toJson()).toList(),
+        'events': events.map((e) => e.toJson()).toList(),
+        'status': status?.toJson(),
+        'statusTime': statusTime?.millisecondsSinceEpoch,
+      }),
+    );
+  }
+
+  /// Device the app was last connected to, as (id, address).
+  static Future<(String, String)?> lastDevice() async {
+    final prefs = await SharedPreferences.getInstance();
+    final id = prefs.getString(_lastDeviceKey);
+    final address = prefs.getString(_lastAddressKey);
+    if (id == null || address == null) return null;
+    return (id, address);
+  }
+
+  static Future<void> rememberDevice(String id, String address) async {
+    final prefs = await SharedPreferences.getInstance();
+    await prefs.setString(_lastDeviceKey, id);
+    await prefs.setString(_lastAddressKey, address);
+  }
+
+  /// Readings restart at sequence 1 whenever the device reboots.
+  void startBoot(int newBoot) {
+    boot = newBoot;
+    readingSeq = 0;
+  }
+
+  void addReadings(Iterable<VoltageReading> newReadings) {
+    for (final reading in newReadings) {
+      readings.add(reading);
+      readingSeq = reading.seq;
+    }
+    if (readings.length > maxReadings) {
+      readings.removeRange(0, readings.length - maxReadings);
+    }
+  }
+
+  void addEvents(Iterable<DeviceEvent> newEvents) {
+    for (final event in newEvents) {
+      events.add(event);
+      eventSeq = event.seq;
+    }
+    if (events.length > maxEvents) {
+      events.removeRange(0, events.length - maxEvents);
+    }
+  }
+
+  void setStatus(SystemStatus newStatus) {
+    status = newStatus;
+    statusTime = DateTime.now();
+  }
+}
@@ -1,120 +1,357 @@
 import 'dart:convert';
+import 'dart:math';
 import 'package:flutter/foundation.dart';
 import 'package:http/http.dart' as http;
+import '../models/history.dart';
 import '../models/phase_data.dart';
+import 'discovery_service.dart';
+import 'history_cache.dart';
 
 class PhaseService extends ChangeNotifier {
-  String _serverIP = '192.168.1.100'; // Default IP, user can change
+  // One client for every request so the TCP connection is reused where the
+  // device keeps it alive, instead of a new connection per call.
+  final http.Client _client = http.Client();
+  Future<void>? _refresh; // In-flight status request shared by callers
+  String _serverIP = '192.168.4.1'; // Device AP address; replaced by discovery
+  String? _deviceId; // mDNS device ID of the connected detector
   bool _isConnected = false;
   bool _isLoading = false;
+  bool _isRediscovering = false;
   SystemStatus? _status;
+  String? _statusEtag; // Validator for conditional status polls
   String? _errorMessage;
+  HistoryCache? _cache; // Offline copy for the current device
+  DateTime? _lastSync;
+
+  // The device stores one reading per trend update (5 s); syncing more
+  // often than that would only return empty pages.
+  static const Duration _syncInterval = Duration(seconds: 5);
+
+  // Only what the app renders; forecast, trend and power-quality changes
+  // then don't turn an unchanged poll into a full response.
+  static const String _statusFields = 'deviceId,mode,bestPhase,selectedPhase,'
+      'name,voltage,avgVoltage,minVoltage,maxVoltage,isActive';
 
   String get serverIP => _serverIP;
+  String? get deviceId => _deviceId;
   bool get isConnected => _isConnected;
   bool get isLoading => _isLoading;
   SystemStatus? get status => _status;
   String? get errorMessage => _errorMessage;
+  List<VoltageReading> get history => _cache?.readings ?? const [];
+  List<DeviceEvent> get events => _cache?.events ?? const [];
+
+  /// When [status] was received; older than the last poll while offline.
+  DateTime? get statusTime => _cache?.statusTime;
+
+  /// Shows the last known state of the previous device straight away, then
+  /// reconnects to it (or discovers a device if there was none).
+  Future<void> start() async {
+    final last = await HistoryCache.lastDevice();
+    if (last != null) {
+      _deviceId = last.$1;
+      _serverIP = last.$2;
+      _cache = await HistoryCache.load(last.$1);
+      _status = _cache!.status;
+      notifyListeners();
+      await connect();
+    }
+    if (!_isConnected) await discoverAndConnect();
+  }
 
   void setServerIP(String ip) {
     _serverIP = ip;
     notifyListeners();
   }
 
+  Future<List<DiscoveredDevice>> discover() => DiscoveryService.discover();
+
+  /// Connects straight away when exactly one detector answers on mDNS.
+  /// Returns the devices found so the caller can offer a choice otherwise.
+  Future<List<DiscoveredDevice>> discoverAndConnect() async {
+    final devices = await discover();
+    if (devices.length == 1) {
+      await connectTo(devices.first);
+    }
+    return devices;
+  }
+
+  Future<void> connectTo(DiscoveredDevice device) {
+    _serverIP = device.address;
+    _deviceId = device.id;
+    return connect();
+  }
+
   Future<void> connect() async {
     _isLoading = true;
     _errorMessage = null;
+    _statusEtag = null; // May be a different device now
     notifyListeners();
 
     try {
-      final response = await http
-          .get(Uri.parse('http://$_serverIP/api/status'))
-          .timeout(const Duration(seconds: 5));
-
-      if (response.statusCode == 200) {
-        _status = SystemStatus.fromJson(json.decode(response.body));
+      await _fetch(const Duration(seconds: 5));
+      _isConnected = true;
+      _errorMessage = null;
+    } catch (e) {
+      // The detector may have moved to a new address; look it up by ID
+      // instead of waiting for the user to notice and re-enter it.
+      if (await _rediscover()) {
         _isConnected = true;
         _errorMessage = null;
       } else {
         _isConnected = false;
-        _errorMessage = 'Failed to connect: ${response.statusCode}';
+        _errorMessage = 'Connection error: ${e.toString()}';
       }
-    } catch (e) {
-      _isConnected = false;
-      _errorMessage = 'Connection error: ${e.toString()}';
     } finally {
       _isLoading = false;
       notifyListeners();
     }
   }
 
-  Future<void> fetchStatus() async {
-    if (!_isConnected) return;
+  /// Refreshes the status. Calls made while a refresh is in flight share it
+  /// rather than queueing more requests on the single-client server.
+  Future<void> fetchStatus() {
+    if (!_isConnected) return Future.value();
+    return _refresh ??= _fetchStatus().whenComplete(() => _refresh = null);
+  }
 
+  Future<void> _fetchStatus() async {
     try {
-      final response = await http
-          .get(Uri.parse('http://$_serverIP/api/status'))
-          .timeout(const Duration(seconds: 3));
-
-      if (response.statusCode == 200) {
-        _status = SystemStatus.fromJson(json.decode(response.body));
-        _errorMessage = null;
-        notifyListeners();
-      }
+      await _fetch(const Duration(seconds: 3));
+      _errorMessage = null;
+      notifyListeners();
     } catch (e) {
-      _errorMessage = 'Failed to fetch status: ${e.toString()}';
+      if (!await _rediscover()) {
+        _errorMessage = 'Failed to fetch status: ${e.toString()}';
+      }
       notifyListeners();
     }
   }
 
-  Future<bool> setPhase(int phaseIndex) async {
-    if (!_isConnected) return false;
+  Future<void> _fetch(Duration timeout) async {
+    final etag = _status != null ? _statusEtag : null;
+    final response = await _client.get(
+      Uri.parse('http://$_serverIP/api/status?fields=$_statusFields'),
+      headers: {if (etag != null) 'If-None-Match': etag},
+    ).timeout(timeout);
+
+    // 429: shed by the device's rate limit; keep the last status and let
+    // the next poll try again
+    if (response.statusCode == 429) return;
+
+    // 304: nothing the app shows has changed since the last poll
+    if (response.statusCode != 304) {
+      if (response.statusCode != 200) {
+        throw Exception('HTTP ${response.statusCode}');
+      }
+      _statusEtag = response.headers['etag'];
+      _status = SystemStatus.fromJson(json.decode(response.body));
+      if (_status!.deviceId.isNotEmpty) _deviceId = _status!.deviceId;
+    }
+
+    final id = _deviceId;
+    if (id == null) return; // Firmware without device IDs: nothing to key a cache on
+    if (_cache?.deviceId != id) {
+      _cache = await HistoryCache.load(id);
+      _lastSync = null;
+    }
+    _cache!.setStatus(_status!);
+    await HistoryCache.rememberDevice(id, _serverIP);
+    await _syncIfDue();
+  }
+
+  Future<Map<String, dynamic>?> _getJson(String path) async {
+    final response = await _client
+        .get(Uri.parse('http://$_serverIP$path'))
+        .timeout(const Duration(seconds: 3));
+    if (response.statusCode != 200) return null;
+    return json.decode(response.body) as Map<String, dynamic>;
+  }
+
+  /// Pulls readings and events newer than what the cache already holds.
+  Future<void> _syncIfDue() async {
+    final cache = _cache;
+    if (cache == null) return;
+    final now = DateTime.now();
+    if (_lastSync != null && now.difference(_lastSync!) < _syncInterval) {
+      return;
+    }
+    _lastSync = now;
 
     try {
-      final response = await http.post(
-        Uri.parse('http://$_serverIP/api/setPhase'),
-        headers: {'Content-Type': 'application/json'},
-        body: json.encode({'phase': phaseIndex}),
-      ).timeout(const Duration(seconds: 5));
-
-      if (response.statusCode == 200) {
-        await fetchStatus();
-        return true;
+      await _syncReadings(cache);
+      await _syncEvents(cache);
+    } catch (_) {
+      // Keep what arrived; the next sync continues from there
+    }
+    await cache.save();
+  }
+
+  Future<void> _syncReadings(HistoryCache cache) async {
+    for (var page = 0; page < 10; page++) {
+      final body = await _getJson('/api/history?since=${cache.readingSeq}');
+      if (body == null) return; // Firmware without /api/history
+
+      if (body['boot'] != cache.boot) {
+        // Device rebooted: its reading sequence numbers started over
+        final wasSynced = cache.readingSeq != 0;
+        cache.startBoot(body['boot']);
+        if (wasSynced) continue;
       }
+
+      final bootTime = DateTime.now().subtract(Duration(milliseconds: body['uptime']));
+      cache.addReadings(
+        (body['readings'] as List<dynamic>).map(
+          (row) => VoltageReading.fromRow(row as List<dynamic>, bootTime),
+        ),
+      );
+      if (body['more'] != true) return;
+    }
+  }
+
+  Future<void> _syncEvents(HistoryCache cache) async {
+    for (var page = 0; page < 10; page++) {
+      final body = await _getJson('/api/events?since=${cache.eventSeq}');
+      if (body == null) return;
+
+      final bootTime = DateTime.now().subtract(Duration(milliseconds: body['uptime']));
+      cache.addEvents(
+        (body['events'] as List<dynamic>).map(
+          (e) => DeviceEvent.fromDevice(
+            e as Map<String, dynamic>,
+            body['boot'],
+            bootTime,
+          ),
+        ),
+      );
+      if (body['more'] != true) return;
+    }
+  }
+
+
+  /// Re-resolves the connected device through mDNS and retries once at its
+  /// current address. Returns true if that succeeded.
+  Future<bool> _rediscover() async {
+    final id = _deviceId;
+    if (id == null || _isRediscovering) return false;
+
+    _isRediscovering = true;
+    try {
+      final device = await DiscoveryService.find(id);
+      if (device == null) return false;
+      _serverIP = device.address;
+      await _fetch(const Duration(seconds: 3));
+      return true;
+    } catch (_) {
       return false;
-    } catch (e) {
-      _errorMessage = 'Failed to set phase: ${e.toString()}';
-      notifyListeners();
-      return false;
+    } finally {
+      _isRediscovering = false;
     }
   }
 
-  Future<bool> setMode(String mode) async {
+  Future<bool> setPhase(int phaseIndex) =>
+      _sendCommand({'type': 'setPhase', 'phase': phaseIndex}, 'set phase');
+
+  Future<bool> setMode(String mode) =>
+      _sendCommand({'type': 'setMode', 'mode': mode}, 'set mode');
+
+  /// Sends a command and waits for its outcome, long-polling it while the
+  /// device still reports it pending. The idempotency key makes the single
+  /// retry after a lost response safe: the device returns the original
+  /// command instead of operating the relays again.
+  Future<bool> _sendCommand(Map<String, dynamic> command, String action) async {
     if (!_isConnected) return false;
 
-    try {
-      final response = await http.post(
-        Uri.parse('http://$_serverIP/api/setMode'),
-        headers: {'Content-Type': 'application/json'},
-        body: json.encode({'mode': mode}),
-      ).timeout(const Duration(seconds: 5));
-
-      if (response.statusCode == 200) {
-        await fetchStatus();
-        return true;
+    final body = json.encode({...command, 'key': _newCommandKey(), 'wait': true});
+    Object? lastError;
+    for (var attempt = 0; attempt < 2; attempt++) {
+      try {
+        final response = await _client.post(
+          Uri.parse('http://$_serverIP/api/command'),
+          headers: {'Content-Type': 'application/json'},
+          body: body,
+        ).timeout(const Duration(seconds: 5));
+
+        if (response.statusCode == 404) {
+          return _sendLegacyCommand(command, action); // Older firmware
+        }
+        return _applyCommandResponse(await _awaitCommand(response), action);
+      } catch (e) {
+        lastError = e;
       }
-      return false;
-    } catch (e) {
-      _errorMessage = 'Failed to set mode: ${e.toString()}';
-      notifyListeners();
-      return false;
     }
+
+    _errorMessage = 'Failed to $action: ${lastError.toString()}';
+    notifyListeners();
+    return false;
+  }
+
+  /// Polls a command answered with 202 until it has run. The device holds
+  /// each poll for up to 2 s while the command is pending.
+  Future<http.Response> _awaitCommand(http.Response response) async {
+    var current = response;
+    for (var poll = 0; poll < 5 && current.statusCode == 202; poll++) {
+      final id = (json.decode(current.body) as Map<String, dynamic>)['id'];
+      if (id == null) break;
+      current = await _client
+          .get(Uri.parse('http://$_serverIP/api/command?id=$id&wait=2000'))
+          .timeout(const Duration(seconds: 5));
+    }
+    return current;
+  }
+
+  Future<bool> _sendLegacyCommand(
+    Map<String, dynamic> command,
+    String action,
+  ) async {
+    final isPhase = command['type'] == 'setPhase';
+    final response = await _client.post(
+      Uri.parse('http://$_serverIP/api/${command['type']}'),
+      headers: {'Content-Type': 'application/json'},
+      body: json.encode(
+        isPhase ? {'phase': command['phase']} : {'mode': command['mode']},
+      ),
+    ).timeout(const Duration(seconds: 5));
+    return _applyCommandResponse(response, action);
+  }
+
+  static String _newCommandKey() {
+    final random = Random.secure();
+    return List.generate(16, (_) => random.nextInt(256))
+        .map((b) => b.toRadixString(16).padLeft(2, '0'))
+        .join();
+  }
+
+  /// Command responses carry the resulting mode and selected phase; apply
+  /// them to the current status instead of fetching it again.
+  bool _applyCommandResponse(http.Response response, String action) {
+    final body = json.decode(response.body) as Map<String, dynamic>;
+    if (body.containsKey('selectedPhase') && _status != null) {
+      _status = _status!.withControlState(body);
+      _cache?.setStatus(_status!);
+    }
+
+    // /api/command reports `state`; the legacy endpoints `success`
+    final state = body['state'];
+    final succeeded = state != null ? state == 'done' : body['success'] == true;
+    if (!succeeded) {
+      _errorMessage = state != null
+          ? 'Could not $action: ${body['reason'] ?? state}'
+          : body['message'] ?? 'Could not $action';
+    }
+    notifyListeners();
+    return succeeded;
   }
 
   void disconnect() {
     _isConnected = false;
-    _status = null;
+    _status = _cache?.status;
     notifyListeners();
   }
-}
 
+  @override
+  void dispose() {
+    _client.close();
+    super.dispose();
+  }
+}
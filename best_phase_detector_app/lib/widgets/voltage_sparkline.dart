@@ -0,0 +1,111 @@
+import 'package:flutter/material.dart';
+import '../models/history.dart';
+
+/// Compact line chart of one phase's cached readings, with the safe
+/// voltage band shaded.
+class VoltageSparkline extends StatelessWidget {
+  final List<VoltageReading> readings;
+  final int phase;
+  final Duration window;
+
+  const VoltageSparkline({
+    super.key,
+    required this.readings,
+    required this.phase,
+    this.window = const Duration(minutes: 30),
+  });
+
+  @override
+  Widget build(BuildContext context) {
+    final since = DateTime.now().subtract(window);
+    final points = readings
+        .where((r) => r.time.isAfter(since) && phase < r.voltages.length)
+        .toList();
+
+    if (points.length < 2) {
+      return const SizedBox(
+        height: 48,
+        child: Center(
+          child: Text(
+            'Collecting history...',
+            style: TextStyle(fontSize: 12, color: Colors.grey),
+          ),
+        ),
+      );
+    }
+
+    return SizedBox(
+      height: 48,
+      width: double.infinity,
+      child: CustomPaint(
+        painter: _SparklinePainter(
+          points: points,
+          phase: phase,
+          start: since,
+          window: window,
+          color: Theme.of(context).colorScheme.primary,
+        ),
+      ),
+    );
+  }
+}
+
+class _SparklinePainter extends CustomPainter {
+  static const double lowVoltage = 180.0; // Matches the firmware's limits
+  static const double highVoltage = 260.0;
+
+  final List<VoltageReading> points;
+  final int phase;
+  final DateTime start;
+  final Duration window;
+  final Color color;
+
+  _SparklinePainter({
+    required this.points,
+    required this.phase,
+    required this.start,
+    required this.window,
+    required this.color,
+  });
+
+  @override
+  void paint(Canvas canvas, Size size) {
+    var minV = lowVoltage - 20;
+    var maxV = highVoltage + 20;
+    for (final p in points) {
+      final v = p.voltages[phase];
+      if (v < minV) minV = v;
+      if (v > maxV) maxV = v;
+    }
+
+    double y(double v) => size.height * (1 - (v - minV) / (maxV - minV));
+    double x(DateTime t) =>
+        size.width *
+        t.difference(start).inMilliseconds /
+        window.inMilliseconds;
+
+    canvas.drawRect(
+      Rect.fromLTRB(0, y(highVoltage), size.width, y(lowVoltage)),
+      Paint()..color = Colors.green.withValues(alpha: 0.08),
+    );
+
+    final path = Path()
+      ..moveTo(x(points.first.time), y(points.first.voltages[phase]));
+    for (final p in points.skip(1)) {
+      path.lineTo(x(p.time), y(p.voltages[phase]));
+    }
+    canvas.drawPath(
+      path,
+      Paint()
+        ..color = color
+        ..style = PaintingStyle.stroke
+        ..strokeWidth = 1.5,
+    );
+  }
+
+  @override
+  bool shouldRepaint(_SparklinePainter old) =>
+      old.points.length != points.length ||
+      old.points.last.seq != points.last.seq ||
+      old.start != start;
+}
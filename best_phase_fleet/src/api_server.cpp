@@ -0,0 +1,297 @@
+#include "api_server.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "json.h"
+
+const size_t HISTORY_DEFAULT_LIMIT = 600;
+const size_t HISTORY_MAX_LIMIT = 10000;
+
+static const char* modeName(uint8_t mode) {
+    switch (mode) {
+        case DEVICE_MODE_AUTOMATIC: return "automatic";
+        case DEVICE_MODE_MANUAL: return "manual";
+    }
+    return "unknown";
+}
+
+static void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string& out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) out.append(buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+ApiServer::~ApiServer() {
+    while (!clients_.empty()) closeClient(clients_.begin()->first);
+    if (listenFd_ >= 0) {
+        loop_.remove(listenFd_);
+        close(listenFd_);
+    }
+}
+
+bool ApiServer::listen(uint16_t port) {
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) return false;
+
+    int reuse = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listenFd_, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd_, 64) != 0) {
+        perror("listen");
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    return loop_.add(listenFd_, EPOLLIN, [this](uint32_t) { onAccept(); });
+}
+
+void ApiServer::onAccept() {
+    for (;;) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;  // EAGAIN or transient error; epoll reports the next one
+        if (clients_.size() >= MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        clients_[fd] = Client();
+        loop_.add(fd, EPOLLIN | EPOLLRDHUP, [this, fd](uint32_t events) { onClient(fd, events); });
+    }
+}
+
+void ApiServer::onClient(int fd, uint32_t events) {
+    auto it = clients_.find(fd);
+    if (it == clients_.end()) return;
+    Client& client = it->second;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        closeClient(fd);
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        if (!flush(fd, client)) return;
+    }
+
+    if (events & (EPOLLIN | EPOLLRDHUP)) {
+        char buffer[4096];
+        for (;;) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                client.input.append(buffer, n);
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                closeClient(fd);
+                return;
+            }
+            break;
+        }
+
+        // Answer every complete request in the buffer (pipelining)
+        for (;;) {
+            HttpRequest request;
+            long consumed = parseHttpRequest(client.input, request);
+            if (consumed == 0) break;
+            if (consumed < 0) {
+                client.output += formatHttpResponse(400, "text/plain", "Bad Request\n", false);
+                client.closeAfterWrite = true;
+                client.input.clear();
+                break;
+            }
+            client.input.erase(0, consumed);
+            client.output += handle(request);
+            if (!request.keepAlive) {
+                client.closeAfterWrite = true;
+                client.input.clear();
+                break;
+            }
+        }
+        flush(fd, client);
+    }
+}
+
+// Returns false if the client was closed
+bool ApiServer::flush(int fd, Client& client) {
+    while (client.written < client.output.size()) {
+        ssize_t n = send(fd, client.output.data() + client.written,
+                         client.output.size() - client.written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                loop_.modify(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+                return true;
+            }
+            closeClient(fd);
+            return false;
+        }
+        client.written += n;
+    }
+
+    client.output.clear();
+    client.written = 0;
+    if (client.closeAfterWrite) {
+        closeClient(fd);
+        return false;
+    }
+    loop_.modify(fd, EPOLLIN | EPOLLRDHUP);
+    return true;
+}
+
+void ApiServer::closeClient(int fd) {
+    loop_.remove(fd);
+    close(fd);
+    clients_.erase(fd);
+}
+
+std::string ApiServer::handle(const HttpRequest& request) {
+    if (request.method != "GET") {
+        return formatHttpResponse(405, "text/plain", "Method Not Allowed\n", request.keepAlive);
+    }
+    if (request.path == "/api/fleet") return handleFleet(request.keepAlive);
+    if (request.path == "/api/history") return handleHistory(request, request.keepAlive);
+    if (request.path == "/metrics") return handleMetrics(request.keepAlive);
+    return formatHttpResponse(404, "text/plain", "Not Found\n", request.keepAlive);
+}
+
+std::string ApiServer::handleFleet(bool keepAlive) {
+    std::string body;
+    body.reserve(256 * store_.deviceCount() + 64);
+    size_t online = 0;
+
+    body += "{\"devices\":[";
+    for (size_t d = 0; d < store_.deviceCount(); d++) {
+        const DeviceInfo& info = store_.info(d);
+        const DeviceSeries& series = store_.series(d);
+        if (info.online) online++;
+
+        if (d > 0) body += ',';
+        body += "{\"id\":";
+        appendJsonString(body, info.id);
+        body += ",\"host\":";
+        appendJsonString(body, info.host);
+        appendf(body, ",\"port\":%u,\"online\":%s,\"lastSeen\":%lld,\"latencyMs\":%u",
+                info.port, info.online ? "true" : "false", (long long)info.lastSeenMs, info.lastLatencyMs);
+        if (!info.lastError.empty()) {
+            body += ",\"error\":";
+            appendJsonString(body, info.lastError);
+        }
+
+        if (series.size() > 0) {
+            StatusSample latest = series.at(series.size() - 1);
+            appendf(body, ",\"mode\":\"%s\",\"selectedPhase\":%d,\"bestPhase\":%d,\"phases\":[",
+                    modeName(latest.mode), latest.selectedPhase, latest.bestPhase);
+            for (int p = 0; p < latest.phaseCount; p++) {
+                if (p > 0) body += ',';
+                body += "{\"name\":";
+                appendJsonString(body, p < (int)info.phaseNames.size() ? info.phaseNames[p] : "");
+                appendf(body, ",\"voltage\":%.1f,\"avgVoltage\":%.1f}", latest.voltage[p], latest.avgVoltage[p]);
+            }
+            body += ']';
+        }
+        body += '}';
+    }
+    appendf(body, "],\"online\":%zu,\"total\":%zu}", online, store_.deviceCount());
+
+    return formatHttpResponse(200, "application/json", body, keepAlive);
+}
+
+std::string ApiServer::handleHistory(const HttpRequest& request, bool keepAlive) {
+    std::string id;
+    if (!queryParam(request.query, "device", id)) {
+        return formatHttpResponse(400, "application/json", "{\"error\":\"device required\"}", keepAlive);
+    }
+    int device = store_.find(id);
+    if (device < 0) {
+        return formatHttpResponse(404, "application/json", "{\"error\":\"unknown device\"}", keepAlive);
+    }
+
+    std::string value;
+    int64_t since = queryParam(request.query, "since", value) ? strtoll(value.c_str(), nullptr, 10) : 0;
+    size_t limit = queryParam(request.query, "limit", value) ? strtoul(value.c_str(), nullptr, 10)
+                                                             : HISTORY_DEFAULT_LIMIT;
+    if (limit == 0 || limit > HISTORY_MAX_LIMIT) limit = HISTORY_MAX_LIMIT;
+
+    const DeviceSeries& series = store_.series(device);
+    size_t first = series.firstAfter(since);
+    size_t end = first + limit < series.size() ? first + limit : series.size();
+    int phaseCount = end > first ? series.at(end - 1).phaseCount : 0;
+
+    // Columnar: one array per field, same order as the store
+    std::string body;
+    body.reserve((end - first) * (16 + 8 * phaseCount) + 128);
+    body += "{\"device\":";
+    appendJsonString(body, id);
+    body += ",\"time\":[";
+    for (size_t i = first; i < end; i++) {
+        appendf(body, i > first ? ",%lld" : "%lld", (long long)series.timeAt(i));
+    }
+    body += "],\"selectedPhase\":[";
+    for (size_t i = first; i < end; i++) {
+        appendf(body, i > first ? ",%d" : "%d", series.selectedPhaseAt(i));
+    }
+    body += "],\"voltage\":[";
+    for (int p = 0; p < phaseCount; p++) {
+        body += p > 0 ? ",[" : "[";
+        for (size_t i = first; i < end; i++) {
+            appendf(body, i > first ? ",%.1f" : "%.1f", series.voltageAt(p, i));
+        }
+        body += ']';
+    }
+    appendf(body, "],\"more\":%s}", end < series.size() ? "true" : "false");
+
+    return formatHttpResponse(200, "application/json", body, keepAlive);
+}
+
+std::string ApiServer::handleMetrics(bool keepAlive) {
+    std::string body;
+    size_t online = 0;
+    for (size_t d = 0; d < store_.deviceCount(); d++) {
+        if (store_.info(d).online) online++;
+    }
+
+    appendf(body, "# HELP bpd_fleet_devices Configured devices\n# TYPE bpd_fleet_devices gauge\n");
+    appendf(body, "bpd_fleet_devices %zu\n", store_.deviceCount());
+    appendf(body, "# HELP bpd_fleet_devices_online Devices whose last poll succeeded\n"
+                  "# TYPE bpd_fleet_devices_online gauge\n");
+    appendf(body, "bpd_fleet_devices_online %zu\n", online);
+
+    body += "# HELP bpd_fleet_device_up 1 if the last poll succeeded\n# TYPE bpd_fleet_device_up gauge\n";
+    for (size_t d = 0; d < store_.deviceCount(); d++) {
+        appendf(body, "bpd_fleet_device_up{device=\"%s\"} %d\n", store_.info(d).id.c_str(),
+                store_.info(d).online ? 1 : 0);
+    }
+    body += "# HELP bpd_fleet_poll_failures_total Failed status polls\n"
+            "# TYPE bpd_fleet_poll_failures_total counter\n";
+    for (size_t d = 0; d < store_.deviceCount(); d++) {
+        appendf(body, "bpd_fleet_poll_failures_total{device=\"%s\"} %u\n", store_.info(d).id.c_str(),
+                store_.info(d).failures);
+    }
+    body += "# HELP bpd_fleet_voltage_volts Latest RMS voltage per phase\n"
+            "# TYPE bpd_fleet_voltage_volts gauge\n";
+    for (size_t d = 0; d < store_.deviceCount(); d++) {
+        const DeviceSeries& series = store_.series(d);
+        if (series.size() == 0) continue;
+        StatusSample latest = series.at(series.size() - 1);
+        for (int p = 0; p < latest.phaseCount; p++) {
+            appendf(body, "bpd_fleet_voltage_volts{device=\"%s\",phase=\"%d\"} %.1f\n",
+                    store_.info(d).id.c_str(), p + 1, latest.voltage[p]);
+        }
+    }
+
+    return formatHttpResponse(200, "text/plain; version=0.0.4", body, keepAlive);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "event_loop.h"
+#include "fleet_store.h"
+#include "http.h"
+
+// Aggregated HTTP API over the fleet store:
+//   GET /api/fleet                                  latest status of every device
+//   GET /api/history?device=ID[&since=MS][&limit=N] columnar history of one device
+//   GET /metrics                                    Prometheus text format
+class ApiServer {
+public:
+    ApiServer(EventLoop& loop, FleetStore& store) : loop_(loop), store_(store) {}
+    ~ApiServer();
+
+    bool listen(uint16_t port);
+
+private:
+    struct Client {
+        std::string input;
+        std::string output;
+        size_t written = 0;
+        bool closeAfterWrite = false;
+    };
+
+    static const size_t MAX_CLIENTS = 256;
+
+    void onAccept();
+    void onClient(int fd, uint32_t events);
+    bool flush(int fd, Client& client);
+    void closeClient(int fd);
+
+    std::string handle(const HttpRequest& request);
+    std::string handleFleet(bool keepAlive);
+    std::string handleHistory(const HttpRequest& request, bool keepAlive);
+    std::string handleMetrics(bool keepAlive);
+
+    EventLoop& loop_;
+    FleetStore& store_;
+    int listenFd_ = -1;
+    std::unordered_map<int, Client> clients_;
+};
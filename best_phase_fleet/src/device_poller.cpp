@@ -0,0 +1,246 @@
+#include "device_poller.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "json.h"
+
+DevicePoller::DevicePoller(EventLoop& loop, FleetStore& store, int device, int intervalMs, int timeoutMs)
+    : loop_(loop), store_(store), device_(device), intervalMs_(intervalMs), timeoutMs_(timeoutMs) {
+    buildRequest();
+}
+
+DevicePoller::~DevicePoller() {
+    closeSocket();
+}
+
+void DevicePoller::buildRequest() {
+    request_ = "GET /api/status HTTP/1.1\r\nHost: " + store_.info(device_).host +
+               "\r\nAccept: application/json\r\nConnection: keep-alive\r\n\r\n";
+}
+
+void DevicePoller::addressChanged() {
+    closeSocket();
+    buildRequest();
+    state_ = STATE_IDLE;
+    resolved_ = false;
+    backoffMs_ = 0;
+    nextPollMs_ = EventLoop::nowMs();
+}
+
+bool DevicePoller::resolve() {
+    const DeviceInfo& info = store_.info(device_);
+    address_.sin_family = AF_INET;
+    address_.sin_port = htons(info.port);
+    if (inet_pton(AF_INET, info.host.c_str(), &address_.sin_addr) == 1) return true;
+
+    // Hostnames go through the blocking resolver. Fleets are normally
+    // configured by address, so this only runs for the odd named device and
+    // again after repeated failures.
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(info.host.c_str(), nullptr, &hints, &result) != 0 || !result) return false;
+    address_.sin_addr = ((sockaddr_in*)result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return true;
+}
+
+void DevicePoller::tick(int64_t now) {
+    if (state_ != STATE_IDLE) {
+        if (now - startedMs_ > timeoutMs_) finish(false, "timeout");
+        return;
+    }
+    if (now >= nextPollMs_) beginPoll(now);
+}
+
+void DevicePoller::beginPoll(int64_t now) {
+    startedMs_ = now;
+    parser_.reset();
+    sent_ = 0;
+
+    if (fd_ >= 0) {
+        // Reuse the kept-alive connection
+        state_ = STATE_SENDING;
+        loop_.modify(fd_, EPOLLOUT | EPOLLIN | EPOLLRDHUP);
+        return;
+    }
+
+    if (!resolved_) {
+        resolved_ = resolve();
+        if (!resolved_) {
+            finish(false, "resolve failed");
+            return;
+        }
+    }
+
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        finish(false, strerror(errno));
+        return;
+    }
+
+    int result = connect(fd_, (sockaddr*)&address_, sizeof(address_));
+    if (result != 0 && errno != EINPROGRESS) {
+        finish(false, strerror(errno));
+        return;
+    }
+
+    state_ = STATE_CONNECTING;
+    loop_.add(fd_, EPOLLOUT | EPOLLRDHUP, [this](uint32_t events) { onEvent(events); });
+}
+
+void DevicePoller::onEvent(uint32_t events) {
+    if (state_ == STATE_IDLE) {
+        // Idle keep-alive connection closed or sent something unexpected
+        closeSocket();
+        return;
+    }
+
+    if (state_ == STATE_CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            finish(false, strerror(error));
+            return;
+        }
+        state_ = STATE_SENDING;
+        loop_.modify(fd_, EPOLLOUT | EPOLLIN | EPOLLRDHUP);
+    }
+
+    if (state_ == STATE_SENDING && (events & EPOLLOUT)) onWritable();
+    if (state_ == STATE_RECEIVING && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) onReadable();
+    if (state_ != STATE_IDLE && (events & EPOLLERR)) finish(false, "socket error");
+}
+
+void DevicePoller::onWritable() {
+    while (sent_ < request_.size()) {
+        ssize_t n = send(fd_, request_.data() + sent_, request_.size() - sent_, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            finish(false, strerror(errno));
+            return;
+        }
+        sent_ += n;
+    }
+    state_ = STATE_RECEIVING;
+    loop_.modify(fd_, EPOLLIN | EPOLLRDHUP);
+}
+
+void DevicePoller::onReadable() {
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+        HttpResponseParser::Result result;
+        if (n > 0) {
+            result = parser_.feed(buffer, n);
+        } else if (n == 0) {
+            result = parser_.finish();
+            if (result != HttpResponseParser::COMPLETE) {
+                finish(false, "connection closed");
+                return;
+            }
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else {
+            finish(false, strerror(errno));
+            return;
+        }
+
+        if (result == HttpResponseParser::FAILED) {
+            finish(false, "malformed response");
+            return;
+        }
+        if (result == HttpResponseParser::COMPLETE) {
+            const HttpResponse& response = parser_.response();
+            if (!response.keepAlive || n == 0) closeSocket();
+            if (response.status != 200) {
+                char error[32];
+                snprintf(error, sizeof(error), "HTTP %d", response.status);
+                finish(false, error);
+            } else if (!applyStatus(response.body)) {
+                finish(false, "invalid status document");
+            } else {
+                finish(true, nullptr);
+            }
+            return;
+        }
+    }
+}
+
+void DevicePoller::finish(bool success, const char* error) {
+    DeviceInfo& info = store_.info(device_);
+    int64_t now = EventLoop::nowMs();
+    info.polls++;
+
+    if (success) {
+        if (!info.online) fprintf(stderr, "%s: online\n", info.id.c_str());
+        info.online = true;
+        info.consecutiveFailures = 0;
+        info.lastLatencyMs = (uint32_t)(now - startedMs_);
+        info.lastError.clear();
+        backoffMs_ = 0;
+        nextPollMs_ = startedMs_ + intervalMs_;
+        if (fd_ >= 0) loop_.modify(fd_, EPOLLIN | EPOLLRDHUP);  // Watch for the peer closing
+    } else {
+        closeSocket();
+        if (info.online) fprintf(stderr, "%s: offline (%s)\n", info.id.c_str(), error);
+        info.online = false;
+        info.failures++;
+        info.consecutiveFailures++;
+        info.lastError = error;
+        // Addresses can change (DHCP); resolve again after a few failures
+        if (info.consecutiveFailures % 3 == 0) resolved_ = false;
+        backoffMs_ = backoffMs_ == 0 ? intervalMs_ : backoffMs_ * 2;
+        if (backoffMs_ > MAX_BACKOFF_MS) backoffMs_ = MAX_BACKOFF_MS;
+        nextPollMs_ = now + backoffMs_;
+    }
+    state_ = STATE_IDLE;
+}
+
+void DevicePoller::closeSocket() {
+    if (fd_ < 0) return;
+    loop_.remove(fd_);
+    close(fd_);
+    fd_ = -1;
+}
+
+bool DevicePoller::applyStatus(const std::string& body) {
+    JsonValue doc;
+    if (!parseJson(body, doc) || doc.type != JsonValue::OBJECT) return false;
+    const JsonValue* phases = doc.get("phases");
+    if (!phases || phases->type != JsonValue::ARRAY) return false;
+
+    DeviceInfo& info = store_.info(device_);
+    StatusSample sample;
+    sample.timeMs = EventLoop::wallClockMs();
+    sample.selectedPhase = (int8_t)doc.numberOr("selectedPhase", -1);
+    sample.bestPhase = (int8_t)doc.numberOr("bestPhase", -1);
+    std::string mode = doc.stringOr("mode", "");
+    sample.mode = mode == "automatic" ? DEVICE_MODE_AUTOMATIC
+                : mode == "manual" ? DEVICE_MODE_MANUAL
+                : DEVICE_MODE_UNKNOWN;
+
+    size_t count = phases->items.size();
+    if (count > (size_t)FLEET_MAX_PHASES) count = FLEET_MAX_PHASES;
+    sample.phaseCount = (uint8_t)count;
+    info.phaseNames.resize(count);
+    for (size_t p = 0; p < count; p++) {
+        const JsonValue& phase = phases->items[p];
+        sample.voltage[p] = (float)phase.numberOr("voltage", 0.0);
+        sample.avgVoltage[p] = (float)phase.numberOr("avgVoltage", 0.0);
+        info.phaseNames[p] = phase.stringOr("name", "");
+    }
+
+    info.lastSeenMs = sample.timeMs;
+    store_.series(device_).append(sample);
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string>
+
+#include "event_loop.h"
+#include "fleet_store.h"
+#include "http.h"
+
+// Polls one detector's /api/status over a non-blocking socket and appends
+// the result to the store. The connection is reused when the device keeps
+// it alive (the ESP32 WebServer usually closes it, so most polls reconnect).
+// Failed polls back off exponentially up to MAX_BACKOFF_MS.
+class DevicePoller {
+public:
+    DevicePoller(EventLoop& loop, FleetStore& store, int device, int intervalMs, int timeoutMs);
+    ~DevicePoller();
+
+    DevicePoller(const DevicePoller&) = delete;
+    DevicePoller& operator=(const DevicePoller&) = delete;
+
+    // First poll at `firstPollMs` (monotonic); callers stagger these so a
+    // large fleet does not connect in one burst.
+    void start(int64_t firstPollMs) { nextPollMs_ = firstPollMs; }
+
+    // Starts a poll when due and enforces the request timeout.
+    void tick(int64_t now);
+
+    bool busy() const { return state_ != STATE_IDLE; }
+
+    // The device's host or port in the store changed (mDNS); drop the
+    // connection and poll the new address right away.
+    void addressChanged();
+
+private:
+    enum State { STATE_IDLE, STATE_CONNECTING, STATE_SENDING, STATE_RECEIVING };
+
+    static const int MAX_BACKOFF_MS = 30000;
+
+    void buildRequest();
+    bool resolve();
+    void beginPoll(int64_t now);
+    void onEvent(uint32_t events);
+    void onWritable();
+    void onReadable();
+    void finish(bool success, const char* error);
+    void closeSocket();
+    bool applyStatus(const std::string& body);
+
+    EventLoop& loop_;
+    FleetStore& store_;
+    int device_;
+    int intervalMs_;
+    int timeoutMs_;
+
+    sockaddr_in address_ = {};
+    bool resolved_ = false;
+    int fd_ = -1;
+    State state_ = STATE_IDLE;
+    std::string request_;
+    size_t sent_ = 0;
+    HttpResponseParser parser_;
+    int64_t nextPollMs_ = 0;
+    int64_t startedMs_ = 0;
+    int backoffMs_ = 0;
+};
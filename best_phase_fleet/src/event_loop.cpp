@@ -0,0 +1,96 @@
+#include "event_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+const int MAX_EVENTS = 256;
+
+EventLoop::EventLoop()
+    : epollFd_(epoll_create1(EPOLL_CLOEXEC)), running_(false), tickInterval_(100), nextTick_(0) {
+    if (epollFd_ < 0) perror("epoll_create1");
+}
+
+EventLoop::~EventLoop() {
+    if (epollFd_ >= 0) close(epollFd_);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) != 0) return false;
+    handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    handlers_.erase(fd);
+}
+
+void EventLoop::setTick(int intervalMs, std::function<void()> tick) {
+    tickInterval_ = intervalMs;
+    tick_ = std::move(tick);
+    nextTick_ = nowMs();
+}
+
+void EventLoop::run() {
+    epoll_event events[MAX_EVENTS];
+    running_ = true;
+
+    while (running_) {
+        int64_t now = nowMs();
+        if (tick_ && now >= nextTick_) {
+            tick_();
+            // Skip missed ticks rather than bursting to catch up
+            nextTick_ += tickInterval_;
+            if (nextTick_ <= now) nextTick_ = now + tickInterval_;
+        }
+
+        int timeout = tick_ ? (int)(nextTick_ - nowMs()) : -1;
+        if (tick_ && timeout < 0) timeout = 0;
+
+        int count = epoll_wait(epollFd_, events, MAX_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            auto it = handlers_.find(events[i].data.fd);
+            if (it == handlers_.end()) continue;  // Removed earlier in this batch
+            // Keep the handler alive even if it removes itself
+            std::shared_ptr<Handler> handler = it->second;
+            (*handler)(events[i].events);
+        }
+    }
+}
+
+int64_t EventLoop::nowMs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t EventLoop::wallClockMs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
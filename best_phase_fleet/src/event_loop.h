@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+// Single-threaded epoll loop. Every registered fd has one handler that is
+// called with the ready event mask; a periodic tick drives timeouts and
+// poll scheduling. Handlers may add or remove fds (including their own)
+// while running.
+class EventLoop {
+public:
+    typedef std::function<void(uint32_t events)> Handler;
+
+    EventLoop();
+    ~EventLoop();
+
+    bool add(int fd, uint32_t events, Handler handler);
+    bool modify(int fd, uint32_t events);
+    void remove(int fd);
+
+    void setTick(int intervalMs, std::function<void()> tick);
+
+    void run();
+    void stop() { running_ = false; }
+
+    // CLOCK_MONOTONIC, for scheduling
+    static int64_t nowMs();
+    // CLOCK_REALTIME, for timestamps handed to clients
+    static int64_t wallClockMs();
+
+private:
+    int epollFd_;
+    bool running_;
+    int tickInterval_;
+    int64_t nextTick_;
+    std::function<void()> tick_;
+    std::unordered_map<int, std::shared_ptr<Handler>> handlers_;
+};
+
+// Non-blocking socket helpers
+bool setNonBlocking(int fd);
@@ -0,0 +1,74 @@
+#include "fleet_store.h"
+
+DeviceSeries::DeviceSeries(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1),
+      time_(capacity_), selectedPhase_(capacity_), bestPhase_(capacity_),
+      mode_(capacity_), phaseCount_(capacity_) {
+    for (int p = 0; p < FLEET_MAX_PHASES; p++) {
+        voltage_[p].resize(capacity_);
+        avgVoltage_[p].resize(capacity_);
+    }
+}
+
+void DeviceSeries::append(const StatusSample& sample) {
+    // Keep timestamps monotonic for firstAfter() even if the wall clock steps back
+    int64_t last = size_ > 0 ? timeAt(size_ - 1) : sample.timeMs;
+    time_[head_] = sample.timeMs < last ? last : sample.timeMs;
+    selectedPhase_[head_] = sample.selectedPhase;
+    bestPhase_[head_] = sample.bestPhase;
+    mode_[head_] = sample.mode;
+    phaseCount_[head_] = sample.phaseCount;
+    for (int p = 0; p < FLEET_MAX_PHASES; p++) {
+        voltage_[p][head_] = sample.voltage[p];
+        avgVoltage_[p][head_] = sample.avgVoltage[p];
+    }
+    head_ = (head_ + 1) % capacity_;
+    if (size_ < capacity_) size_++;
+}
+
+StatusSample DeviceSeries::at(size_t index) const {
+    size_t s = slot(index);
+    StatusSample sample;
+    sample.timeMs = time_[s];
+    sample.selectedPhase = selectedPhase_[s];
+    sample.bestPhase = bestPhase_[s];
+    sample.mode = mode_[s];
+    sample.phaseCount = phaseCount_[s];
+    for (int p = 0; p < FLEET_MAX_PHASES; p++) {
+        sample.voltage[p] = voltage_[p][s];
+        sample.avgVoltage[p] = avgVoltage_[p][s];
+    }
+    return sample;
+}
+
+size_t DeviceSeries::firstAfter(int64_t sinceMs) const {
+    // Timestamps are appended in order, so binary search over logical indices
+    size_t low = 0;
+    size_t high = size_;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (timeAt(mid) <= sinceMs) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int FleetStore::addDevice(const std::string& id, const std::string& host, uint16_t port) {
+    if (index_.count(id)) return -1;
+    Device device = {DeviceInfo(), DeviceSeries(historyPerDevice_)};
+    device.info.id = id;
+    device.info.host = host;
+    device.info.port = port;
+    devices_.push_back(std::move(device));
+    int index = (int)devices_.size() - 1;
+    index_[id] = index;
+    return index;
+}
+
+int FleetStore::find(const std::string& id) const {
+    auto it = index_.find(id);
+    return it == index_.end() ? -1 : it->second;
+}
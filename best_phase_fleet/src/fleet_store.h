@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory store for the whole fleet: per-device connection info plus a
+// fixed-capacity history of status samples. History is kept column-wise
+// (one array per field) so a query that reads one field over time, or one
+// field across every device, walks contiguous memory.
+
+const int FLEET_MAX_PHASES = 4;  // Largest PHASE_TABLE the firmware supports
+
+enum DeviceMode : uint8_t { DEVICE_MODE_UNKNOWN, DEVICE_MODE_AUTOMATIC, DEVICE_MODE_MANUAL };
+
+struct StatusSample {
+    int64_t timeMs = 0;       // Wall clock when the status arrived
+    int8_t selectedPhase = -1;
+    int8_t bestPhase = -1;
+    uint8_t mode = DEVICE_MODE_UNKNOWN;
+    uint8_t phaseCount = 0;
+    float voltage[FLEET_MAX_PHASES] = {};
+    float avgVoltage[FLEET_MAX_PHASES] = {};
+};
+
+class DeviceSeries {
+public:
+    explicit DeviceSeries(size_t capacity);
+
+    void append(const StatusSample& sample);
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+    // Index 0 is the oldest retained sample
+    int64_t timeAt(size_t index) const { return time_[slot(index)]; }
+    float voltageAt(int phase, size_t index) const { return voltage_[phase][slot(index)]; }
+    float avgVoltageAt(int phase, size_t index) const { return avgVoltage_[phase][slot(index)]; }
+    int8_t selectedPhaseAt(size_t index) const { return selectedPhase_[slot(index)]; }
+    StatusSample at(size_t index) const;
+
+    // First index with a timestamp after `sinceMs` (size() if none)
+    size_t firstAfter(int64_t sinceMs) const;
+
+private:
+    size_t slot(size_t index) const { return (head_ + capacity_ - size_ + index) % capacity_; }
+
+    size_t capacity_;
+    size_t head_ = 0;   // Next slot to write
+    size_t size_ = 0;
+    std::vector<int64_t> time_;
+    std::vector<int8_t> selectedPhase_;
+    std::vector<int8_t> bestPhase_;
+    std::vector<uint8_t> mode_;
+    std::vector<uint8_t> phaseCount_;
+    std::vector<float> voltage_[FLEET_MAX_PHASES];
+    std::vector<float> avgVoltage_[FLEET_MAX_PHASES];
+};
+
+struct DeviceInfo {
+    std::string id;
+    std::string host;
+    uint16_t port = 80;
+    std::vector<std::string> phaseNames;
+
+    bool online = false;
+    int64_t lastSeenMs = 0;      // Wall clock of the last good status
+    uint32_t polls = 0;
+    uint32_t failures = 0;
+    uint32_t consecutiveFailures = 0;
+    uint32_t lastLatencyMs = 0;
+    std::string lastError;
+};
+
+class FleetStore {
+public:
+    explicit FleetStore(size_t historyPerDevice) : historyPerDevice_(historyPerDevice) {}
+
+    // Returns the device index, or -1 if the id is already taken
+    int addDevice(const std::string& id, const std::string& host, uint16_t port);
+    int find(const std::string& id) const;
+
+    size_t deviceCount() const { return devices_.size(); }
+    DeviceInfo& info(int device) { return devices_[device].info; }
+    const DeviceInfo& info(int device) const { return devices_[device].info; }
+    DeviceSeries& series(int device) { return devices_[device].series; }
+    const DeviceSeries& series(int device) const { return devices_[device].series; }
+
+private:
+    struct Device {
+        DeviceInfo info;
+        DeviceSeries series;
+    };
+
+    size_t historyPerDevice_;
+    std::vector<Device> devices_;
+    std::unordered_map<std::string, int> index_;
+};
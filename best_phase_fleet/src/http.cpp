@@ -0,0 +1,246 @@
+#include "http.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+static std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return s;
+}
+
+static std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+// Parses "Name: value" lines between `start` and `end` into `headers`.
+static void parseHeaderLines(const std::string& text, size_t start, size_t end,
+                             std::map<std::string, std::string>& headers) {
+    while (start < end) {
+        size_t lineEnd = text.find("\r\n", start);
+        if (lineEnd == std::string::npos || lineEnd > end) lineEnd = end;
+        size_t colon = text.find(':', start);
+        if (colon != std::string::npos && colon < lineEnd) {
+            headers[toLower(text.substr(start, colon - start))] =
+                trim(text.substr(colon + 1, lineEnd - colon - 1));
+        }
+        start = lineEnd + 2;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Responses
+// ---------------------------------------------------------------------------
+
+void HttpResponseParser::reset() {
+    buffer_.clear();
+    bodyStart_ = 0;
+    contentLength_ = 0;
+    mode_ = BODY_UNKNOWN;
+    response_ = HttpResponse();
+}
+
+HttpResponseParser::Result HttpResponseParser::feed(const char* data, size_t length) {
+    buffer_.append(data, length);
+    if (mode_ == BODY_UNKNOWN) {
+        Result result = parseHeaders();
+        if (result != COMPLETE) return result;
+    }
+    return parseBody();
+}
+
+HttpResponseParser::Result HttpResponseParser::finish() {
+    if (mode_ != BODY_UNTIL_CLOSE) return FAILED;
+    response_.body = buffer_.substr(bodyStart_);
+    response_.keepAlive = false;
+    return COMPLETE;
+}
+
+HttpResponseParser::Result HttpResponseParser::parseHeaders() {
+    size_t headerEnd = buffer_.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        return buffer_.size() > HTTP_MAX_HEADER ? FAILED : INCOMPLETE;
+    }
+
+    // Status line: HTTP/1.x NNN Reason
+    size_t lineEnd = buffer_.find("\r\n");
+    if (buffer_.compare(0, 5, "HTTP/") != 0) return FAILED;
+    size_t space = buffer_.find(' ');
+    if (space == std::string::npos || space > lineEnd) return FAILED;
+    response_.status = atoi(buffer_.c_str() + space + 1);
+    bool http11 = buffer_.compare(0, 8, "HTTP/1.1") == 0;
+
+    parseHeaderLines(buffer_, lineEnd + 2, headerEnd, response_.headers);
+    bodyStart_ = headerEnd + 4;
+
+    std::string connection = toLower(response_.headers["connection"]);
+    response_.keepAlive = http11 ? connection != "close" : connection == "keep-alive";
+
+    auto encoding = response_.headers.find("transfer-encoding");
+    auto length = response_.headers.find("content-length");
+    if (encoding != response_.headers.end() && toLower(encoding->second) == "chunked") {
+        mode_ = BODY_CHUNKED;
+    } else if (length != response_.headers.end()) {
+        mode_ = BODY_LENGTH;
+        contentLength_ = strtoul(length->second.c_str(), nullptr, 10);
+        if (contentLength_ > HTTP_MAX_BODY) return FAILED;
+    } else if (response_.status == 204 || response_.status == 304) {
+        mode_ = BODY_LENGTH;
+        contentLength_ = 0;
+    } else {
+        mode_ = BODY_UNTIL_CLOSE;
+        response_.keepAlive = false;
+    }
+    return COMPLETE;
+}
+
+HttpResponseParser::Result HttpResponseParser::parseBody() {
+    switch (mode_) {
+        case BODY_LENGTH:
+            if (buffer_.size() - bodyStart_ < contentLength_) return INCOMPLETE;
+            response_.body = buffer_.substr(bodyStart_, contentLength_);
+            return COMPLETE;
+
+        case BODY_UNTIL_CLOSE:
+            return buffer_.size() - bodyStart_ > HTTP_MAX_BODY ? FAILED : INCOMPLETE;
+
+        case BODY_CHUNKED: {
+            // Bodies are small, so decode from the start on every call
+            // instead of keeping chunk state between reads.
+            std::string body;
+            size_t pos = bodyStart_;
+            for (;;) {
+                size_t lineEnd = buffer_.find("\r\n", pos);
+                if (lineEnd == std::string::npos) return INCOMPLETE;
+                char* end = nullptr;
+                unsigned long size = strtoul(buffer_.c_str() + pos, &end, 16);
+                if (end == buffer_.c_str() + pos) return FAILED;
+                if (body.size() + size > HTTP_MAX_BODY) return FAILED;
+                pos = lineEnd + 2;
+                if (size == 0) {
+                    // Trailer section ends with an empty line
+                    if (buffer_.find("\r\n", pos) == std::string::npos) return INCOMPLETE;
+                    response_.body = std::move(body);
+                    return COMPLETE;
+                }
+                if (buffer_.size() < pos + size + 2) return INCOMPLETE;
+                body.append(buffer_, pos, size);
+                pos += size + 2;
+            }
+        }
+
+        case BODY_UNKNOWN:
+            break;
+    }
+    return FAILED;
+}
+
+// ---------------------------------------------------------------------------
+// Requests
+// ---------------------------------------------------------------------------
+
+long parseHttpRequest(const std::string& buffer, HttpRequest& request) {
+    size_t headerEnd = buffer.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        return buffer.size() > HTTP_MAX_HEADER ? -1 : 0;
+    }
+
+    size_t lineEnd = buffer.find("\r\n");
+    size_t methodEnd = buffer.find(' ');
+    if (methodEnd == std::string::npos || methodEnd > lineEnd) return -1;
+    size_t targetEnd = buffer.find(' ', methodEnd + 1);
+    if (targetEnd == std::string::npos || targetEnd > lineEnd) return -1;
+
+    request = HttpRequest();
+    request.method = buffer.substr(0, methodEnd);
+    std::string target = buffer.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string::npos) request.query = target.substr(question + 1);
+
+    parseHeaderLines(buffer, lineEnd + 2, headerEnd, request.headers);
+
+    bool http11 = buffer.compare(targetEnd + 1, 8, "HTTP/1.1") == 0;
+    std::string connection = toLower(request.headers["connection"]);
+    request.keepAlive = http11 ? connection != "close" : connection == "keep-alive";
+
+    size_t consumed = headerEnd + 4;
+    auto length = request.headers.find("content-length");
+    if (length != request.headers.end()) {
+        size_t bodyLength = strtoul(length->second.c_str(), nullptr, 10);
+        if (bodyLength > HTTP_MAX_BODY) return -1;
+        if (buffer.size() < consumed + bodyLength) return 0;
+        consumed += bodyLength;
+    }
+    return (long)consumed;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static std::string urlDecode(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0) {
+            out += (char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+bool queryParam(const std::string& query, const char* name, std::string& value) {
+    size_t nameLength = strlen(name);
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) end = query.size();
+        if (end - pos >= nameLength && query.compare(pos, nameLength, name) == 0 &&
+            (end - pos == nameLength || query[pos + nameLength] == '=')) {
+            size_t valueStart = std::min(pos + nameLength + 1, end);
+            value = urlDecode(query.substr(valueStart, end - valueStart));
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+static const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 429: return "Too Many Requests";
+        case 503: return "Service Unavailable";
+    }
+    return "Error";
+}
+
+std::string formatHttpResponse(int status, const char* contentType, const std::string& body,
+                               bool keepAlive) {
+    char header[256];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 %d %s\r\n"
+             "Content-Type: %s\r\n"
+             "Content-Length: %zu\r\n"
+             "Connection: %s\r\n"
+             "\r\n",
+             status, statusText(status), contentType, body.size(), keepAlive ? "keep-alive" : "close");
+    return header + body;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <map>
+#include <string>
+
+// Minimal HTTP/1.1 for talking to detectors and serving the aggregated API.
+// Header names are stored lower-case.
+
+const size_t HTTP_MAX_HEADER = 8192;
+const size_t HTTP_MAX_BODY = 256 * 1024;
+
+struct HttpResponse {
+    int status = 0;
+    std::map<std::string, std::string> headers;
+    std::string body;
+    bool keepAlive = false;
+};
+
+// Incremental response parser: feed() whatever recv() returned until it
+// reports COMPLETE. Handles Content-Length, chunked and close-delimited
+// bodies (the ESP32 WebServer uses all three).
+class HttpResponseParser {
+public:
+    enum Result { INCOMPLETE, COMPLETE, FAILED };
+
+    void reset();
+    Result feed(const char* data, size_t length);
+    // Peer closed the connection; completes a close-delimited body.
+    Result finish();
+
+    const HttpResponse& response() const { return response_; }
+
+private:
+    enum BodyMode { BODY_UNKNOWN, BODY_LENGTH, BODY_CHUNKED, BODY_UNTIL_CLOSE };
+
+    Result parseHeaders();
+    Result parseBody();
+
+    std::string buffer_;
+    size_t bodyStart_ = 0;
+    size_t contentLength_ = 0;
+    BodyMode mode_ = BODY_UNKNOWN;
+    HttpResponse response_;
+};
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string query;  // Without the leading '?'
+    std::map<std::string, std::string> headers;
+    bool keepAlive = true;
+};
+
+// Parses one request (headers only; request bodies are skipped) from the
+// front of `buffer`. Returns the number of bytes consumed, 0 if more data is
+// needed, or -1 on a malformed or oversized request.
+long parseHttpRequest(const std::string& buffer, HttpRequest& request);
+
+// Value of `name` in an application/x-www-form-urlencoded query string.
+bool queryParam(const std::string& query, const char* name, std::string& value);
+
+std::string formatHttpResponse(int status, const char* contentType, const std::string& body,
+                               bool keepAlive);
@@ -0,0 +1,205 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int MAX_DEPTH = 32;
+
+namespace {
+
+class Parser {
+public:
+    explicit Parser(const std::string& text) : p_(text.c_str()), end_(text.c_str() + text.size()) {}
+
+    bool parseDocument(JsonValue& out) {
+        if (!parseValue(out, 0)) return false;
+        skipWhitespace();
+        return p_ == end_;
+    }
+
+private:
+    void skipWhitespace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) p_++;
+    }
+
+    bool literal(const char* word) {
+        size_t length = strlen(word);
+        if ((size_t)(end_ - p_) < length || memcmp(p_, word, length) != 0) return false;
+        p_ += length;
+        return true;
+    }
+
+    bool parseValue(JsonValue& out, int depth) {
+        if (depth > MAX_DEPTH) return false;
+        skipWhitespace();
+        if (p_ >= end_) return false;
+
+        switch (*p_) {
+            case '{': return parseObject(out, depth);
+            case '[': return parseArray(out, depth);
+            case '"': out.type = JsonValue::STRING; return parseString(out.string);
+            case 't': out.type = JsonValue::BOOLEAN; out.boolean = true; return literal("true");
+            case 'f': out.type = JsonValue::BOOLEAN; out.boolean = false; return literal("false");
+            case 'n': out.type = JsonValue::NUL; return literal("null");
+        }
+        return parseNumber(out);
+    }
+
+    bool parseNumber(JsonValue& out) {
+        // strtod would accept inf/nan/hex, so check the first character
+        if (*p_ != '-' && (*p_ < '0' || *p_ > '9')) return false;
+        char* end = nullptr;
+        out.number = strtod(p_, &end);
+        if (end == p_ || end > end_) return false;
+        out.type = JsonValue::NUMBER;
+        p_ = end;
+        return true;
+    }
+
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static void appendUtf8(std::string& out, unsigned codepoint) {
+        if (codepoint < 0x80) {
+            out += (char)codepoint;
+        } else if (codepoint < 0x800) {
+            out += (char)(0xC0 | (codepoint >> 6));
+            out += (char)(0x80 | (codepoint & 0x3F));
+        } else {
+            out += (char)(0xE0 | (codepoint >> 12));
+            out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+            out += (char)(0x80 | (codepoint & 0x3F));
+        }
+    }
+
+    bool parseString(std::string& out) {
+        p_++;  // Opening quote
+        out.clear();
+        while (p_ < end_) {
+            char c = *p_++;
+            if (c == '"') return true;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p_ >= end_) return false;
+            char escape = *p_++;
+            switch (escape) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    if (end_ - p_ < 4) return false;
+                    unsigned codepoint = 0;
+                    for (int i = 0; i < 4; i++) {
+                        int digit = hexDigit(p_[i]);
+                        if (digit < 0) return false;
+                        codepoint = codepoint * 16 + digit;
+                    }
+                    p_ += 4;
+                    // Surrogate pairs are not expected from the firmware
+                    appendUtf8(out, codepoint >= 0xD800 && codepoint <= 0xDFFF ? 0xFFFD : codepoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool parseArray(JsonValue& out, int depth) {
+        p_++;
+        out.type = JsonValue::ARRAY;
+        skipWhitespace();
+        if (p_ < end_ && *p_ == ']') { p_++; return true; }
+        for (;;) {
+            out.items.emplace_back();
+            if (!parseValue(out.items.back(), depth + 1)) return false;
+            skipWhitespace();
+            if (p_ >= end_) return false;
+            if (*p_ == ']') { p_++; return true; }
+            if (*p_++ != ',') return false;
+        }
+    }
+
+    bool parseObject(JsonValue& out, int depth) {
+        p_++;
+        out.type = JsonValue::OBJECT;
+        skipWhitespace();
+        if (p_ < end_ && *p_ == '}') { p_++; return true; }
+        for (;;) {
+            skipWhitespace();
+            if (p_ >= end_ || *p_ != '"') return false;
+            out.members.emplace_back();
+            if (!parseString(out.members.back().first)) return false;
+            skipWhitespace();
+            if (p_ >= end_ || *p_++ != ':') return false;
+            if (!parseValue(out.members.back().second, depth + 1)) return false;
+            skipWhitespace();
+            if (p_ >= end_) return false;
+            if (*p_ == '}') { p_++; return true; }
+            if (*p_++ != ',') return false;
+        }
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+}  // namespace
+
+const JsonValue* JsonValue::get(const char* key) const {
+    if (type != OBJECT) return nullptr;
+    for (const auto& member : members) {
+        if (member.first == key) return &member.second;
+    }
+    return nullptr;
+}
+
+double JsonValue::numberOr(const char* key, double fallback) const {
+    const JsonValue* value = get(key);
+    return value && value->type == NUMBER ? value->number : fallback;
+}
+
+std::string JsonValue::stringOr(const char* key, const char* fallback) const {
+    const JsonValue* value = get(key);
+    return value && value->type == STRING ? value->string : fallback;
+}
+
+bool parseJson(const std::string& text, JsonValue& out) {
+    out = JsonValue();
+    return Parser(text).parseDocument(out);
+}
+
+void appendJsonString(std::string& out, const std::string& value) {
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+    out += '"';
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Small DOM JSON reader for detector status documents, plus string escaping
+// for the responses we build by hand.
+
+struct JsonValue {
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;                               // ARRAY
+    std::vector<std::pair<std::string, JsonValue>> members;     // OBJECT, in document order
+
+    // Member lookup; nullptr if this is not an object or the key is missing
+    const JsonValue* get(const char* key) const;
+
+    double numberOr(const char* key, double fallback) const;
+    std::string stringOr(const char* key, const char* fallback) const;
+};
+
+bool parseJson(const std::string& text, JsonValue& out);
+
+// Appends `value` as a quoted JSON string.
+void appendJsonString(std::string& out, const std::string& value);
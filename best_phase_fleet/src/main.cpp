@@ -0,0 +1,188 @@
+// Best Phase Fleet Aggregator
+//
+// Polls /api/status on many detectors from one epoll thread, keeps the
+// latest readings plus a rolling history in memory and serves an
+// aggregated API. Usage:
+//
+//   bpd_fleet [-l port] [-i interval_ms] [-t timeout_ms] [-H samples]
+//             [-d] [-f devices.txt] [[id=]host[:port] ...]
+//
+// devices.txt holds one `[id=]host[:port]` per line; '#' starts a comment.
+// With -d, detectors advertising _bpd._tcp over mDNS are added as they are
+// found, and a known device that moves to a new address is followed.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api_server.h"
+#include "device_poller.h"
+#include "event_loop.h"
+#include "fleet_store.h"
+#include "mdns_browser.h"
+
+const int TICK_INTERVAL = 20;  // ms; resolution of poll scheduling and timeouts
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-l port] [-i interval_ms] [-t timeout_ms] [-H samples]\n"
+            "          [-d] [-f devices.txt] [[id=]host[:port] ...]\n"
+            "  -l  API listen port (default 8080)\n"
+            "  -i  Poll interval per device (default 1000)\n"
+            "  -t  Request timeout (default 3000)\n"
+            "  -H  History samples kept per device (default 3600)\n"
+            "  -d  Discover devices over mDNS (_bpd._tcp)\n"
+            "  -f  Device list, one [id=]host[:port] per line\n",
+            program);
+}
+
+// Parses `[id=]host[:port]`; the id defaults to host:port.
+static bool addDevice(FleetStore& store, std::string spec) {
+    size_t hash = spec.find('#');
+    if (hash != std::string::npos) spec.erase(hash);
+    spec.erase(0, spec.find_first_not_of(" \t"));
+    spec.erase(spec.find_last_not_of(" \t\r") + 1);
+    if (spec.empty()) return true;
+
+    std::string id;
+    size_t equals = spec.find('=');
+    if (equals != std::string::npos) {
+        id = spec.substr(0, equals);
+        spec.erase(0, equals + 1);
+    }
+
+    std::string host = spec;
+    unsigned long port = 80;
+    size_t colon = spec.rfind(':');
+    if (colon != std::string::npos) {
+        host = spec.substr(0, colon);
+        port = strtoul(spec.c_str() + colon + 1, nullptr, 10);
+        if (port == 0 || port > 65535) {
+            fprintf(stderr, "Invalid port in '%s'\n", spec.c_str());
+            return false;
+        }
+    }
+    if (id.empty()) id = host + ":" + std::to_string(port);
+
+    if (store.addDevice(id, host, (uint16_t)port) < 0) {
+        fprintf(stderr, "Duplicate device id '%s'\n", id.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int listenPort = 8080;
+    int interval = 1000;
+    int timeout = 3000;
+    int history = 3600;
+    bool discover = false;
+    std::vector<std::string> deviceFiles;
+
+    int option;
+    while ((option = getopt(argc, argv, "l:i:t:H:df:h")) != -1) {
+        switch (option) {
+            case 'l': listenPort = atoi(optarg); break;
+            case 'i': interval = atoi(optarg); break;
+            case 't': timeout = atoi(optarg); break;
+            case 'H': history = atoi(optarg); break;
+            case 'd': discover = true; break;
+            case 'f': deviceFiles.push_back(optarg); break;
+            default:
+                usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+    if (interval < TICK_INTERVAL || timeout <= 0 || history <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FleetStore store(history);
+    for (const std::string& path : deviceFiles) {
+        std::ifstream file(path);
+        if (!file) {
+            fprintf(stderr, "Cannot open %s\n", path.c_str());
+            return 1;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!addDevice(store, line)) return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!addDevice(store, argv[i])) return 1;
+    }
+    if (store.deviceCount() == 0 && !discover) {
+        fprintf(stderr, "No devices configured\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    EventLoop loop;
+    ApiServer api(loop, store);
+    if (!api.listen(listenPort)) {
+        fprintf(stderr, "Cannot listen on port %d\n", listenPort);
+        return 1;
+    }
+
+    // Spread first polls over one interval so the fleet is not hit at once
+    std::vector<std::unique_ptr<DevicePoller>> pollers;
+    int64_t start = EventLoop::nowMs();
+    size_t count = store.deviceCount();
+    for (size_t d = 0; d < count; d++) {
+        pollers.emplace_back(new DevicePoller(loop, store, d, interval, timeout));
+        pollers.back()->start(start + (int64_t)interval * d / count);
+    }
+
+    // Pollers are indexed like the store's devices
+    MdnsBrowser browser(loop, [&](const std::string& id, const std::string& host, uint16_t port) {
+        int device = store.find(id);
+        if (device < 0) {
+            device = store.addDevice(id, host, port);
+            pollers.emplace_back(new DevicePoller(loop, store, device, interval, timeout));
+            pollers.back()->start(EventLoop::nowMs());
+            fprintf(stderr, "%s: discovered at %s:%u\n", id.c_str(), host.c_str(), port);
+        } else if (store.info(device).host != host || store.info(device).port != port) {
+            store.info(device).host = host;
+            store.info(device).port = port;
+            pollers[device]->addressChanged();
+            fprintf(stderr, "%s: moved to %s:%u\n", id.c_str(), host.c_str(), port);
+        }
+    });
+    if (discover && !browser.start()) {
+        fprintf(stderr, "mDNS discovery unavailable\n");
+    }
+
+    loop.setTick(TICK_INTERVAL, [&]() {
+        if (stopRequested) {
+            loop.stop();
+            return;
+        }
+        int64_t now = EventLoop::nowMs();
+        if (discover) browser.tick(now);
+        for (size_t i = 0; i < pollers.size(); i++) pollers[i]->tick(now);
+    });
+
+    fprintf(stderr, "Polling %zu devices every %d ms, API on port %d\n", count, interval, listenPort);
+    loop.run();
+    fprintf(stderr, "Stopped\n");
+    return 0;
+}
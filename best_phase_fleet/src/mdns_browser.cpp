@@ -0,0 +1,200 @@
+#include "mdns_browser.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+const char* MDNS_GROUP = "224.0.0.251";
+const uint16_t MDNS_PORT = 5353;
+const char* SERVICE_NAME = "_bpd._tcp.local";
+
+const uint16_t TYPE_A = 1;
+const uint16_t TYPE_PTR = 12;
+const uint16_t TYPE_TXT = 16;
+const uint16_t TYPE_SRV = 33;
+
+static uint16_t read16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static std::string lowerCase(std::string s) {
+    for (char& c : s) c = (char)tolower((unsigned char)c);
+    return s;
+}
+
+// Decodes a possibly compressed name at `offset`. On success `offset` is
+// moved past the name as it appears in place.
+static bool readName(const uint8_t* packet, size_t length, size_t& offset, std::string& name) {
+    name.clear();
+    size_t pos = offset;
+    bool jumped = false;
+    int jumps = 0;
+
+    while (pos < length) {
+        uint8_t label = packet[pos];
+        if (label == 0) {
+            if (!jumped) offset = pos + 1;
+            return true;
+        }
+        if ((label & 0xC0) == 0xC0) {
+            if (pos + 1 >= length || ++jumps > 16) return false;
+            if (!jumped) offset = pos + 2;
+            jumped = true;
+            pos = ((label & 0x3F) << 8) | packet[pos + 1];
+            continue;
+        }
+        if (pos + 1 + label > length) return false;
+        if (!name.empty()) name += '.';
+        name.append((const char*)packet + pos + 1, label);
+        pos += 1 + label;
+    }
+    return false;
+}
+
+MdnsBrowser::~MdnsBrowser() {
+    if (fd_ >= 0) {
+        loop_.remove(fd_);
+        close(fd_);
+    }
+}
+
+bool MdnsBrowser::start() {
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) return false;
+
+    // Share the port with any system responder (avahi)
+    int reuse = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(MDNS_PORT);
+    if (bind(fd_, (sockaddr*)&address, sizeof(address)) != 0) {
+        perror("mdns bind");
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    ip_mreq membership = {};
+    inet_pton(AF_INET, MDNS_GROUP, &membership.imr_multiaddr);
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+        perror("mdns membership");
+    }
+
+    return loop_.add(fd_, EPOLLIN, [this](uint32_t) { onReadable(); });
+}
+
+void MdnsBrowser::tick(int64_t now) {
+    if (fd_ < 0 || now < nextQueryMs_) return;
+    nextQueryMs_ = now + QUERY_INTERVAL_MS;
+    sendQuery();
+}
+
+void MdnsBrowser::sendQuery() {
+    std::vector<uint8_t> packet = {0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0};  // One question
+    const char* label = SERVICE_NAME;
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        size_t size = dot ? (size_t)(dot - label) : strlen(label);
+        packet.push_back((uint8_t)size);
+        packet.insert(packet.end(), label, label + size);
+        label += size + (dot ? 1 : 0);
+    }
+    packet.push_back(0);
+    packet.insert(packet.end(), {0, TYPE_PTR, 0, 1});  // PTR, class IN
+
+    sockaddr_in group = {};
+    group.sin_family = AF_INET;
+    group.sin_port = htons(MDNS_PORT);
+    inet_pton(AF_INET, MDNS_GROUP, &group.sin_addr);
+    sendto(fd_, packet.data(), packet.size(), 0, (sockaddr*)&group, sizeof(group));
+}
+
+void MdnsBrowser::onReadable() {
+    uint8_t packet[1500];
+    ssize_t n;
+    while ((n = recv(fd_, packet, sizeof(packet), 0)) > 0) {
+        parsePacket(packet, n);
+    }
+    report();
+}
+
+void MdnsBrowser::parsePacket(const uint8_t* packet, size_t length) {
+    if (length < 12) return;
+    if (!(packet[2] & 0x80)) return;  // Queries, not responses
+
+    size_t pos = 12;
+    std::string name;
+    for (int q = read16(packet + 4); q > 0; q--) {
+        if (!readName(packet, length, pos, name) || pos + 4 > length) return;
+        pos += 4;
+    }
+
+    // Answers, authority and additional records are treated alike
+    int records = read16(packet + 6) + read16(packet + 8) + read16(packet + 10);
+    std::string suffix = std::string(".") + SERVICE_NAME;
+    for (; records > 0; records--) {
+        if (!readName(packet, length, pos, name) || pos + 10 > length) return;
+        uint16_t type = read16(packet + pos);
+        uint16_t dataLength = read16(packet + pos + 8);
+        size_t data = pos + 10;
+        pos = data + dataLength;
+        if (pos > length) return;
+        name = lowerCase(name);
+        bool isInstance = name.size() > suffix.size() &&
+                          name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+
+        if (type == TYPE_PTR && name == SERVICE_NAME) {
+            std::string instance;
+            size_t offset = data;
+            if (readName(packet, length, offset, instance)) instances_[lowerCase(instance)];
+        } else if (type == TYPE_SRV && dataLength > 6 && isInstance) {
+            Instance& instance = instances_[name];
+            instance.port = read16(packet + data + 4);
+            size_t offset = data + 6;
+            readName(packet, length, offset, instance.target);
+            instance.target = lowerCase(instance.target);
+        } else if (type == TYPE_TXT && isInstance) {
+            // Length-prefixed key=value strings. Kept even if the PTR or SRV
+            // has not arrived yet; responders may order records either way.
+            size_t offset = data;
+            while (offset < data + dataLength) {
+                uint8_t size = packet[offset];
+                if (offset + 1 + size > data + dataLength) break;
+                std::string entry((const char*)packet + offset + 1, size);
+                if (entry.compare(0, 3, "id=") == 0) instances_[name].id = entry.substr(3);
+                offset += 1 + size;
+            }
+        } else if (type == TYPE_A && dataLength == 4) {
+            char address[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, packet + data, address, sizeof(address));
+            addresses_[name] = address;
+        }
+    }
+}
+
+void MdnsBrowser::report() {
+    for (auto& entry : instances_) {
+        Instance& instance = entry.second;
+        auto address = addresses_.find(instance.target);
+        if (instance.port == 0 || address == addresses_.end()) continue;
+
+        std::string current = address->second + ":" + std::to_string(instance.port);
+        if (current == instance.reported) continue;
+        instance.reported = current;
+
+        std::string id = instance.id.empty() ? entry.first.substr(0, entry.first.find('.')) : instance.id;
+        callback_(id, address->second, instance.port);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "event_loop.h"
+
+// Minimal DNS-SD browser for _bpd._tcp.local: periodically multicasts a PTR
+// query and assembles PTR/SRV/TXT/A records from the answers, in whatever
+// order they arrive. Reports each device once it knows its address, and
+// again whenever the address changes.
+class MdnsBrowser {
+public:
+    typedef std::function<void(const std::string& id, const std::string& host, uint16_t port)> Callback;
+
+    MdnsBrowser(EventLoop& loop, Callback callback) : loop_(loop), callback_(std::move(callback)) {}
+    ~MdnsBrowser();
+
+    bool start();
+    // Re-sends the query every QUERY_INTERVAL_MS
+    void tick(int64_t now);
+
+private:
+    static const int QUERY_INTERVAL_MS = 30000;
+
+    struct Instance {
+        std::string target;     // SRV target host name
+        uint16_t port = 0;
+        std::string id;         // TXT id=
+        std::string reported;   // host:port last passed to the callback
+    };
+
+    void sendQuery();
+    void onReadable();
+    void parsePacket(const uint8_t* packet, size_t length);
+    void report();
+
+    EventLoop& loop_;
+    Callback callback_;
+    int fd_ = -1;
+    int64_t nextQueryMs_ = 0;
+    std::map<std::string, Instance> instances_;       // By service instance name
+    std::map<std::string, std::string> addresses_;    // Host name -> IPv4
+};
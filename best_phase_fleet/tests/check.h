@@ -0,0 +1,27 @@
+#pragma once
+
+// Assertions for the host tests of the firmware headers. A failed check is
+// printed and counted, and main() returns checkResult() so ctest sees it.
+
+#include <cstdio>
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+// Prints at most the first few failures of a sweep; the count is exact
+inline void check(bool condition, const char* what) {
+    if (condition) return;
+    if (checkFailures() < 20) std::printf("FAIL: %s\n", what);
+    checkFailures()++;
+}
+
+inline int checkResult(const char* name) {
+    if (checkFailures() > 0) {
+        std::printf("%s: %d checks failed\n", name, checkFailures());
+        return 1;
+    }
+    std::printf("%s: checks passed\n", name);
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Idempotency of the firmware's command queue (command_queue.h): a retry
+// with the key of a finished command gets that command back, also after its
+// queue slot has been reused, until the key cache entry expires.
+
+#include <cstdint>
+#include <cstdio>
+
+#include "check.h"
+#include "command_queue.h"
+
+namespace {
+
+const uint32_t KEY_TTL = 600000;
+typedef CommandQueue<4, 8> Queue;
+
+// Queues and finishes a keyless command, pushing older ones out of the slots
+void churn(Queue& queue, int count, uint32_t now) {
+    bool duplicate;
+    for (int i = 0; i < count; i++) {
+        Command* command = queue.submit(COMMAND_SET_MODE, 0, "", now, duplicate);
+        queue.complete(command, COMMAND_DONE, nullptr, now);
+    }
+}
+
+void testRetryAfterSlotReuse() {
+    Queue queue(KEY_TTL);
+    bool duplicate;
+    Command* command = queue.submit(COMMAND_SET_PHASE, 1, "retry", 1000, duplicate);
+    uint32_t id = command->id;
+    queue.complete(command, COMMAND_REJECTED, "target voltage too low", 1500);
+
+    churn(queue, 10, 2000);
+    Command* retry = queue.submit(COMMAND_SET_PHASE, 1, "retry", 3000, duplicate);
+    check(duplicate, "retry after slot reuse queued a new command");
+    check(retry->id == id && retry->state == COMMAND_REJECTED, "retry did not return the original outcome");
+    check(queue.find(id, 3000) == retry, "finished keyed command not found by id after slot reuse");
+    check(queue.nextPending() == nullptr, "retry left a pending command");
+}
+
+void testKeyExpires() {
+    Queue queue(KEY_TTL);
+    bool duplicate;
+    Command* command = queue.submit(COMMAND_SET_PHASE, 1, "old", 0, duplicate);
+    uint32_t id = command->id;
+    queue.complete(command, COMMAND_DONE, nullptr, 100);
+
+    churn(queue, 10, 200);
+    check(queue.find(id, 100 + KEY_TTL) == nullptr, "key cache entry outlived its TTL");
+    Command* again = queue.submit(COMMAND_SET_PHASE, 1, "old", 100 + KEY_TTL, duplicate);
+    check(!duplicate && again->id != id && again->state == COMMAND_PENDING,
+          "expired key did not queue a new command");
+}
+
+// A full cache drops its oldest result first
+void testOldestKeyDropped() {
+    Queue queue(KEY_TTL);
+    bool duplicate;
+    char key[COMMAND_KEY_LENGTH];
+    for (int i = 0; i < 9; i++) {
+        std::snprintf(key, sizeof(key), "key%d", i);
+        Command* command = queue.submit(COMMAND_SET_MODE, 0, key, 0, duplicate);
+        queue.complete(command, COMMAND_DONE, nullptr, 0);
+    }
+    churn(queue, 4, 0);
+
+    queue.submit(COMMAND_SET_MODE, 0, "key1", 0, duplicate);
+    check(duplicate, "recent key lost from the cache");
+    queue.submit(COMMAND_SET_MODE, 0, "key0", 0, duplicate);
+    check(!duplicate, "oldest key kept in a full cache");
+}
+
+// A pending command is superseded by a newer one of its type, and a retry
+// of the superseded one reports that instead of queueing it again
+void testSupersededRetry() {
+    Queue queue(KEY_TTL);
+    bool duplicate;
+    Command* first = queue.submit(COMMAND_SET_PHASE, 0, "first", 0, duplicate);
+    uint32_t firstId = first->id;
+    queue.submit(COMMAND_SET_PHASE, 2, "second", 10, duplicate);
+    churn(queue, 6, 20);
+
+    Command* retry = queue.submit(COMMAND_SET_PHASE, 0, "first", 30, duplicate);
+    check(duplicate && retry->id == firstId && retry->state == COMMAND_SUPERSEDED,
+          "retry of a superseded command not answered from the cache");
+    Command* pending = queue.nextPending();
+    check(pending && pending->argument == 2, "newer command no longer pending");
+}
+
+}  // namespace
+
+int main() {
+    testRetryAfterSlotReuse();
+    testKeyExpires();
+    testOldestKeyDropped();
+    testSupersededRetry();
+    return checkResult("command_queue");
+}
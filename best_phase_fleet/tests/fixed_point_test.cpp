@@ -0,0 +1,237 @@
+// Equivalence of the firmware's Q16.16 pipeline (phase_math.h,
+// USE_FIXED_POINT=1) with the float reference over generated inputs:
+//
+//   RmsAccumulator::rms()  vs rmsFromSamples()   within 0.004 V
+//   emaQ16()               vs ema()              within 0.004 V
+//   scorePhaseQ16()        vs scorePhase()       within 0.002 points
+//
+// and a host timing comparison of each pair. The on-target cycle counts
+// come from the bench environment (src/bench/bench_main.cpp).
+//
+//   fixed_point_test [timing iterations]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "phase_math.h"
+#include "sensor_config.h"
+
+namespace {
+
+const float RMS_TOLERANCE_V = 0.004f;
+const float EMA_TOLERANCE_V = 0.004f;
+const float SCORE_TOLERANCE = 0.002f;
+
+const float VOLTS_PER_COUNT = VREF / ADC_MAX * CALIBRATION_FACTOR;
+
+// Results land here so the compiler cannot drop the timed loops
+volatile float sinkFloat;
+volatile int32_t sinkInt;
+
+struct Worst {
+    double error = 0.0;
+    long compared = 0;
+
+    void add(double reference, double fixed) {
+        error = std::max(error, std::fabs(reference - fixed));
+        compared++;
+    }
+};
+
+// One ADC window: a sine of `rmsVolts` around `offset` counts with
+// harmonics and noise, clipped to the 12-bit range like the real ADC
+void generateWindow(std::mt19937& random, std::vector<int>& window, float rmsVolts, float offset) {
+    std::uniform_real_distribution<float> phase(0.0f, 6.2831853f);
+    std::normal_distribution<float> noise(0.0f, 3.0f);
+    float amplitude = rmsVolts * std::sqrt(2.0f) / VOLTS_PER_COUNT;
+    float start = phase(random);
+    float third = 0.05f * (random() % 3);
+    for (size_t i = 0; i < window.size(); i++) {
+        float angle = start + 2.0f * 3.14159265f * 50.0f * 210e-6f * i;
+        float value = offset + amplitude * (std::sin(angle) + third * std::sin(3.0f * angle)) + noise(random);
+        window[i] = std::min(4095, std::max(0, (int)std::lrint(value)));
+    }
+}
+
+float fixedRms(const std::vector<int>& window, uint32_t voltsPerCountQ24) {
+    RmsAccumulator accumulator;
+    for (int reading : window) accumulator.add(reading);
+    return fromQ16(accumulator.rms(voltsPerCountQ24));
+}
+
+void checkRms(std::mt19937& random) {
+    const int sizes[] = {1, 2, 50, 150, 300, 600, 1000, 2000};
+    const uint32_t voltsPerCountQ24 = toQ24(VOLTS_PER_COUNT);
+    std::uniform_real_distribution<float> volts(0.0f, 300.0f);
+    std::uniform_real_distribution<float> offset(1500.0f, 2600.0f);
+    Worst worst;
+
+    for (int size : sizes) {
+        std::vector<int> window(size);
+        for (int trial = 0; trial < 2000; trial++) {
+            generateWindow(random, window, volts(random), offset(random));
+            worst.add(rmsFromSamples(window.data(), size, VOLTS_PER_COUNT), fixedRms(window, voltsPerCountQ24));
+        }
+
+        // Flat, full-scale square and rail-to-rail clipped windows
+        const int flats[] = {0, 2048, 4095};
+        for (int level : flats) {
+            std::fill(window.begin(), window.end(), level);
+            worst.add(rmsFromSamples(window.data(), size, VOLTS_PER_COUNT), fixedRms(window, voltsPerCountQ24));
+        }
+        for (int i = 0; i < size; i++) window[i] = i % 2 ? 4095 : 0;
+        worst.add(rmsFromSamples(window.data(), size, VOLTS_PER_COUNT), fixedRms(window, voltsPerCountQ24));
+        generateWindow(random, window, 500.0f, 2048.0f);
+        worst.add(rmsFromSamples(window.data(), size, VOLTS_PER_COUNT), fixedRms(window, voltsPerCountQ24));
+    }
+
+    std::printf("rms:   %ld windows, worst error %.6f V (limit %.3f)\n", worst.compared, worst.error,
+                RMS_TOLERANCE_V);
+    check(worst.error <= RMS_TOLERANCE_V, "RmsAccumulator::rms() differs from rmsFromSamples()");
+}
+
+// Long runs of the filter, as phase.avgVoltage sees them, at the alphas the
+// adaptive sampler picks. Both filters use the alpha as Q16 represents it: a
+// rounding of up to 7.6e-6 in alpha alone moves the average by that times
+// step / (e * alpha) during a step, 6 mV for a 230 V step at alpha 0.05.
+void checkEma(std::mt19937& random) {
+    const float alphas[] = {0.05f, 0.15f, 0.3f, 0.5f, 1.0f};
+    std::uniform_real_distribution<float> level(0.0f, 300.0f);
+    std::normal_distribution<float> noise(0.0f, 2.0f);
+    Worst worst;
+
+    for (float alpha : alphas) {
+        q16_t alphaQ16 = toQ16(alpha);
+        alpha = fromQ16(alphaQ16);
+        for (int run = 0; run < 200; run++) {
+            float target = level(random);
+            float average = target;
+            q16_t averageQ16 = toQ16(average);
+            for (int step = 0; step < 5000; step++) {
+                // Steps between levels as well as noise around one
+                if (step % 1000 == 999) target = level(random);
+                float value = std::max(0.0f, target + noise(random));
+                average = ema(average, value, alpha);
+                averageQ16 = emaQ16(averageQ16, toQ16(value), alphaQ16);
+                worst.add(average, fromQ16(averageQ16));
+            }
+        }
+    }
+
+    std::printf("ema:   %ld updates, worst error %.6f V (limit %.3f)\n", worst.compared, worst.error,
+                EMA_TOLERANCE_V);
+    check(worst.error <= EMA_TOLERANCE_V, "emaQ16() drifted from ema()");
+}
+
+void checkScore(std::mt19937& random) {
+    std::uniform_real_distribution<float> voltage(0.0f, 320.0f);
+    std::uniform_real_distribution<float> prediction(-25.0f, 25.0f);
+    std::uniform_real_distribution<float> variation(-1.0f, 60.0f);
+    std::uniform_real_distribution<float> waveform(0.0f, 100.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    Worst worst;
+
+    for (int set = 0; set < 50; set++) {
+        ScoringParams params = DEFAULT_SCORING_PARAMS;
+        if (set > 0) {
+            // Parameters from the range the policy tuner searches
+            params.targetVoltage = 210.0f + 20.0f * unit(random);
+            params.maxVoltageError = 20.0f + 60.0f * unit(random);
+            params.maxVariation = 10.0f + 40.0f * unit(random);
+            params.voltageWeight = unit(random);
+            params.stabilityWeight = 1.0f - params.voltageWeight;
+            params.waveformWeight = 0.5f * unit(random);
+            params.waveformVoltageWeight = (1.0f - params.waveformWeight) * unit(random);
+            params.waveformStabilityWeight = 1.0f - params.waveformWeight - params.waveformVoltageWeight;
+        }
+        ScoringParamsQ16 paramsQ16 = toQ16(params);
+        params = fromQ16(paramsQ16);
+
+        for (int trial = 0; trial < 20000; trial++) {
+            float average = voltage(random);
+            float predicted = average + prediction(random);
+            float spread = variation(random);
+            float quality = trial % 2 ? waveform(random) : -1.0f;
+            // Exact Q16 values, like the parameters, so the comparison
+            // measures the arithmetic rather than the rounding of the inputs
+            average = fromQ16(toQ16(average));
+            predicted = fromQ16(toQ16(predicted));
+            spread = fromQ16(toQ16(spread));
+            quality = fromQ16(toQ16(quality));
+
+            float reference = scorePhase(average, predicted, spread, quality, params);
+            float fixed = fromQ16(scorePhaseQ16(toQ16(average), toQ16(predicted), toQ16(spread),
+                                                toQ16(quality), paramsQ16));
+            worst.add(reference, fixed);
+        }
+    }
+
+    std::printf("score: %ld scores, worst error %.6f (limit %.3f)\n", worst.compared, worst.error,
+                SCORE_TOLERANCE);
+    check(worst.error <= SCORE_TOLERANCE, "scorePhaseQ16() differs from scorePhase()");
+}
+
+template <typename Body>
+double nsPerCall(long iterations, Body body) {
+    auto started = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) body(i);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() /
+           iterations;
+}
+
+void printTiming(const char* name, double floatNs, double fixedNs) {
+    std::printf("%-6s %12.1f %12.1f %8.2fx\n", name, floatNs, fixedNs, fixedNs > 0 ? floatNs / fixedNs : 0.0);
+}
+
+void benchmark(std::mt19937& random, long iterations) {
+    std::vector<int> window(SAMPLES);
+    generateWindow(random, window, 230.0f, 2048.0f);
+    const uint32_t voltsPerCountQ24 = toQ24(VOLTS_PER_COUNT);
+    const ScoringParamsQ16 paramsQ16 = toQ16(DEFAULT_SCORING_PARAMS);
+    long windows = std::max(1L, iterations / 100);
+
+    std::printf("\n%-6s %12s %12s %9s\n", "host", "float ns", "q16 ns", "speedup");
+    printTiming("rms",
+                nsPerCall(windows, [&](long) {
+                    sinkFloat = rmsFromSamples(window.data(), SAMPLES, VOLTS_PER_COUNT);
+                }),
+                nsPerCall(windows, [&](long) { sinkInt = toQ16(fixedRms(window, voltsPerCountQ24)); }));
+
+    float average = 230.0f;
+    q16_t averageQ16 = toQ16(average);
+    printTiming("ema",
+                nsPerCall(iterations, [&](long i) { sinkFloat = average = ema(average, 228.0f + (i & 7), 0.15f); }),
+                nsPerCall(iterations, [&](long i) {
+                    sinkInt = averageQ16 = emaQ16(averageQ16, (228 + (i & 7)) * Q16_ONE, 9830);
+                }));
+
+    printTiming("score",
+                nsPerCall(iterations, [&](long i) {
+                    float v = 225.0f + (i & 15);
+                    sinkFloat = scorePhase(v, v - 2.0f, 4.0f, 90.0f, DEFAULT_SCORING_PARAMS);
+                }),
+                nsPerCall(iterations, [&](long i) {
+                    q16_t v = (225 + (i & 15)) * Q16_ONE;
+                    sinkInt = scorePhaseQ16(v, v - 2 * Q16_ONE, 4 * Q16_ONE, 90 * Q16_ONE, paramsQ16);
+                }));
+    std::printf("Host CPUs have hardware floating point; the ESP32's cycle counts are in the bench env.\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 2000000;
+    std::mt19937 random(31);
+
+    checkRms(random);
+    checkEma(random);
+    checkScore(random);
+    int result = checkResult("fixed_point_test");
+
+    if (iterations > 0) benchmark(random, iterations);
+    return result;
+}
@@ -0,0 +1,175 @@
+// Break-before-make checks for the firmware's transfer planner
+// (relay_transfer.h). For every combination of waveform timing, relay
+// bounds and actual relay behaviour within those bounds, the target
+// contacts must close at least the guard time after the source contacts
+// open. Learning from biased load-side measurements must only ever widen
+// the bounds, and must cover the relay's real times once it has seen them.
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+
+#include "check.h"
+#include "relay_transfer.h"
+
+namespace {
+
+const uint32_t GUARD_US = 2000;
+
+bool notBefore(uint32_t a, uint32_t b) { return (int32_t)(a - b) >= 0; }
+
+ZeroCrossing wave(uint32_t timeUs, uint32_t periodUs) {
+    ZeroCrossing z = {timeUs, periodUs, 2048.0f, 1600.0f};
+    return z;
+}
+
+// The plan's own guarantees, independent of the actual relays
+void checkPlanShape(const TransferPlan& plan, const ZeroCrossing* source, const RelayTiming* sourceRelay,
+                    const ZeroCrossing& target, const RelayTiming& targetRelay, uint32_t earliest) {
+    check(notBefore(plan.releaseAt, earliest), "source released before the earliest start");
+    check(notBefore(plan.operateAt, plan.releaseAt), "target coil energised before the source coil released");
+
+    uint32_t openLatest = source ? plan.releaseAt + sourceRelay->maxReleaseUs : plan.releaseAt;
+    check(notBefore(plan.operateAt + targetRelay.minOperateUs, openLatest + GUARD_US),
+          "fastest close comes less than the guard after the slowest open");
+    check(notBefore(plan.closeAt, plan.openAt + GUARD_US), "expected gap shorter than the guard");
+
+    if (source && source->valid()) {
+        check(plan.sourceSynced && nextZeroCrossing(*source, plan.openAt) == plan.openAt,
+              "open not on a source zero crossing");
+    }
+    if (target.valid()) {
+        check(plan.targetSynced && nextZeroCrossing(target, plan.closeAt) == plan.closeAt,
+              "close not on a target zero crossing");
+    }
+
+    // The wait is bounded by the guard, the spread of the bounds and half a
+    // cycle of the target
+    uint32_t spread = (sourceRelay ? sourceRelay->maxReleaseUs : 0) + targetRelay.operateUs;
+    uint32_t halfCycle = target.valid() ? target.periodUs / 2 : 0;
+    check(plan.closeAt - plan.openAt <= GUARD_US + spread + halfCycle + 1, "gap longer than the bounds explain");
+}
+
+// Every relay that behaves within its bounds breaks before it makes
+void checkPlanInvariant() {
+    const uint32_t periods[] = {15385, 16667, 18182, 20000, 22222, 0};  // 65-45 Hz, dead
+    const uint32_t minOperates[] = {500, 2000, 5000, 10000};
+    const uint32_t operateExtra[] = {0, 3000, 15000};
+    const uint32_t releases[] = {500, 3000, 8000};
+    const uint32_t releaseExtra[] = {0, 2000, 10000};
+    const uint32_t earliests[] = {0, 123457, 0xFFFFF000u};
+
+    std::mt19937 random(46);
+    long plans = 0;
+    for (uint32_t sourcePeriod : periods) {
+        for (uint32_t targetPeriod : periods) {
+            for (int offset = 0; offset < 8; offset++) {
+                for (uint32_t earliest : earliests) {
+                    ZeroCrossing source = wave(earliest - 3000 * offset, sourcePeriod);
+                    ZeroCrossing target = wave(earliest - 2100 * offset - 777, targetPeriod);
+                    for (uint32_t minOp : minOperates) {
+                        for (uint32_t opExtra : operateExtra) {
+                            for (uint32_t rel : releases) {
+                                for (uint32_t relExtra : releaseExtra) {
+                                    RelayTiming sourceRelay = {minOp + opExtra, rel, minOp, rel + relExtra};
+                                    RelayTiming targetRelay = sourceRelay;
+                                    for (int withSource = 0; withSource < 2; withSource++) {
+                                        const ZeroCrossing* from = withSource ? &source : nullptr;
+                                        const RelayTiming* fromRelay = withSource ? &sourceRelay : nullptr;
+                                        TransferPlan plan = planTransfer(from, fromRelay, target, targetRelay,
+                                                                         earliest, GUARD_US);
+                                        checkPlanShape(plan, from, fromRelay, target, targetRelay, earliest);
+                                        plans++;
+
+                                        // Actual relays anywhere within the bounds
+                                        for (int trial = 0; trial < 4; trial++) {
+                                            uint32_t actualOperate = minOp + random() % 30000;
+                                            uint32_t actualRelease = withSource
+                                                ? random() % (sourceRelay.maxReleaseUs + 1) : 0;
+                                            if (trial == 0) {
+                                                actualOperate = minOp;
+                                                actualRelease = withSource ? sourceRelay.maxReleaseUs : 0;
+                                            }
+                                            uint32_t opened = plan.releaseAt + actualRelease;
+                                            uint32_t closed = plan.operateAt + actualOperate;
+                                            check(notBefore(closed, opened + GUARD_US),
+                                                  "contacts overlapped for a relay within its bounds");
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::printf("planTransfer: %ld plans checked\n", plans);
+}
+
+// Bounds after learning from load-side measurements that see the close up
+// to `band` late and the open up to `band` early
+void checkLearning() {
+    const RelayTiming datasheet = datasheetRelayTiming(2000, 10000, 1000, 5000);
+    std::mt19937 random(47);
+    int relays = 0;
+
+    // Real relays from faster to slower than the datasheet, within the
+    // quarter-to-four-times window that learning accepts
+    for (uint32_t trueOperate = 1500; trueOperate <= 24000; trueOperate += 1500) {
+        for (uint32_t trueRelease = 750; trueRelease <= 12000; trueRelease += 750) {
+            RelayTiming source = datasheet;
+            RelayTiming target = datasheet;
+            bool operateSeen = false;
+            bool releaseSeen = false;
+            relays++;
+
+            for (int transfer = 0; transfer < 100; transfer++) {
+                uint32_t band = 200 + random() % 800;
+                uint32_t previousMinOperate = target.minOperateUs;
+                uint32_t previousMaxRelease = source.maxReleaseUs;
+
+                // Once each side is within its bounds or has been measured,
+                // the relay must break before it makes
+                bool operateCovered = operateSeen || trueOperate >= target.minOperateUs;
+                bool releaseCovered = releaseSeen || trueRelease <= source.maxReleaseUs;
+                if (operateCovered && releaseCovered) {
+                    ZeroCrossing sourceWave = wave(0, 20000);
+                    ZeroCrossing targetWave = wave(6667 + transfer * 97, 20000);
+                    TransferPlan plan = planTransfer(&sourceWave, &source, targetWave, target,
+                                                     1000 + transfer * 3331, GUARD_US);
+                    check(notBefore(plan.operateAt + trueOperate, plan.releaseAt + trueRelease + GUARD_US),
+                          "learned timing let the contacts overlap");
+                }
+
+                uint32_t observedOperate = trueOperate + random() % (band + 1);
+                uint32_t observedRelease = trueRelease - random() % (std::min(band, trueRelease) + 1);
+                // Measurements within the mis-detection window are used
+                operateSeen |= observedOperate >= target.operateUs / 4 && observedOperate <= target.operateUs * 4;
+                releaseSeen |= observedRelease >= source.releaseUs / 4 && observedRelease <= source.releaseUs * 4;
+                learnOperateTime(target, observedOperate, band);
+                learnReleaseTime(source, observedRelease, band);
+
+                check(target.minOperateUs <= previousMinOperate, "learning raised the minimum operate time");
+                check(source.maxReleaseUs >= previousMaxRelease, "learning lowered the maximum release time");
+                check(target.minOperateUs <= datasheet.minOperateUs, "minimum operate above the datasheet's");
+                check(source.maxReleaseUs >= datasheet.maxReleaseUs, "maximum release below the datasheet's");
+                if (operateSeen) check(target.minOperateUs <= trueOperate, "minimum operate above the real one");
+                if (releaseSeen) check(source.maxReleaseUs >= trueRelease, "maximum release below the real one");
+            }
+            // Relays outside the datasheet range on the unsafe side must
+            // have been learned
+            if (trueOperate < datasheet.minOperateUs) check(operateSeen, "fast operate time never learned");
+            if (trueRelease > datasheet.maxReleaseUs) check(releaseSeen, "slow release time never learned");
+        }
+    }
+    std::printf("learnOperateTime/learnReleaseTime: %d relays checked\n", relays);
+}
+
+}  // namespace
+
+int main() {
+    checkPlanInvariant();
+    checkLearning();
+    return checkResult("relay_transfer_test");
+}
@@ -0,0 +1,183 @@
+// Checks for the firmware's cooperative scheduler (scheduler.h). Simulated
+// loop() passes with random jitter verify that periodic jobs do not drift,
+// that overruns are accounted for and skipped, that one-shot and cancelled
+// jobs behave, and that a callback may cancel or reschedule another job
+// waiting in the slot being walked.
+
+#include <cstdint>
+#include <random>
+
+#include "check.h"
+#include "scheduler.h"
+
+namespace {
+
+uint32_t fakeMicros = 0;
+uint32_t clockUs() { return fakeMicros; }
+
+typedef Scheduler<32, 10> FirmwareScheduler;
+
+struct Counter {
+    int runs = 0;
+    uint32_t lastRun = 0;
+    uint32_t* now = nullptr;
+};
+
+void countRun(void* context) {
+    Counter* counter = static_cast<Counter*>(context);
+    counter->runs++;
+    counter->lastRun = *counter->now;
+}
+
+// Periodic jobs over a simulated hour of loop() passes that start 0-30 ms
+// apart: the run count must match the elapsed periods exactly
+void checkDrift() {
+    uint32_t now = 1000;
+    FirmwareScheduler scheduler(clockUs);
+    Counter fast, slow;
+    fast.now = slow.now = &now;
+    Job fastJob("fast", countRun, &fast, 200, 100);
+    Job slowJob("slow", countRun, &slow, 5000, 1000);
+    scheduler.schedule(fastJob, now);
+    scheduler.schedule(slowJob, now);
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<uint32_t> jitter(0, 30);
+    const uint32_t start = now;
+    const uint32_t hour = 3600000;
+    while (now - start < hour) {
+        scheduler.run(now);
+        now += jitter(random);
+    }
+
+    check(fast.runs == (int)(hour / 200) || fast.runs == (int)(hour / 200) + 1, "fast job drifted");
+    check(slow.runs == (int)(hour / 5000) || slow.runs == (int)(hour / 5000) + 1, "slow job drifted");
+    check(fastJob.missedDeadlines == 0, "fast job missed deadlines under small jitter");
+    check(fastJob.skippedRuns == 0, "fast job skipped runs under small jitter");
+    check(fastJob.lateness.maxUs <= 30000, "fast job started later than the worst pass gap");
+}
+
+// A pass blocked for 1 s: the 200 ms job runs once, counts the missed
+// deadline and skips the periods it slept through instead of bursting
+void checkOverrun() {
+    uint32_t now = 0;
+    FirmwareScheduler scheduler(clockUs);
+    Counter counter;
+    counter.now = &now;
+    Job job("job", countRun, &counter, 200, 100);
+    scheduler.schedule(job, 200);
+
+    scheduler.run(now);
+    check(counter.runs == 0, "job ran before it was due");
+    now = 1250;
+    scheduler.run(now);
+    check(counter.runs == 1, "overdue job did not run exactly once");
+    check(job.missedDeadlines == 1, "missed deadline not counted");
+    check(job.skippedRuns == 5, "skipped periods not counted");
+    check(job.due == 1400, "job left its period grid after an overrun");
+}
+
+void checkOneShotAndCancel() {
+    uint32_t now = 0;
+    FirmwareScheduler scheduler(clockUs);
+    Counter once, cancelled;
+    once.now = cancelled.now = &now;
+    Job onceJob("once", countRun, &once);
+    Job cancelledJob("cancelled", countRun, &cancelled);
+    scheduler.scheduleIn(onceJob, 35, now);
+    scheduler.scheduleIn(cancelledJob, 35, now);
+    scheduler.cancel(cancelledJob);
+
+    for (now = 0; now < 1000; now += 5) scheduler.run(now);
+    check(once.runs == 1 && once.lastRun == 35, "one-shot job did not run once on time");
+    check(!onceJob.scheduled, "one-shot job still scheduled");
+    check(cancelled.runs == 0, "cancelled job ran");
+
+    // Scheduled for a time the wheel has already passed: runs next pass
+    scheduler.schedule(onceJob, now - 100);
+    scheduler.run(now);
+    check(once.runs == 2, "job scheduled in the past did not run");
+    check(scheduler.timeUntilNext(now, 20) == 20, "empty scheduler reported a deadline");
+}
+
+// A job whose callback cancels or reschedules another job
+struct Controller {
+    FirmwareScheduler* scheduler;
+    Job* target;
+    uint32_t* now;
+    bool reschedule;
+    int runs = 0;
+};
+
+void controlOther(void* context) {
+    Controller* controller = static_cast<Controller*>(context);
+    controller->runs++;
+    if (controller->reschedule) {
+        controller->scheduler->schedule(*controller->target, *controller->now + 50);
+    } else {
+        controller->scheduler->cancel(*controller->target);
+    }
+}
+
+// Three jobs due in the same tick. Slots are walked newest first, so the
+// first job's callback acts on the second while it and the third are still
+// in the detached chain.
+void checkCallbackControlsOther(bool reschedule) {
+    uint32_t now = 0;
+    FirmwareScheduler scheduler(clockUs);
+    Counter target, last;
+    target.now = last.now = &now;
+    Job lastJob("last", countRun, &last);
+    Job targetJob("target", countRun, &target);
+    Controller controller = {&scheduler, &targetJob, &now, reschedule};
+    Job controllerJob("controller", controlOther, &controller);
+    scheduler.run(now);  // The first pass walks every slot; keep it off the chain
+    scheduler.schedule(lastJob, 40);
+    scheduler.schedule(targetJob, 40);
+    scheduler.schedule(controllerJob, 40);
+
+    for (now = 0; now < 1000; now += 5) scheduler.run(now);
+    check(controller.runs == 1, "controlling job did not run once");
+    check(last.runs == 1, "job behind the controlled one in the slot was lost");
+    if (reschedule) {
+        check(target.runs == 1 && target.lastRun == 90, "rescheduled job did not run once at its new time");
+    } else {
+        check(target.runs == 0, "job cancelled by another job's callback still ran");
+    }
+    check(!targetJob.scheduled && !lastJob.scheduled, "one-shot job still scheduled");
+}
+
+// A periodic job that cancels itself from its callback
+struct SelfCancel {
+    FirmwareScheduler* scheduler;
+    Job* job;
+    int runs = 0;
+};
+
+void cancelSelf(void* context) {
+    SelfCancel* self = static_cast<SelfCancel*>(context);
+    if (++self->runs == 3) self->scheduler->cancel(*self->job);
+}
+
+void checkSelfCancel() {
+    FirmwareScheduler scheduler(clockUs);
+    SelfCancel self = {&scheduler, nullptr};
+    Job job("self", cancelSelf, &self, 100, 50);
+    self.job = &job;
+    scheduler.schedule(job, 100);
+
+    for (uint32_t now = 0; now < 2000; now += 5) scheduler.run(now);
+    check(self.runs == 3, "periodic job kept running after cancelling itself");
+}
+
+}  // namespace
+
+int main() {
+    checkDrift();
+    checkOverrun();
+    checkOneShotAndCancel();
+    checkCallbackControlsOther(false);
+    checkCallbackControlsOther(true);
+    checkSelfCancel();
+    return checkResult("scheduler");
+}
@@ -0,0 +1,123 @@
+// Lockout back-off of the firmware's switch controller
+// (switch_controller.h): flapping drives the lockout up to maxLockout, and
+// quiet time after the lockout runs out brings it back to baseLockout, so a
+// flapping episode does not hold back a legitimate switch hours later. The
+// hourly limit must stay within what the switch log can count.
+
+#include "check.h"
+#include "switch_controller.h"
+
+namespace {
+
+const SwitchPolicy& POLICY = DEFAULT_SWITCH_POLICY;
+const unsigned long SECOND = 1000;
+
+// Switches 10 s apart until the lockout is at its maximum; returns the time
+// of the last one
+unsigned long flap(SwitchController& controller, unsigned long start) {
+    controller.recordSwitch(start, true);
+    unsigned long now = start;
+    for (int i = 0; i < 8; i++) {
+        now += 10 * SECOND;
+        controller.recordSwitch(now, false);
+    }
+    return now;
+}
+
+// Drives evaluate() with phase 1 winning against an energised, healthy
+// phase 0 until the controller agrees. Returns the time it did, or 0 if it
+// was still blocked at `deadline`.
+unsigned long switchWhenAllowed(SwitchController& controller, unsigned long start, unsigned long deadline) {
+    for (unsigned long now = start; now <= deadline; now += SECOND) {
+        if (controller.evaluate(now, 1, 0, false)) return now;
+    }
+    return 0;
+}
+
+void testFlappingBacksOff() {
+    SwitchController controller;
+    unsigned long last = flap(controller, 0);
+    check(controller.currentLockout(last) == POLICY.maxLockout, "flapping did not reach maxLockout");
+
+    // No decay while the lockout is still running
+    check(controller.currentLockout(last + POLICY.maxLockout) == POLICY.maxLockout,
+          "lockout decayed before it ran out");
+    check(switchWhenAllowed(controller, last + SECOND, last + POLICY.maxLockout - SECOND) == 0,
+          "normal switch allowed during the flap lockout");
+}
+
+void testQuietDecays() {
+    SwitchController controller;
+    unsigned long last = flap(controller, 0);
+    unsigned long expired = last + POLICY.maxLockout;
+
+    check(controller.currentLockout(expired + POLICY.flapWindow) == POLICY.maxLockout / 2,
+          "one quiet flap window did not halve the lockout");
+    check(controller.currentLockout(expired + 2 * POLICY.flapWindow) == POLICY.maxLockout / 4,
+          "two quiet flap windows did not quarter the lockout");
+    check(controller.currentLockout(expired + 3600 * SECOND) == POLICY.baseLockout,
+          "an hour of quiet did not return to baseLockout");
+}
+
+void testFlapQuietSwitch() {
+    SwitchController controller;
+    unsigned long last = flap(controller, 0);
+
+    // Hours later a phase legitimately wins: it switches after the dwell,
+    // and the switch starts from baseLockout, not from the flap back-off
+    unsigned long later = last + 3 * 3600 * SECOND;
+    unsigned long switched = switchWhenAllowed(controller, later, later + POLICY.dwellTime + SECOND);
+    check(switched == later + POLICY.dwellTime, "switch after quiet not allowed once the dwell passed");
+    controller.recordSwitch(switched, false);
+    check(controller.currentLockout(switched) == POLICY.baseLockout,
+          "switch after quiet did not start from baseLockout");
+    check(controller.lockoutRemaining(switched + POLICY.baseLockout, false) == 0,
+          "lockout after quiet outlasted baseLockout");
+
+    // Flapping straight after it backs off again
+    controller.recordSwitch(switched + 40 * SECOND, false);
+    check(controller.currentLockout(switched + 40 * SECOND) == 2 * POLICY.baseLockout,
+          "switch within the flap window did not double the lockout");
+}
+
+void testFailedPhaseResets() {
+    SwitchController controller;
+    unsigned long last = flap(controller, 0);
+    controller.recordSwitch(last + 10 * SECOND, true);
+    check(controller.currentLockout(last + 10 * SECOND) == POLICY.baseLockout,
+          "leaving a failed phase did not reset the lockout");
+}
+
+// A policy asking for more switches per hour than the log remembers is
+// clamped, so the limit still engages
+void testRateLimitClamped() {
+    SwitchPolicy policy = DEFAULT_SWITCH_POLICY;
+    policy.maxSwitchesPerHour = 20;
+    policy.baseLockout = 0;
+    policy.flapWindow = 0;
+    policy.dwellTime = 0;
+    SwitchController controller(policy);
+    check(controller.policy().maxSwitchesPerHour == SwitchController::SWITCH_LOG_SIZE,
+          "maxSwitchesPerHour not clamped to the switch log");
+
+    unsigned long now = 0;
+    int switches = 0;
+    for (; switches < 20; switches++) {
+        now += 60 * SECOND;
+        if (!controller.evaluate(now, switches % 2 ? 0 : 1, switches % 2, false)) break;
+        controller.recordSwitch(now, false);
+    }
+    check(switches == SwitchController::SWITCH_LOG_SIZE, "hourly limit did not stop at the switch log size");
+    check(controller.blockReason() == SWITCH_BLOCKED_RATE, "hourly limit not reported as the block reason");
+}
+
+}  // namespace
+
+int main() {
+    testFlappingBacksOff();
+    testQuietDecays();
+    testFlapQuietSwitch();
+    testFailedPhaseResets();
+    testRateLimitClamped();
+    return checkResult("switch_controller");
+}
@@ -0,0 +1,413 @@
+#include "decision_sim.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "json.h"
+#include "phase_forecast.h"
+#include "robust_filter.h"
+#include "sensor_config.h"
+
+namespace {
+
+const float VOLTS_PER_COUNT = VREF / ADC_MAX * CALIBRATION_FACTOR;
+const float SAMPLE_PERIOD_US = 210.0f;             // analogRead() + delayMicroseconds(200)
+const uint32_t READ_MS = (uint32_t)(SAMPLES * SAMPLE_PERIOD_US / 1000.0f);  // One readVoltage() window
+const float ADC_MIDPOINT = 2048.0f;
+
+uint64_t splitmix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Standard normal value that depends only on its arguments, so readings
+// are reproducible without carrying generator state through the run
+float gaussian(uint64_t seed, int phase, uint32_t t) {
+    uint64_t h = splitmix(seed ^ splitmix(((uint64_t)phase << 32) | t));
+    double u1 = ((h >> 11) + 1) * (1.0 / 9007199254740993.0);
+    double u2 = (splitmix(h) >> 11) * (1.0 / 9007199254740992.0);
+    return (float)(sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+bool eventActive(const GridEvent& event, uint32_t t) {
+    return t >= event.start && t - event.start < event.duration;
+}
+
+}  // namespace
+
+DecisionParams firmwareDecisionParams() {
+    DecisionParams params;
+    params.scoring = DEFAULT_SCORING_PARAMS;
+    params.policy = DEFAULT_SWITCH_POLICY;
+    params.forecastHorizon = FORECAST_HORIZON;
+    return params;
+}
+
+float GridScenario::trueVoltage(int phase, uint32_t t) const {
+    float v;
+    if (!trace.time.empty()) {
+        const std::vector<uint32_t>& times = trace.time;
+        const std::vector<float>& values = trace.voltage[phase];
+        size_t next = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+        if (next == 0) {
+            v = values.front();
+        } else if (next == times.size()) {
+            v = values.back();
+        } else {
+            float f = (float)(t - times[next - 1]) / (times[next] - times[next - 1]);
+            v = values[next - 1] + f * (values[next] - values[next - 1]);
+        }
+    } else {
+        v = base[phase] + drift * sinf(t / 1200000.0f * 6.2832f + phase * 2.1f + (seed % 7));
+    }
+
+    for (const GridEvent& event : events) {
+        if (event.phase != phase || !eventActive(event, t)) continue;
+        uint32_t elapsed = t - event.start;
+        switch (event.kind) {
+            case GRID_SAG:
+            case GRID_SWELL:
+                v = event.level;
+                break;
+            case GRID_OUTAGE:
+                v = 0.0f;
+                break;
+            case GRID_RAMP:
+                v = std::max(v - event.rate * elapsed / 1000.0f, event.level);
+                break;
+            case GRID_FLAP:
+                if ((elapsed / event.period) & 1) v = event.level;
+                break;
+            case GRID_HUNT:
+                v += event.level * sinf(6.2832f * (elapsed % event.period) / event.period);
+                break;
+            case GRID_DROPOUT:
+                break;
+        }
+    }
+    return v;
+}
+
+float GridScenario::reading(int phase, uint32_t t) const {
+    for (const GridEvent& event : events) {
+        if (event.kind == GRID_DROPOUT && event.phase == phase && eventActive(event, t)) {
+            return 2.0f + fabsf(gaussian(seed, phase, t));
+        }
+    }
+    return std::max(trueVoltage(phase, t) + noise * gaussian(seed, phase, t), 0.0f);
+}
+
+GridScenario randomScenario(uint64_t seed, uint32_t duration, float eventsPerHour) {
+    std::mt19937_64 random(seed);
+    auto uniform = [&](double low, double high) {
+        return std::uniform_real_distribution<double>(low, high)(random);
+    };
+    // Durations spread over orders of magnitude
+    auto logUniform = [&](double low, double high) {
+        return exp(uniform(log(low), log(high)));
+    };
+
+    GridScenario scenario;
+    scenario.seed = seed;
+    scenario.duration = duration;
+    scenario.name = "random-" + std::to_string(seed);
+    for (int i = 0; i < NUM_PHASES; i++) scenario.base[i] = (float)uniform(208.0, 236.0);
+    scenario.noise = (float)uniform(0.3, 1.5);
+
+    std::poisson_distribution<int> eventCount(eventsPerHour * duration / 3600000.0);
+    int count = eventCount(random);
+    for (int i = 0; i < count; i++) {
+        GridEvent event = {};
+        event.phase = (int)(random() % NUM_PHASES);
+        event.start = (uint32_t)uniform(0.0, duration);
+        double kind = uniform(0.0, 1.0);
+        if (kind < 0.25) {
+            event.kind = GRID_SAG;
+            event.level = (float)uniform(150.0, 178.0);
+            event.duration = (uint32_t)logUniform(2000, 600000);
+        } else if (kind < 0.35) {
+            event.kind = GRID_SWELL;
+            event.level = (float)uniform(262.0, 280.0);
+            event.duration = (uint32_t)logUniform(2000, 300000);
+        } else if (kind < 0.50) {
+            event.kind = GRID_OUTAGE;
+            event.duration = (uint32_t)logUniform(1000, 1800000);
+        } else if (kind < 0.70) {
+            event.kind = GRID_RAMP;
+            event.level = (float)uniform(150.0, 175.0);
+            event.rate = (float)logUniform(0.05, 3.0);
+            event.duration = (uint32_t)logUniform(60000, 1200000);
+        } else if (kind < 0.85) {
+            event.kind = GRID_FLAP;
+            event.level = (float)uniform(160.0, 175.0);
+            event.period = (uint32_t)logUniform(5000, 60000);
+            event.duration = (uint32_t)logUniform(120000, 1200000);
+        } else if (kind < 0.95) {
+            event.kind = GRID_HUNT;
+            event.level = (float)uniform(5.0, 25.0);
+            event.period = (uint32_t)logUniform(2000, 20000);
+            event.duration = (uint32_t)logUniform(60000, 900000);
+        } else {
+            event.kind = GRID_DROPOUT;
+            event.duration = (uint32_t)logUniform(1000, 120000);
+        }
+        scenario.events.push_back(event);
+    }
+    return scenario;
+}
+
+std::vector<GridScenario> namedScenarios() {
+    const float BASES[3] = {221.0f, 233.0f, 208.0f};
+    GridScenario steady;
+    steady.seed = 1;
+    steady.duration = 3600000;
+    steady.drift = 2.0f;
+    for (int i = 0; i < NUM_PHASES; i++) steady.base[i] = BASES[i % 3];
+
+    std::vector<GridScenario> scenarios;
+    auto add = [&](const char* name, std::initializer_list<GridEvent> events) {
+        GridScenario scenario = steady;
+        scenario.name = name;
+        scenario.seed = scenarios.size() + 1;
+        scenario.events = events;
+        // Events on phases the profile does not have are dropped
+        scenario.events.erase(std::remove_if(scenario.events.begin(), scenario.events.end(),
+                                             [](const GridEvent& e) { return e.phase >= NUM_PHASES; }),
+                              scenario.events.end());
+        scenarios.push_back(scenario);
+    };
+
+    const uint32_t MINUTE = 60000;
+    add("steady", {});
+    add("brownout", {
+        {GRID_RAMP, 0, 10 * MINUTE, 22 * MINUTE, 170.0f, 0.43f, 0},
+        {GRID_RAMP, 1, 10 * MINUTE, 22 * MINUTE, 190.0f, 0.3f, 0},
+    });
+    add("flapping", {
+        {GRID_FLAP, 0, 10 * MINUTE, 15 * MINUTE, 170.0f, 0.0f, 20000},
+    });
+    add("slow-drift", {
+        {GRID_RAMP, 0, 5 * MINUTE, 50 * MINUTE, 172.0f, 0.02f, 0},
+    });
+    add("generator-hunting", {
+        {GRID_HUNT, 0, 10 * MINUTE, 30 * MINUTE, 15.0f, 0.0f, 6000},
+        {GRID_HUNT, 1, 10 * MINUTE, 30 * MINUTE, 15.0f, 0.0f, 6000},
+        {GRID_HUNT, 2, 10 * MINUTE, 30 * MINUTE, 15.0f, 0.0f, 6000},
+    });
+    add("sensor-dropout", {
+        {GRID_DROPOUT, 0, 10 * MINUTE, 30000, 0.0f, 0.0f, 0},
+        {GRID_DROPOUT, 0, 30 * MINUTE, 2 * MINUTE, 0.0f, 0.0f, 0},
+    });
+    return scenarios;
+}
+
+bool loadRecordedScenario(const std::string& path, GridScenario& scenario, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    JsonValue doc;
+    if (!parseJson(text.str(), doc)) {
+        error = path + ": not JSON";
+        return false;
+    }
+    const JsonValue* time = doc.get("time");
+    const JsonValue* voltage = doc.get("voltage");
+    if (!time || time->type != JsonValue::ARRAY || time->items.size() < 2 ||
+        !voltage || voltage->type != JsonValue::ARRAY) {
+        error = path + ": expected a fleet /api/history response";
+        return false;
+    }
+    if ((int)voltage->items.size() != NUM_PHASES) {
+        error = path + ": phase count does not match PHASE_TABLE";
+        return false;
+    }
+
+    scenario = GridScenario();
+    size_t slash = path.find_last_of('/');
+    scenario.name = slash == std::string::npos ? path : path.substr(slash + 1);
+    scenario.seed = std::hash<std::string>()(path);
+    double first = time->items.front().number;
+    for (const JsonValue& t : time->items) {
+        scenario.trace.time.push_back((uint32_t)(t.number - first));
+    }
+    for (int p = 0; p < NUM_PHASES; p++) {
+        const JsonValue& series = voltage->items[p];
+        if (series.items.size() != time->items.size()) {
+            error = path + ": voltage and time arrays differ in length";
+            return false;
+        }
+        for (const JsonValue& v : series.items) scenario.trace.voltage[p].push_back((float)v.number);
+    }
+    scenario.duration = scenario.trace.time.back();
+    return true;
+}
+
+void SimResult::add(const SimResult& other) {
+    switches += other.switches;
+    outOfBandMs += other.outOfBandMs;
+    simulatedMs += other.simulatedMs;
+    excursions += other.excursions;
+    escaped += other.escaped;
+    latencySumMs += other.latencySumMs;
+    latencyMaxMs = std::max(latencyMaxMs, other.latencyMaxMs);
+    readNs += other.readNs;
+    decideNs += other.decideNs;
+    reads += other.reads;
+    decisions += other.decisions;
+}
+
+SimResult simulateDecisions(const GridScenario& scenario, const DecisionParams& params,
+                            const SimOptions& options) {
+    typedef std::chrono::steady_clock Clock;
+    SimResult result;
+
+    SwitchController controller(params.policy);
+    AdaptiveSampler<NUM_PHASES> sampler(ADAPTIVE_SAMPLING_PARAMS);
+    HoltForecaster forecast[NUM_PHASES];
+    HampelFilter<OUTLIER_WINDOW> filter[NUM_PHASES];
+    float voltage[NUM_PHASES] = {};
+    float average[NUM_PHASES] = {};
+    float minVoltage[NUM_PHASES];
+    float maxVoltage[NUM_PHASES];
+    for (int i = 0; i < NUM_PHASES; i++) {
+        minVoltage[i] = 999.0f;
+        maxVoltage[i] = 0.0f;
+    }
+
+    int selected = 0;
+    bool active = false;
+    int readPhase = 0;
+    uint32_t readInterval = VOLTAGE_READ_INTERVAL;
+    bool accounting = false;
+    bool excursion = false;
+    uint32_t excursionStart = 0;
+    int samples[SAMPLES];
+
+    // The scheduler's jobs, run in the firmware's order when due together
+    uint32_t nextRead = 0;
+    uint32_t nextTrend = 0;
+    uint32_t nextReset = MIN_MAX_RESET_INTERVAL;
+
+    for (uint32_t t = 0; t < scenario.duration;) {
+        if (t >= nextRead) {
+            // readVoltageJob(): readVoltage() on one phase per run
+            float value = scenario.reading(readPhase, t);
+            if (options.synthesizeSamples) {
+                float amplitude = value * 1.41421f / VOLTS_PER_COUNT;
+                float phase = (t % 20) * 0.314f;
+                uint32_t dither = (uint32_t)t * 2654435761u;
+                for (int i = 0; i < SAMPLES; i++) {
+                    dither = dither * 1664525u + 1013904223u;
+                    float wave = sinf(6.2832f * 50.0f * SAMPLE_PERIOD_US * 1e-6f * i + phase);
+                    samples[i] = (int)(ADC_MIDPOINT + amplitude * wave) + (int)(dither >> 30) - 2;
+                }
+            }
+            Clock::time_point readStart;
+            if (options.timePipeline) readStart = Clock::now();
+            if (options.synthesizeSamples) value = rmsFromSamples(samples, SAMPLES, VOLTS_PER_COUNT);
+            bool plausible = filter[readPhase].update(value);
+            float alpha = VOLTAGE_EMA_ALPHA;
+            if (options.adaptiveSampling) {
+                sampler.update(readPhase, value, average[readPhase], forecast[readPhase].trendPerSecond(), t);
+                alpha = sampler.emaAlpha(VOLTAGE_EMA_ALPHA);
+            }
+            if (plausible || voltageOutOfBand(value)) voltage[readPhase] = value;
+            if (plausible) {
+                trackExtremes(value, minVoltage[readPhase], maxVoltage[readPhase]);
+                average[readPhase] = updateAverage(average[readPhase], value, alpha);
+                forecast[readPhase].update(value, t);
+            }
+            if (options.timePipeline) {
+                result.readNs += std::chrono::duration<double, std::nano>(Clock::now() - readStart).count();
+            }
+            result.reads++;
+            readPhase = (readPhase + 1) % NUM_PHASES;
+
+            // A trip back to full rate reads the next phase as soon as this
+            // one is done
+            uint32_t interval = options.adaptiveSampling ? sampler.interval() : VOLTAGE_READ_INTERVAL;
+            nextRead = interval < readInterval ? t + READ_MS : nextRead + interval;
+            readInterval = interval;
+        }
+
+        if (t >= nextReset) {
+            // resetMinMaxJob()
+            for (int i = 0; i < NUM_PHASES; i++) minVoltage[i] = maxVoltage[i] = average[i];
+            nextReset += MIN_MAX_RESET_INTERVAL;
+        }
+
+        if (t >= nextTrend) {
+            Clock::time_point decideStart;
+            if (options.timePipeline) decideStart = Clock::now();
+
+            // findBestPhase(), without waveform input
+            PhaseCandidate candidates[NUM_PHASES];
+            for (int i = 0; i < NUM_PHASES; i++) {
+                candidates[i].average = average[i];
+                candidates[i].forecast = forecast[i].predict(params.forecastHorizon);
+                candidates[i].variation = maxVoltage[i] - minVoltage[i];
+                candidates[i].waveformScore = -1.0f;
+                candidates[i].distorted = false;
+            }
+            int best = selectBestPhase(candidates, NUM_PHASES, [&](int, const PhaseCandidate& c) {
+                return scorePhase(c.average, c.forecast, c.variation, c.waveformScore, params.scoring);
+            });
+
+            // trendJob() and switchToPhase()
+            int current = active ? selected : -1;
+            bool currentFailed = voltageOutOfBand(voltage[selected]);
+            if (controller.evaluate(t, best, current, currentFailed) && !voltageOutOfBand(average[best])) {
+                if (active) {
+                    result.switches++;
+                    if (excursion) {
+                        double latency = t - excursionStart;
+                        result.escaped++;
+                        result.latencySumMs += latency;
+                        result.latencyMaxMs = std::max(result.latencyMaxMs, latency);
+                        excursion = false;
+                    }
+                }
+                controller.recordSwitch(t, !active || currentFailed);
+                selected = best;
+                active = true;
+            }
+            if (options.timePipeline) {
+                result.decideNs += std::chrono::duration<double, std::nano>(Clock::now() - decideStart).count();
+            }
+            result.decisions++;
+            nextTrend += TREND_UPDATE_INTERVAL;
+        }
+
+        // What the load saw until the next job runs
+        uint32_t next = std::min(std::min(nextRead, nextTrend), std::min(nextReset, scenario.duration));
+        if (active) accounting = true;
+        if (accounting) {
+            float v = active ? scenario.trueVoltage(selected, t) : 0.0f;
+            bool out = !active || voltageOutOfBand(v);
+            result.simulatedMs += next - t;
+            if (out) result.outOfBandMs += next - t;
+            if (out && !excursion) {
+                excursion = true;
+                excursionStart = t;
+                result.excursions++;
+            } else if (!out) {
+                excursion = false;
+            }
+        }
+        t = next;
+    }
+    return result;
+}
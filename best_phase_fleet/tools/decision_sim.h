@@ -0,0 +1,130 @@
+#pragma once
+
+// Host model of the firmware's acquisition and switching pipeline, for
+// tuning and benchmarking the decision code without hardware. It runs the
+// firmware's own code: the thresholds and timing of decision_config.h, the
+// statistics and phase selection of phase_selection.h, AdaptiveSampler,
+// HoltForecaster, HampelFilter and SwitchController. Only the scheduling
+// glue of readVoltageJob(), trendJob() and resetMinMaxJob() is repeated
+// here.
+//
+// A grid is a function from (phase, time) to the true RMS voltage, plus
+// reading noise and sensor faults. The whole scenario is derived from a
+// seed, so every parameter set sees exactly the same grid.
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "phase_config.h"
+#include "phase_selection.h"
+#include "switch_controller.h"
+
+// Everything the tuner may vary
+struct DecisionParams {
+    ScoringParams scoring;
+    SwitchPolicy policy;
+    uint32_t forecastHorizon;  // ms
+};
+
+DecisionParams firmwareDecisionParams();
+
+enum GridEventKind {
+    GRID_SAG,       // Step to `level` for `duration`
+    GRID_SWELL,     // Same, above the band
+    GRID_OUTAGE,    // Phase dead for `duration`
+    GRID_RAMP,      // Drift at `rate` V/s towards `level`, hold, then recover
+    GRID_FLAP,      // Toggle between nominal and `level` every `period`
+    GRID_HUNT,      // Oscillate by +-`level` V with `period` (generator governor hunting)
+    GRID_DROPOUT    // Sensor reads ~0 V although the phase is fine
+};
+
+struct GridEvent {
+    GridEventKind kind;
+    int phase;
+    uint32_t start;     // ms
+    uint32_t duration;  // ms
+    float level;
+    float rate;         // V/s, GRID_RAMP
+    uint32_t period;    // ms, GRID_FLAP and GRID_HUNT
+};
+
+// Recorded voltages (e.g. the fleet aggregator's /api/history), linearly
+// interpolated between samples
+struct GridTrace {
+    std::vector<uint32_t> time;                  // ms from the start
+    std::vector<float> voltage[NUM_PHASES];
+};
+
+struct GridScenario {
+    std::string name;
+    uint64_t seed = 1;
+    uint32_t duration = 3600000;  // ms
+    float base[NUM_PHASES] = {};
+    float drift = 3.0f;           // V, slow sinusoidal wander around base
+    float noise = 0.8f;           // V RMS on every reading
+    std::vector<GridEvent> events;
+    GridTrace trace;              // Used instead of base/drift when not empty
+
+    float trueVoltage(int phase, uint32_t t) const;
+    // What readVoltage() would compute: true voltage plus noise, or a
+    // sensor fault
+    float reading(int phase, uint32_t t) const;
+};
+
+// Random grid: per-phase base voltage and a Poisson mix of sags, swells,
+// outages, ramps, flapping and hunting, `eventsPerHour` on average
+GridScenario randomScenario(uint64_t seed, uint32_t duration, float eventsPerHour = 4.0f);
+
+// Fixed one-hour grids for tracking regressions, identical on every run.
+// Phase 1 starts closest to the target voltage, so it is selected first,
+// and it is the phase that takes the event:
+//   steady             no events (control)
+//   brownout           phase 1 sags to 170 V over 2 min and stays there for
+//                      20 min; phase 2 dips to 190 V with it
+//   flapping           phase 1 toggles to 170 V every 20 s for 15 min
+//   slow-drift         phase 1 sinks 1.2 V/min from 221 V to 172 V
+//   generator-hunting  every phase swings +-15 V over 6 s for 30 min
+//   sensor-dropout     phase 1's sensor reads ~0 V for 30 s, later 2 min
+std::vector<GridScenario> namedScenarios();
+
+// Loads a saved fleet /api/history response ({"time": [...], "voltage":
+// [[...], ...]}) as a scenario. Returns false with `error` set on failure.
+bool loadRecordedScenario(const std::string& path, GridScenario& scenario, std::string& error);
+
+struct SimOptions {
+    // Feed readVoltage() a synthetic 300-sample ADC window per reading
+    // and run the real RMS on it, instead of taking the RMS directly.
+    // Slower, but makes the pipeline's CPU time representative.
+    bool synthesizeSamples = false;
+    // Time the read and decision stages with a steady clock
+    bool timePipeline = false;
+    // Read at the AdaptiveSampler cadence like the shipped firmware
+    // (ENABLE_ADAPTIVE_SAMPLING), or at a fixed VOLTAGE_READ_INTERVAL
+    bool adaptiveSampling = true;
+};
+
+struct SimResult {
+    int switches = 0;             // Transfers, not counting the first energise
+    double outOfBandMs = 0.0;     // Load on an out-of-band phase or unpowered
+    double simulatedMs = 0.0;     // Accounted time, from the first energise
+    int excursions = 0;           // Times the active phase left the band
+    int escaped = 0;              // ... and the relay moved off it
+    double latencySumMs = 0.0;    // Excursion start to relay move, summed
+    double latencyMaxMs = 0.0;
+    double readNs = 0.0;          // timePipeline: readVoltage() model
+    double decideNs = 0.0;        // timePipeline: findBestPhase() and switching
+    long reads = 0;
+    long decisions = 0;
+
+    void add(const SimResult& other);
+    double meanLatencyMs() const { return escaped > 0 ? latencySumMs / escaped : 0.0; }
+    double switchesPerHour() const { return simulatedMs > 0 ? switches * 3600000.0 / simulatedMs : 0.0; }
+    double outOfBandSecondsPerHour() const {
+        return simulatedMs > 0 ? outOfBandMs / 1000.0 * 3600000.0 / simulatedMs : 0.0;
+    }
+};
+
+SimResult simulateDecisions(const GridScenario& scenario, const DecisionParams& params,
+                            const SimOptions& options = SimOptions());
@@ -0,0 +1,185 @@
+// Simulated detectors for exercising the aggregator without hardware.
+//
+//   bpd_fleet_sim [-p base_port] [-n count] [-k]
+//
+// Device i listens on base_port + i and answers GET /api/status with a
+// document shaped like the firmware's (phase names and count from
+// PHASE_TABLE). Voltages random-walk around 220 V; every fifth device
+// periodically sags a phase so switching shows up in the data. Like the
+// ESP32 WebServer, responses close the connection unless -k is given.
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "event_loop.h"
+#include "http.h"
+#include "json.h"
+#include "phase_config.h"
+
+const float LOW_VOLTAGE = 180.0f;
+
+struct SimDevice {
+    int listenFd = -1;
+    int selectedPhase = 0;
+    float voltage[NUM_PHASES];
+    float avgVoltage[NUM_PHASES];
+    bool sagging = false;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+static int openListener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static std::string statusJson(const SimDevice& device) {
+    std::string body = "{\"mode\":\"automatic\",";
+    char buffer[160];
+
+    int best = 0;
+    for (int p = 1; p < NUM_PHASES; p++) {
+        if (device.avgVoltage[p] > device.avgVoltage[best]) best = p;
+    }
+    snprintf(buffer, sizeof(buffer), "\"bestPhase\":%d,\"selectedPhase\":%d,\"phases\":[",
+             best, device.selectedPhase);
+    body += buffer;
+
+    for (int p = 0; p < NUM_PHASES; p++) {
+        if (p > 0) body += ',';
+        body += "{\"name\":";
+        appendJsonString(body, PHASE_TABLE[p].name);
+        snprintf(buffer, sizeof(buffer),
+                 ",\"voltage\":%.2f,\"avgVoltage\":%.2f,\"isActive\":%s}",
+                 device.voltage[p], device.avgVoltage[p], p == device.selectedPhase ? "true" : "false");
+        body += buffer;
+    }
+    body += "]}";
+    return body;
+}
+
+int main(int argc, char** argv) {
+    int basePort = 9000;
+    int count = 10;
+    bool keepAlive = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "p:n:k")) != -1) {
+        switch (option) {
+            case 'p': basePort = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 'k': keepAlive = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-p base_port] [-n count] [-k]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    EventLoop loop;
+    std::vector<SimDevice> devices(count);
+    std::unordered_map<int, std::string> inputs;  // Per client connection
+    std::mt19937 random(42);
+    std::normal_distribution<float> noise(0.0f, 1.5f);
+
+    for (int d = 0; d < count; d++) {
+        SimDevice& device = devices[d];
+        for (int p = 0; p < NUM_PHASES; p++) {
+            device.voltage[p] = device.avgVoltage[p] = 215.0f + 5.0f * p;
+        }
+        device.listenFd = openListener(basePort + d);
+        if (device.listenFd < 0) {
+            fprintf(stderr, "Cannot listen on port %d\n", basePort + d);
+            return 1;
+        }
+
+        loop.add(device.listenFd, EPOLLIN, [&, d](uint32_t) {
+            int fd;
+            while ((fd = accept4(devices[d].listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                inputs[fd].clear();
+                loop.add(fd, EPOLLIN | EPOLLRDHUP, [&, d, fd](uint32_t) {
+                    char buffer[2048];
+                    ssize_t n;
+                    bool closed = false;
+                    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) inputs[fd].append(buffer, n);
+                    if (n == 0) closed = true;
+
+                    HttpRequest request;
+                    long consumed = parseHttpRequest(inputs[fd], request);
+                    if (consumed != 0) {
+                        bool keep = keepAlive && consumed > 0 && request.keepAlive;
+                        std::string response =
+                            consumed < 0 ? formatHttpResponse(400, "text/plain", "Bad Request\n", false)
+                            : request.path == "/api/status"
+                                ? formatHttpResponse(200, "application/json", statusJson(devices[d]), keep)
+                                : formatHttpResponse(404, "text/plain", "Not Found\n", keep);
+                        // Small responses fit the socket buffer in one send
+                        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+                        if (consumed > 0) inputs[fd].erase(0, consumed);
+                        if (!keep) closed = true;
+                    }
+                    if (closed) {
+                        loop.remove(fd);
+                        close(fd);
+                        inputs.erase(fd);
+                    }
+                });
+            }
+        });
+    }
+
+    // Advance the simulated grid every 200 ms, like VOLTAGE_READ_INTERVAL
+    int64_t startMs = EventLoop::nowMs();
+    loop.setTick(200, [&]() {
+        if (stopRequested) {
+            loop.stop();
+            return;
+        }
+        int64_t elapsed = EventLoop::nowMs() - startMs;
+        for (int d = 0; d < count; d++) {
+            SimDevice& device = devices[d];
+            // Every fifth device sags its first phase for 10 s out of every 60 s
+            device.sagging = d % 5 == 0 && (elapsed / 1000 + d) % 60 < 10;
+            for (int p = 0; p < NUM_PHASES; p++) {
+                float target = (device.sagging && p == 0) ? 170.0f : 215.0f + 5.0f * p;
+                device.voltage[p] += 0.2f * (target - device.voltage[p]) + noise(random);
+                device.avgVoltage[p] = device.avgVoltage[p] * 0.85f + device.voltage[p] * 0.15f;
+            }
+            if (device.voltage[device.selectedPhase] < LOW_VOLTAGE) {
+                device.selectedPhase = (device.selectedPhase + 1) % NUM_PHASES;
+            }
+        }
+    });
+
+    fprintf(stderr, "Simulating %d devices on ports %d-%d\n", count, basePort, basePort + count - 1);
+    loop.run();
+    return 0;
+}
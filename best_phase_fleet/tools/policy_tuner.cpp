@@ -0,0 +1,316 @@
+// Monte Carlo search over the switching policy and scoring parameters,
+// run against the firmware's decision pipeline (decision_sim.h) on random
+// and recorded grids, in parallel on every core.
+//
+//   bpd_policy_tuner [-c candidates] [-s scenarios] [-H hours] [-t threads]
+//                    [-r refinements] [--seed n] [--scaling] [history.json ...]
+//
+// Every candidate runs on the same scenarios. It is scored on three costs,
+// all to be minimised: switches per hour, seconds per hour the load spent
+// out of band, and the mean latency from the active phase leaving the band
+// to the relay moving. The non-dominated candidates (the Pareto front) are
+// perturbed `-r` times each and searched again, and the final front is
+// printed next to the firmware defaults.
+//
+// Arguments that are not options are saved fleet /api/history responses,
+// replayed as recorded scenarios.
+//
+// --scaling runs a fixed batch with 1, 2, 4, ... threads up to -t and
+// prints the speedup.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "decision_sim.h"
+#include "work_stealing_pool.h"
+
+namespace {
+
+// One tunable value, searched on a normalised 0-1 axis
+struct Dimension {
+    const char* name;
+    double low;
+    double high;
+    bool logarithmic;
+};
+
+enum {
+    DIM_DWELL,           // SwitchPolicy::dwellTime, s
+    DIM_LOCKOUT,         // SwitchPolicy::baseLockout, s
+    DIM_OUTAGE_LOCKOUT,  // SwitchPolicy::outageLockout, s
+    DIM_MAX_PER_HOUR,    // SwitchPolicy::maxSwitchesPerHour
+    DIM_MAX_VARIATION,   // ScoringParams::maxVariation, V
+    DIM_VOLTAGE_WEIGHT,  // ScoringParams::voltageWeight; stability gets the rest
+    DIM_HORIZON,         // FORECAST_HORIZON, s
+    DIM_COUNT
+};
+
+const Dimension DIMENSIONS[DIM_COUNT] = {
+    {"dwell_s", 0.0, 60.0, false},
+    {"lockout_s", 5.0, 300.0, true},
+    {"outage_s", 1.0, 30.0, true},
+    {"max_per_h", 2.0, SwitchController::SWITCH_LOG_SIZE, false},  // What the switch log can count
+    {"max_var_v", 10.0, 60.0, false},
+    {"v_weight", 0.3, 0.9, false},
+    {"horizon_s", 0.0, 120.0, false},
+};
+
+typedef std::vector<double> Point;  // DIM_COUNT values in [0, 1]
+
+double denormalise(int dim, double x) {
+    const Dimension& d = DIMENSIONS[dim];
+    if (d.logarithmic) return exp(log(d.low) + x * (log(d.high) - log(d.low)));
+    return d.low + x * (d.high - d.low);
+}
+
+double normalise(int dim, double value) {
+    const Dimension& d = DIMENSIONS[dim];
+    if (d.logarithmic) return (log(value) - log(d.low)) / (log(d.high) - log(d.low));
+    return (value - d.low) / (d.high - d.low);
+}
+
+DecisionParams toParams(const Point& x) {
+    DecisionParams params = firmwareDecisionParams();
+    params.policy.dwellTime = (unsigned long)(denormalise(DIM_DWELL, x[DIM_DWELL]) * 1000);
+    params.policy.baseLockout = (unsigned long)(denormalise(DIM_LOCKOUT, x[DIM_LOCKOUT]) * 1000);
+    params.policy.outageLockout = (unsigned long)(denormalise(DIM_OUTAGE_LOCKOUT, x[DIM_OUTAGE_LOCKOUT]) * 1000);
+    params.policy.maxSwitchesPerHour = (uint8_t)lround(denormalise(DIM_MAX_PER_HOUR, x[DIM_MAX_PER_HOUR]));
+    params.scoring.maxVariation = (float)denormalise(DIM_MAX_VARIATION, x[DIM_MAX_VARIATION]);
+    float weight = (float)denormalise(DIM_VOLTAGE_WEIGHT, x[DIM_VOLTAGE_WEIGHT]);
+    params.scoring.voltageWeight = weight;
+    params.scoring.stabilityWeight = 1.0f - weight;  // The simulation has no waveform data
+    params.forecastHorizon = (uint32_t)(denormalise(DIM_HORIZON, x[DIM_HORIZON]) * 1000);
+    return params;
+}
+
+Point defaultPoint() {
+    DecisionParams params = firmwareDecisionParams();
+    Point x(DIM_COUNT);
+    x[DIM_DWELL] = normalise(DIM_DWELL, params.policy.dwellTime / 1000.0);
+    x[DIM_LOCKOUT] = normalise(DIM_LOCKOUT, params.policy.baseLockout / 1000.0);
+    x[DIM_OUTAGE_LOCKOUT] = normalise(DIM_OUTAGE_LOCKOUT, params.policy.outageLockout / 1000.0);
+    x[DIM_MAX_PER_HOUR] = normalise(DIM_MAX_PER_HOUR, params.policy.maxSwitchesPerHour);
+    x[DIM_MAX_VARIATION] = normalise(DIM_MAX_VARIATION, params.scoring.maxVariation);
+    x[DIM_VOLTAGE_WEIGHT] = normalise(DIM_VOLTAGE_WEIGHT, params.scoring.voltageWeight);
+    x[DIM_HORIZON] = normalise(DIM_HORIZON, params.forecastHorizon / 1000.0);
+    return x;
+}
+
+struct Candidate {
+    Point x;
+    SimResult total;
+    double costs[3] = {};  // switches/h, out-of-band s/h, mean latency s
+    bool onFront = false;
+};
+
+bool dominates(const Candidate& a, const Candidate& b) {
+    bool better = false;
+    for (int i = 0; i < 3; i++) {
+        if (a.costs[i] > b.costs[i]) return false;
+        if (a.costs[i] < b.costs[i]) better = true;
+    }
+    return better;
+}
+
+void markFront(std::vector<Candidate>& candidates) {
+    for (Candidate& c : candidates) {
+        c.onFront = true;
+        for (const Candidate& other : candidates) {
+            if (&other != &c && dominates(other, c)) {
+                c.onFront = false;
+                break;
+            }
+        }
+    }
+}
+
+// Runs every candidate from `first` on every scenario. Returns the number
+// of simulations.
+size_t evaluate(WorkStealingPool& pool, std::vector<Candidate>& candidates, size_t first,
+                const std::vector<GridScenario>& scenarios) {
+    size_t count = candidates.size() - first;
+    std::vector<SimResult> results(count * scenarios.size());
+    std::vector<DecisionParams> params(count);
+    for (size_t i = 0; i < count; i++) params[i] = toParams(candidates[first + i].x);
+
+    pool.parallelFor(results.size(), [&](size_t task) {
+        size_t candidate = task / scenarios.size();
+        results[task] = simulateDecisions(scenarios[task % scenarios.size()], params[candidate]);
+    });
+
+    for (size_t i = 0; i < count; i++) {
+        Candidate& c = candidates[first + i];
+        c.total = SimResult();
+        for (size_t s = 0; s < scenarios.size(); s++) c.total.add(results[i * scenarios.size() + s]);
+        c.costs[0] = c.total.switchesPerHour();
+        c.costs[1] = c.total.outOfBandSecondsPerHour();
+        c.costs[2] = c.total.meanLatencyMs() / 1000.0;
+    }
+    return results.size();
+}
+
+void printRow(const Candidate& c, const char* tag) {
+    std::printf("%7.2f %8.1f %7.1f", c.costs[0], c.costs[1], c.costs[2]);
+    for (int d = 0; d < DIM_COUNT; d++) {
+        double value = denormalise(d, c.x[d]);
+        std::printf(d == DIM_VOLTAGE_WEIGHT ? " %10.2f" : " %10.1f", value);
+    }
+    std::printf("  %s\n", tag);
+}
+
+double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+void runScaling(unsigned maxThreads, const std::vector<GridScenario>& scenarios, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<Candidate> batch(32);
+    for (Candidate& c : batch) {
+        c.x.resize(DIM_COUNT);
+        for (double& v : c.x) v = unit(random);
+    }
+
+    std::printf("%8s %10s %10s %10s\n", "threads", "seconds", "speedup", "efficiency");
+    double baseline = 0.0;
+    for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        WorkStealingPool pool(threads);
+        auto started = std::chrono::steady_clock::now();
+        evaluate(pool, batch, 0, scenarios);
+        double elapsed = seconds(started);
+        if (threads == 1) baseline = elapsed;
+        std::printf("%8u %10.2f %10.2f %9.0f%%\n", threads, elapsed, baseline / elapsed,
+                    100.0 * baseline / elapsed / threads);
+        if (threads == maxThreads) break;
+    }
+}
+
+void usage() {
+    std::fprintf(stderr, "usage: bpd_policy_tuner [-c candidates] [-s scenarios] [-H hours] [-t threads]\n"
+                         "                        [-r refinements] [--seed n] [--scaling] [history.json ...]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int candidateCount = 256;
+    int scenarioCount = 64;
+    double hours = 2.0;
+    unsigned threads = std::thread::hardware_concurrency();
+    int refinements = 8;
+    uint64_t seed = 1;
+    bool scaling = false;
+    std::vector<std::string> recorded;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-c") && hasValue) candidateCount = atoi(argv[++i]);
+        else if (!strcmp(arg, "-s") && hasValue) scenarioCount = atoi(argv[++i]);
+        else if (!strcmp(arg, "-H") && hasValue) hours = atof(argv[++i]);
+        else if (!strcmp(arg, "-t") && hasValue) threads = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(arg, "-r") && hasValue) refinements = atoi(argv[++i]);
+        else if (!strcmp(arg, "--seed") && hasValue) seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(arg, "--scaling")) scaling = true;
+        else if (arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            recorded.push_back(arg);
+        }
+    }
+    if (threads == 0) threads = 1;
+
+    std::vector<GridScenario> scenarios;
+    for (int i = 0; i < scenarioCount; i++) {
+        scenarios.push_back(randomScenario(seed * 1000003 + i, (uint32_t)(hours * 3600000)));
+    }
+    for (const std::string& path : recorded) {
+        GridScenario scenario;
+        std::string error;
+        if (!loadRecordedScenario(path, scenario, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        scenarios.push_back(scenario);
+    }
+    if (scenarios.empty()) {
+        usage();
+        return 2;
+    }
+    // Mean per scenario; recorded scenarios keep their own length
+    double scenarioHours = 0.0;
+    for (const GridScenario& s : scenarios) scenarioHours += s.duration / 3600000.0;
+    scenarioHours /= scenarios.size();
+
+    if (scaling) {
+        runScaling(threads, scenarios, seed);
+        return 0;
+    }
+
+    WorkStealingPool pool(threads);
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::normal_distribution<double> step(0.0, 0.08);
+
+    // Stage 1: the defaults plus uniform random candidates
+    std::vector<Candidate> candidates(1);
+    candidates[0].x = defaultPoint();
+    for (int i = 0; i < candidateCount; i++) {
+        Candidate c;
+        c.x.resize(DIM_COUNT);
+        for (double& v : c.x) v = unit(random);
+        candidates.push_back(c);
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    size_t simulations = evaluate(pool, candidates, 0, scenarios);
+    markFront(candidates);
+
+    // Stage 2: local perturbations around the front
+    std::vector<Point> seeds;
+    for (const Candidate& c : candidates) {
+        if (c.onFront) seeds.push_back(c.x);
+    }
+    size_t refined = candidates.size();
+    for (const Point& x : seeds) {
+        for (int i = 0; i < refinements; i++) {
+            Candidate c;
+            c.x = x;
+            for (double& v : c.x) v = std::min(1.0, std::max(0.0, v + step(random)));
+            candidates.push_back(c);
+        }
+    }
+    simulations += evaluate(pool, candidates, refined, scenarios);
+    markFront(candidates);
+    double elapsed = seconds(started);
+
+    std::printf("%zu candidates x %zu scenarios (%.1f grid hours each): %zu simulations in %.1f s "
+                "on %u threads, %.0f simulated hours/s, %llu steals\n\n",
+                candidates.size(), scenarios.size(), scenarioHours, simulations, elapsed, pool.threads(),
+                simulations * scenarioHours / elapsed,
+                (unsigned long long)pool.steals());
+
+    std::vector<const Candidate*> front;
+    for (const Candidate& c : candidates) {
+        if (c.onFront && &c != &candidates[0]) front.push_back(&c);
+    }
+    std::sort(front.begin(), front.end(), [](const Candidate* a, const Candidate* b) {
+        return a->costs[0] != b->costs[0] ? a->costs[0] < b->costs[0] : a->costs[1] < b->costs[1];
+    });
+
+    std::printf("%7s %8s %7s", "sw/h", "oob s/h", "lat s");
+    for (int d = 0; d < DIM_COUNT; d++) std::printf(" %10s", DIMENSIONS[d].name);
+    std::printf("\n");
+    printRow(candidates[0], candidates[0].onFront ? "firmware defaults (on the front)"
+                                                  : "firmware defaults (dominated)");
+    for (const Candidate* c : front) printRow(*c, "");
+    return 0;
+}
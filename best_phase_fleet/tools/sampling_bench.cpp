@@ -0,0 +1,184 @@
+// Simulates the firmware's acquisition loop against synthetic grid
+// scenarios and compares the fixed read cadence with the adaptive one
+// (adaptive_sampling.h): CPU spent acquiring versus how long it takes to
+// see a phase leave the safe band.
+//
+//   bpd_sampling_bench [trials]
+//
+// A read blocks for SAMPLES x 200 us (60 ms) and covers one phase, round
+// robin, exactly as readVoltage() does. Readings carry 0.8 V RMS noise on
+// top of a slow drift. Latency is measured from the moment the true voltage
+// crosses the threshold to the first reading of that phase beyond it, as
+// isPhaseOutOfBand() sees it: out-of-band readings skip the outlier filter
+// (robust_filter.h), which only guards the statistics.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "decision_config.h"
+#include "phase_forecast.h"
+#include "robust_filter.h"
+#include "sensor_config.h"
+
+namespace {
+
+const int PHASES = 3;
+const float READ_COST_MS = SAMPLES * 0.2f;  // SAMPLES x delayMicroseconds(200)
+const uint32_t RUN_MS = 2 * 3600 * 1000;
+const float NOISE_RMS = 0.8f;
+
+enum EventKind { EVENT_NONE, EVENT_STEP_SAG, EVENT_SWELL, EVENT_COLLAPSE, EVENT_SLOW_SAG };
+
+struct Scenario {
+    const char* name;
+    EventKind kind;
+    float rate;  // V/s for ramps
+};
+
+const Scenario SCENARIOS[] = {
+    {"steady", EVENT_NONE, 0.0f},
+    {"step sag to 170 V", EVENT_STEP_SAG, 0.0f},
+    {"swell to 270 V", EVENT_SWELL, 0.0f},
+    {"collapse 5 V/s", EVENT_COLLAPSE, 5.0f},
+    {"slow sag 20 V/min", EVENT_SLOW_SAG, 20.0f / 60.0f},
+};
+
+struct Policy {
+    const char* name;
+    bool adaptive;
+    uint32_t maxInterval;
+};
+
+const Policy POLICIES[] = {
+    {"fixed 200 ms", false, 200},
+    {"adaptive to 800 ms", true, 800},
+    {"adaptive to 1600 ms", true, 1600},
+};
+
+struct Grid {
+    float base[PHASES];
+    int eventPhase;
+    uint32_t eventStart;
+    const Scenario* scenario;
+
+    float trueVoltage(int phase, uint32_t t) const {
+        float v = base[phase] + 3.0f * sinf(t / 1200000.0f * 6.2832f + phase);
+        if (phase != eventPhase || scenario->kind == EVENT_NONE || t < eventStart) return v;
+        float seconds = (t - eventStart) / 1000.0f;
+        switch (scenario->kind) {
+            case EVENT_STEP_SAG: return 170.0f;
+            case EVENT_SWELL: return 270.0f;
+            case EVENT_COLLAPSE:
+            case EVENT_SLOW_SAG: return std::max(v - scenario->rate * seconds, 120.0f);
+            default: return v;
+        }
+    }
+
+    bool outOfBand(float v) const { return v < UNDERVOLTAGE_THRESHOLD || v > OVERVOLTAGE_THRESHOLD; }
+
+    // First millisecond at which the true voltage leaves the band
+    uint32_t crossing() const {
+        for (uint32_t t = eventStart; t < RUN_MS; t++) {
+            if (outOfBand(trueVoltage(eventPhase, t))) return t;
+        }
+        return RUN_MS;
+    }
+};
+
+struct Result {
+    double busyMs = 0;
+    long reads = 0;
+    std::vector<double> latencies;
+};
+
+void simulate(const Policy& policy, const Grid& grid, std::mt19937& random, Result& result) {
+    AdaptiveSamplingParams params = ADAPTIVE_SAMPLING_PARAMS;
+    params.maxInterval = policy.maxInterval;
+    AdaptiveSampler<PHASES> sampler(params);
+    HoltForecaster forecast[PHASES];
+    float average[PHASES] = {};
+    HampelFilter<OUTLIER_WINDOW> filter[PHASES];
+    std::normal_distribution<float> noise(0.0f, NOISE_RMS);
+
+    uint32_t crossing = grid.scenario->kind == EVENT_NONE ? RUN_MS : grid.crossing();
+    bool detected = false;
+    int phase = 0;
+    uint32_t t = 0;
+    while (t < RUN_MS) {
+        float reading = grid.trueVoltage(phase, t) + noise(random);
+        result.reads++;
+        result.busyMs += READ_COST_MS;
+
+        bool plausible = filter[phase].update(reading);
+        if (!detected && phase == grid.eventPhase && t >= crossing &&
+            grid.outOfBand(reading)) {
+            result.latencies.push_back(t - crossing);
+            detected = true;
+        }
+
+        uint32_t interval = VOLTAGE_READ_INTERVAL;
+        float alpha = VOLTAGE_EMA_ALPHA;
+        if (policy.adaptive) {
+            bool wasSlow = !sampler.atFullRate();
+            SamplingTrip trip = sampler.update(phase, reading, average[phase],
+                                               forecast[phase].trendPerSecond(), t);
+            alpha = sampler.emaAlpha(VOLTAGE_EMA_ALPHA);
+            // The firmware reads again right away when it trips from a slower rate
+            interval = (trip != TRIP_NONE && wasSlow) ? 0 : sampler.interval();
+        }
+        if (plausible) {
+            forecast[phase].update(reading, t);
+            average[phase] = average[phase] == 0.0f ? reading : average[phase] + alpha * (reading - average[phase]);
+        }
+
+        phase = (phase + 1) % PHASES;
+        t += std::max<uint32_t>(interval, (uint32_t)READ_COST_MS);
+    }
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int trials = argc > 1 ? std::atoi(argv[1]) : 20;
+
+    std::printf("%-20s %-20s %9s %8s %10s %10s %10s\n",
+                "scenario", "policy", "reads/min", "cpu %", "lat mean", "lat p95", "lat max");
+    for (const Scenario& scenario : SCENARIOS) {
+        for (const Policy& policy : POLICIES) {
+            Result result;
+            std::mt19937 random(1234);  // Same grids and noise for every policy
+            for (int trial = 0; trial < trials; trial++) {
+                std::uniform_real_distribution<float> base(215.0f, 235.0f);
+                std::uniform_int_distribution<uint32_t> start(RUN_MS / 4, RUN_MS / 2);
+                Grid grid = {{base(random), base(random), base(random)}, trial % PHASES,
+                             start(random), &scenario};
+                simulate(policy, grid, random, result);
+            }
+
+            double minutes = (double)RUN_MS * trials / 60000.0;
+            double mean = 0.0;
+            for (double latency : result.latencies) mean += latency;
+            if (!result.latencies.empty()) mean /= result.latencies.size();
+
+            std::printf("%-20s %-20s %9.1f %8.1f", scenario.name, policy.name,
+                        result.reads / minutes, 100.0 * result.busyMs / ((double)RUN_MS * trials));
+            if (scenario.kind == EVENT_NONE) {
+                std::printf(" %10s %10s %10s\n", "-", "-", "-");
+            } else {
+                std::printf(" %8.0fms %8.0fms %8.0fms\n", mean, percentile(result.latencies, 0.95),
+                            percentile(result.latencies, 1.0));
+            }
+        }
+    }
+    return 0;
+}
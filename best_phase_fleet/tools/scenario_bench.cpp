@@ -0,0 +1,169 @@
+// Scoreboard for the firmware's switching decisions on the named grid
+// scenarios (decision_sim.h), for tracking regressions between firmware
+// changes.
+//
+//   bpd_scenario_bench [-s scenario] [-n repeats] [--json file] [history.json ...]
+//
+// Per scenario: relay transfers, seconds the load spent out of band (or
+// unpowered), latency from the active phase leaving the band to the relay
+// moving, and host CPU time per simulated hour of the readVoltage() and
+// findBestPhase() model. Reads run the real RMS over a synthesised
+// 300-sample window. The decisions are deterministic; the CPU times are the
+// fastest of `-n` runs.
+//
+// `-s` (repeatable) limits the run to the given scenarios. Saved fleet
+// /api/history responses given as arguments are added as scenarios.
+// `--json` writes the results to a file ("-" for stdout) for CI and
+// dashboards; the table goes to stdout either way (stderr with --json -).
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "decision_sim.h"
+#include "json.h"
+
+namespace {
+
+struct Row {
+    std::string name;
+    double hours;
+    SimResult result;
+};
+
+double cpuMsPerHour(double ns, double hours) {
+    return hours > 0 ? ns / 1e6 / hours : 0.0;
+}
+
+void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string& out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) out.append(buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+std::string toJson(const std::vector<Row>& rows) {
+    std::string body = "{\"tool\":\"bpd_scenario_bench\",\"version\":1,\"scenarios\":[";
+    for (size_t i = 0; i < rows.size(); i++) {
+        const Row& row = rows[i];
+        const SimResult& r = row.result;
+        if (i > 0) body += ",";
+        body += "{\"name\":";
+        appendJsonString(body, row.name);
+        appendf(body, ",\"hours\":%.3f,\"switches\":%d,\"out_of_band_s\":%.1f,\"excursions\":%d,\"escaped\":%d",
+                row.hours, r.switches, r.outOfBandMs / 1000.0, r.excursions, r.escaped);
+        appendf(body, ",\"latency_mean_s\":%.1f,\"latency_max_s\":%.1f,\"reads\":%ld,\"decisions\":%ld",
+                r.meanLatencyMs() / 1000.0, r.latencyMaxMs / 1000.0, r.reads, r.decisions);
+        appendf(body, ",\"read_cpu_ms_per_hour\":%.3f,\"decide_cpu_ms_per_hour\":%.3f}",
+                cpuMsPerHour(r.readNs, row.hours), cpuMsPerHour(r.decideNs, row.hours));
+    }
+    body += "]}\n";
+    return body;
+}
+
+void printTable(FILE* out, const std::vector<Row>& rows) {
+    std::fprintf(out, "%-20s %8s %9s %10s %9s %9s %13s %13s\n", "scenario", "switches", "oob s",
+                 "excursions", "lat s", "max s", "read ms/h", "decide ms/h");
+    for (const Row& row : rows) {
+        const SimResult& r = row.result;
+        std::fprintf(out, "%-20s %8d %9.1f %5d/%-4d %9.1f %9.1f %13.2f %13.3f\n", row.name.c_str(),
+                     r.switches, r.outOfBandMs / 1000.0, r.escaped, r.excursions,
+                     r.meanLatencyMs() / 1000.0, r.latencyMaxMs / 1000.0,
+                     cpuMsPerHour(r.readNs, row.hours), cpuMsPerHour(r.decideNs, row.hours));
+    }
+    std::fprintf(out, "excursions: escaped by a transfer / total. CPU is host time for the pipeline model.\n");
+}
+
+void usage() {
+    std::fprintf(stderr, "usage: bpd_scenario_bench [-s scenario] [-n repeats] [--json file] [history.json ...]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::string> selected;
+    std::vector<std::string> recorded;
+    int repeats = 3;
+    const char* jsonPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-s") && hasValue) selected.push_back(argv[++i]);
+        else if (!strcmp(arg, "-n") && hasValue) repeats = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(arg, "--json") && hasValue) jsonPath = argv[++i];
+        else if (arg[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            recorded.push_back(arg);
+        }
+    }
+
+    std::vector<GridScenario> scenarios;
+    for (const GridScenario& scenario : namedScenarios()) {
+        if (selected.empty() || std::find(selected.begin(), selected.end(), scenario.name) != selected.end()) {
+            scenarios.push_back(scenario);
+        }
+    }
+    for (const std::string& name : selected) {
+        bool known = std::any_of(scenarios.begin(), scenarios.end(),
+                                 [&](const GridScenario& s) { return s.name == name; });
+        if (!known) {
+            std::fprintf(stderr, "unknown scenario: %s\n", name.c_str());
+            return 2;
+        }
+    }
+    for (const std::string& path : recorded) {
+        GridScenario scenario;
+        std::string error;
+        if (!loadRecordedScenario(path, scenario, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        scenarios.push_back(scenario);
+    }
+
+    SimOptions options;
+    options.synthesizeSamples = true;
+    options.timePipeline = true;
+    DecisionParams params = firmwareDecisionParams();
+
+    std::vector<Row> rows;
+    for (const GridScenario& scenario : scenarios) {
+        Row row;
+        row.name = scenario.name;
+        row.hours = scenario.duration / 3600000.0;
+        for (int i = 0; i < repeats; i++) {
+            SimResult result = simulateDecisions(scenario, params, options);
+            if (i > 0) {
+                result.readNs = std::min(result.readNs, row.result.readNs);
+                result.decideNs = std::min(result.decideNs, row.result.decideNs);
+            }
+            row.result = result;
+        }
+        rows.push_back(row);
+    }
+
+    bool jsonToStdout = jsonPath && !strcmp(jsonPath, "-");
+    printTable(jsonToStdout ? stderr : stdout, rows);
+    if (jsonPath) {
+        std::string body = toJson(rows);
+        FILE* file = jsonToStdout ? stdout : std::fopen(jsonPath, "w");
+        if (!file) {
+            std::fprintf(stderr, "cannot write %s\n", jsonPath);
+            return 1;
+        }
+        std::fputs(body.c_str(), file);
+        if (!jsonToStdout) std::fclose(file);
+    }
+    return 0;
+}
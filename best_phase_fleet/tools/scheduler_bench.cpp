@@ -0,0 +1,76 @@
+// Times the firmware's cooperative scheduler (scheduler.h) on the host:
+// run() against the hand-rolled millis() checks it replaced, and
+// timeUntilNext(). Its behaviour is checked by tests/scheduler_test.cpp.
+//
+//   bpd_scheduler_bench [passes]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "scheduler.h"
+
+namespace {
+
+uint32_t fakeMicros = 0;
+uint32_t clockUs() { return fakeMicros; }
+
+typedef Scheduler<32, 10> FirmwareScheduler;
+
+void noop(void*) {}
+
+void benchmark(long passes) {
+    uint32_t now = 0;
+    FirmwareScheduler scheduler(clockUs);
+    const uint32_t periods[] = {200, 500, 5000, 300000, 1000, 60000};
+    Job* jobs[6];
+    for (int i = 0; i < 6; i++) {
+        jobs[i] = new Job("job", noop, nullptr, periods[i], periods[i] / 2);
+        scheduler.schedule(*jobs[i], periods[i]);
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    long ran = 0;
+    for (long i = 0; i < passes; i++) {
+        ran += scheduler.run(now);
+        now += 3;  // A busy loop(): a pass every few milliseconds
+    }
+    double wheelNs = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - started).count() / passes;
+
+    // The previous loop(): every interval checked on every pass
+    uint32_t last[6] = {};
+    volatile long naiveRan = 0;
+    now = 0;
+    started = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+        for (int j = 0; j < 6; j++) {
+            if (now - last[j] >= periods[j]) {
+                last[j] = now;
+                naiveRan = naiveRan + 1;
+            }
+        }
+        now += 3;
+    }
+    double naiveNs = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - started).count() / passes;
+
+    std::printf("%ld passes, %ld job runs\n", passes, ran);
+    std::printf("scheduler.run(): %.1f ns/pass (interval checks: %.1f ns/pass)\n", wheelNs, naiveNs);
+    std::printf("timeUntilNext(): ");
+    started = std::chrono::steady_clock::now();
+    volatile uint32_t wait = 0;
+    for (long i = 0; i < passes; i++) wait = wait + scheduler.timeUntilNext(now + (i & 1023), 20);
+    std::printf("%.1f ns/call\n", std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - started).count() / passes);
+
+    for (int i = 0; i < 6; i++) delete jobs[i];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    long passes = argc > 1 ? std::atol(argv[1]) : 10000000;
+    benchmark(passes);
+    return 0;
+}
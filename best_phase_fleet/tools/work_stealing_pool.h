@@ -0,0 +1,145 @@
+#pragma once
+
+// Fixed pool of worker threads for batches of independent tasks, with work
+// stealing. parallelFor() gives every worker one contiguous block of the
+// index range. A worker takes indices from the front of its own block, and
+// when it runs dry it steals the back half of the largest block left.
+// Uneven tasks (long scenarios, slow parameter sets) even out without all
+// workers contending on one shared queue.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads = std::thread::hardware_concurrency())
+        : blocks_(threads > 0 ? threads : 1) {
+        for (unsigned i = 0; i < blocks_.size(); i++) {
+            workers_.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned threads() const { return (unsigned)blocks_.size(); }
+    uint64_t steals() const { return steals_.load(); }
+
+    // Runs task(i) for every i in [0, count) and returns once all are done
+    void parallelFor(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) return;
+        size_t workers = blocks_.size();
+        for (size_t i = 0; i < workers; i++) {
+            std::lock_guard<std::mutex> lock(blocks_[i].mutex);
+            blocks_[i].begin = count * i / workers;
+            blocks_[i].end = count * (i + 1) / workers;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ = &task;
+        running_ = workers;
+        generation_++;
+        wake_.notify_all();
+        done_.wait(lock, [this] { return running_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    // alignas keeps workers from sharing cache lines for their block bounds
+    struct alignas(64) Block {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void workerLoop(unsigned self) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(size_t)>* task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+                if (stopping_) return;
+                seen = generation_;
+                task = task_;
+            }
+
+            size_t index;
+            while (takeOwn(self, index) || (steal(self) && takeOwn(self, index))) {
+                (*task)(index);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--running_ == 0) done_.notify_one();
+        }
+    }
+
+    bool takeOwn(unsigned self, size_t& index) {
+        Block& block = blocks_[self];
+        std::lock_guard<std::mutex> lock(block.mutex);
+        if (block.begin >= block.end) return false;
+        index = block.begin++;
+        return true;
+    }
+
+    // Moves the back half of the largest other block into ours. Returns
+    // false once every block is empty.
+    bool steal(unsigned self) {
+        for (;;) {
+            size_t victim = self;
+            size_t largest = 0;
+            for (size_t i = 0; i < blocks_.size(); i++) {
+                if (i == self) continue;
+                std::lock_guard<std::mutex> lock(blocks_[i].mutex);
+                size_t remaining = blocks_[i].end - blocks_[i].begin;
+                if (blocks_[i].begin < blocks_[i].end && remaining > largest) {
+                    largest = remaining;
+                    victim = i;
+                }
+            }
+            if (victim == self) return false;
+
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(blocks_[victim].mutex);
+                if (blocks_[victim].begin >= blocks_[victim].end) continue;  // Emptied meanwhile
+                size_t middle = blocks_[victim].begin + (blocks_[victim].end - blocks_[victim].begin) / 2;
+                begin = middle;
+                end = blocks_[victim].end;
+                blocks_[victim].end = middle;
+            }
+            std::lock_guard<std::mutex> lock(blocks_[self].mutex);
+            blocks_[self].begin = begin;
+            blocks_[self].end = end;
+            steals_++;
+            return true;
+        }
+    }
+
+    std::vector<Block> blocks_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* task_ = nullptr;
+    uint64_t generation_ = 0;
+    size_t running_ = 0;
+    bool stopping_ = false;
+    std::atomic<uint64_t> steals_{0};
+};